@@ -824,12 +824,14 @@ int CSidechain::StartHeightForEpoch(int targetEpoch) const { return -1; }
 int CSidechain::SafeguardMargin() const { return -1; }
 size_t CSidechain::DynamicMemoryUsage() const { return 0; }
 bool CCoinsViewCache::isEpochDataValid(const CSidechain& info, int epochNumber, const uint256& endEpochBlockHash) {return true;}
-bool CCoinsViewCache::IsCertApplicableToState(const CScCertificate& cert, int nHeight, CValidationState& state, libzendoomc::CScProofVerifier& scVerifier) {return true;}
+bool CCoinsViewCache::IsCertApplicableToState(const CScCertificate& cert, int nHeight, CValidationState& state, libzendoomc::CScProofVerifier& scVerifier,
+                                              std::vector<libzendoomc::CScCertProofCheck>* pvChecks) {return true;}
 bool libzendoomc::CScProofVerifier::verifyCScCertificate(              
     const libzendoomc::ScConstant& constant,
     const libzendoomc::ScVk& wCertVk,
     const uint256& prev_end_epoch_block_hash,
-    const CScCertificate& scCert
+    const CScCertificate& scCert,
+    std::vector<libzendoomc::CScCertProofCheck>* pvChecks
 ) const { return true; }
 bool CCoinsViewCache::HaveScRequirements(const CTransaction& tx, int height) { return true;}
 size_t CSidechainEvents::DynamicMemoryUsage() const { return 0;}
@@ -838,7 +840,8 @@ size_t CSidechainEvents::DynamicMemoryUsage() const { return 0;}
 
 #include "consensus/validation.h"
 #include "main.h"
-bool CCoinsViewCache::IsCertApplicableToState(const CScCertificate& cert, int nHeight, CValidationState& state, libzendoomc::CScProofVerifier& scVerifier)
+bool CCoinsViewCache::IsCertApplicableToState(const CScCertificate& cert, int nHeight, CValidationState& state, libzendoomc::CScProofVerifier& scVerifier,
+                                              std::vector<libzendoomc::CScCertProofCheck>* pvChecks)
 {
     const uint256& certHash = cert.GetHash();
 
@@ -896,7 +899,7 @@ bool CCoinsViewCache::IsCertApplicableToState(const CScCertificate& cert, int nH
     uint256 prev_end_epoch_block_hash = chainActive[targetHeight] -> GetBlockHash();
 
     // Verify certificate proof
-    if (!scVerifier.verifyCScCertificate(scInfo.creationData.constant, scInfo.creationData.wCertVk, prev_end_epoch_block_hash, cert)){
+    if (!scVerifier.verifyCScCertificate(scInfo.creationData.constant, scInfo.creationData.wCertVk, prev_end_epoch_block_hash, cert, pvChecks)){
         LogPrintf("ERROR: certificate[%s] cannot be accepted for sidechain [%s]: proof verification failed\n",
             certHash.ToString(), cert.GetScId().ToString());
         return state.Invalid(error("proof not verified"),
@@ -43,9 +43,17 @@
 #include <ifaddrs.h>
 #include <limits.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #endif
 
+// ThreadSocketHandler uses an edge-triggered epoll loop where available and
+// falls back to select() elsewhere.
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define USE_EPOLL
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT        0
 #else
@@ -94,7 +102,7 @@ size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_EPOLL)
     return true;
 #else
     return (s < FD_SETSIZE);
@@ -0,0 +1,249 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2020 The Zen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace CuckooCache
+{
+
+/**
+ * A fixed-size array of flags, one bit each, that can be set and cleared
+ * concurrently from many threads. All flags start out set.
+ */
+class bit_packed_atomic_flags
+{
+    std::unique_ptr<std::atomic<uint8_t>[]> mem;
+
+public:
+    bit_packed_atomic_flags() = delete;
+
+    explicit bit_packed_atomic_flags(uint32_t size)
+    {
+        size = (size + 7) / 8;
+        mem.reset(new std::atomic<uint8_t>[size]);
+        for (uint32_t i = 0; i < size; ++i)
+            mem[i].store(0xFF);
+    }
+
+    /** Resize to b flags, all set. Not thread safe. */
+    void setup(uint32_t b)
+    {
+        bit_packed_atomic_flags d(b);
+        std::swap(mem, d.mem);
+    }
+
+    void bit_set(uint32_t s)
+    {
+        mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed);
+    }
+
+    void bit_unset(uint32_t s)
+    {
+        mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed);
+    }
+
+    bool bit_is_set(uint32_t s) const
+    {
+        return (1 << (s & 7)) & mem[s >> 3].load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * A set of small, uniformly distributed elements (such as salted hashes) in a
+ * single flat table, with cuckoo hashing over eight candidate slots.
+ *
+ * Nothing is stored beside the elements except one "may be erased" bit and one
+ * epoch bit per slot, so the table holds as many entries as its memory allows.
+ * Inserting overwrites an erasable slot, or moves an existing element to one of
+ * its other slots, and gives up after about log2(size) moves by dropping the
+ * element it holds at that point. Elements are marked erasable explicitly, by
+ * contains(e, true), or when they have survived two epochs of insertions
+ * without being erased (an epoch ends once about 45% of the table was filled
+ * in it), so that old entries make room for new ones.
+ *
+ * Thread safety: contains() may run on many threads at once, including with
+ * erase set, since erasing only sets an atomic flag. insert() and setup()
+ * need exclusive access.
+ *
+ * Hash must provide template<uint8_t n> uint32_t operator()(const Element&)
+ * for n in 0..7, returning independent uniformly distributed values.
+ */
+template <typename Element, typename Hash>
+class cache
+{
+private:
+    std::vector<Element> table;
+    uint32_t size;
+    //! Set for slots that may be overwritten
+    mutable bit_packed_atomic_flags collection_flags;
+    //! Set for slots written during the current epoch
+    mutable std::vector<bool> epoch_flags;
+    //! Insertions left before epoch_check() counts the table again
+    uint32_t epoch_heuristic_counter;
+    //! Number of new entries after which an epoch ends
+    uint32_t epoch_size;
+    //! Maximum number of moves made by one insert()
+    uint8_t depth_limit;
+    const Hash hash_function;
+
+    /**
+     * Map the eight hashes of e onto [0, size) without a division:
+     * (h * size) >> 32 is uniform over the table if h is uniform over 32 bits.
+     */
+    inline std::array<uint32_t, 8> compute_hashes(const Element& e) const
+    {
+        return {{(uint32_t)(((uint64_t)hash_function.template operator()<0>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<1>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<2>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<3>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<4>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<5>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<6>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<7>(e) * (uint64_t)size) >> 32)}};
+    }
+
+    constexpr uint32_t invalid() const
+    {
+        return ~(uint32_t)0;
+    }
+
+    inline void allow_erase(uint32_t n) const
+    {
+        collection_flags.bit_set(n);
+    }
+
+    inline void please_keep(uint32_t n) const
+    {
+        collection_flags.bit_unset(n);
+    }
+
+    /**
+     * End the epoch once epoch_size live entries were written in it: entries
+     * of the previous epoch become erasable and the current ones become old.
+     * Counting the table is linear, so it is only done after enough inserts
+     * that the epoch could have filled up.
+     */
+    void epoch_check()
+    {
+        if (epoch_heuristic_counter != 0) {
+            --epoch_heuristic_counter;
+            return;
+        }
+        uint32_t epoch_unused_count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            epoch_unused_count += epoch_flags[i] && !collection_flags.bit_is_set(i);
+        if (epoch_unused_count >= epoch_size) {
+            for (uint32_t i = 0; i < size; ++i) {
+                if (epoch_flags[i])
+                    epoch_flags[i] = false;
+                else
+                    allow_erase(i);
+            }
+            epoch_heuristic_counter = epoch_size;
+        } else {
+            epoch_heuristic_counter = std::max(1u, std::max(epoch_size / 16,
+                        epoch_size - std::min(epoch_size, epoch_unused_count)));
+        }
+    }
+
+public:
+    /** A cache that was not set up holds nothing: contains() is always false and insert() does nothing. */
+    cache() : table(), size(0), collection_flags(0), epoch_flags(),
+              epoch_heuristic_counter(0), epoch_size(0), depth_limit(0), hash_function()
+    {
+    }
+
+    /** Resize to new_size slots (at least 2), dropping all entries. Returns the number of slots. */
+    uint32_t setup(uint32_t new_size)
+    {
+        size = std::max<uint32_t>(2, new_size);
+        depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(size)));
+        table.clear();
+        table.resize(size);
+        collection_flags.setup(size);
+        epoch_flags.assign(size, false);
+        epoch_size = std::max<uint32_t>(1, (45 * (uint64_t)size) / 100);
+        epoch_heuristic_counter = epoch_size;
+        return size;
+    }
+
+    /** Resize to as many slots as fit in bytes. Returns the number of slots. */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        return setup(static_cast<uint32_t>(std::min<size_t>(bytes / sizeof(Element), invalid() - 1)));
+    }
+
+    /**
+     * Insert e, which then survives at least until the end of the next epoch
+     * unless it is erased or pushed out by a chain of moves longer than
+     * depth_limit. Inserting an element that is present refreshes it.
+     */
+    void insert(Element e)
+    {
+        if (size == 0)
+            return;
+        epoch_check();
+        uint32_t last_loc = invalid();
+        bool last_epoch = true;
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (const uint32_t loc : locs) {
+            if (table[loc] == e) {
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+        }
+        for (uint8_t depth = 0; depth < depth_limit; ++depth) {
+            for (const uint32_t loc : locs) {
+                if (!collection_flags.bit_is_set(loc))
+                    continue;
+                table[loc] = std::move(e);
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+            // Evict from the slot after the one we just moved into, so
+            // that an element is not sent straight back where it came from
+            last_loc = locs[(1 + (std::find(locs.begin(), locs.end(), last_loc) - locs.begin())) & 7];
+            std::swap(table[last_loc], e);
+            bool epoch = last_epoch;
+            last_epoch = epoch_flags[last_loc];
+            epoch_flags[last_loc] = epoch;
+            locs = compute_hashes(e);
+        }
+    }
+
+    /**
+     * Whether e is in the cache. With erase set, its slot may then be reused,
+     * though e keeps being found until that happens.
+     */
+    inline bool contains(const Element& e, const bool erase) const
+    {
+        if (size == 0)
+            return false;
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (const uint32_t loc : locs) {
+            if (table[loc] == e) {
+                if (erase)
+                    allow_erase(loc);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace CuckooCache
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -0,0 +1,380 @@
+// Copyright (c) 2020 The Zen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATMAP_H
+#define BITCOIN_FLATMAP_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+/**
+ * STL-like unordered map backed by a flat, open-addressing slot table with
+ * linear probing.
+ *
+ * Each slot only holds the cached hash of its key and a pointer to the entry,
+ * so probing walks a contiguous array instead of chasing bucket lists. Entries
+ * themselves live in an arena of geometrically growing chunks and are recycled
+ * through a free list, which replaces one heap allocation per entry with one
+ * per chunk.
+ *
+ * Guarantees mirror the subset of boost::unordered_map the coins cache relies
+ * on:
+ *  - references and pointers to entries stay valid until the entry is erased
+ *    or the map is cleared, even across a rehash;
+ *  - erase() only leaves a tombstone behind, so erasing while iterating (the
+ *    "erase(it++)" idiom) is safe;
+ *  - insertion may rehash and then invalidates iterators, like any unordered
+ *    container.
+ */
+template <typename K, typename V, typename Hash = boost::hash<K> >
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef size_t size_type;
+    typedef Hash hasher;
+
+private:
+    struct Slot
+    {
+        //! Entry in the arena, or NULL for an empty or deleted slot.
+        value_type* node;
+        //! Hash of the key when in use, SLOT_EMPTY or SLOT_DELETED otherwise.
+        size_t hash;
+    };
+
+    enum : size_t {
+        SLOT_EMPTY = 0,
+        SLOT_DELETED = 1,
+        MIN_SLOTS = 8,
+        MIN_CHUNK = 8,
+        MAX_CHUNK = 4096,
+    };
+
+    typedef typename std::aligned_storage<sizeof(value_type), std::alignment_of<value_type>::value>::type NodeStorage;
+
+    struct Chunk
+    {
+        NodeStorage* storage;
+        size_t size;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<Chunk> chunks;
+    std::vector<value_type*> freeNodes;
+    size_t nChunkUsed;
+    size_t nSize;
+    size_t nDeleted;
+    Hash hashFn;
+
+    template <typename SlotPtr, typename Ref, typename Ptr>
+    class iterator_base : public std::iterator<std::forward_iterator_tag, value_type, std::ptrdiff_t, Ptr, Ref>
+    {
+        friend class flatmap;
+        template <typename, typename, typename> friend class iterator_base;
+
+        SlotPtr cur;
+        SlotPtr last;
+
+        void skip() { while (cur != last && cur->node == NULL) ++cur; }
+
+    public:
+        iterator_base() : cur(NULL), last(NULL) {}
+        iterator_base(SlotPtr curIn, SlotPtr lastIn) : cur(curIn), last(lastIn) { skip(); }
+        template <typename S, typename R, typename P>
+        iterator_base(const iterator_base<S, R, P>& other) : cur(other.cur), last(other.last) {}
+
+        Ref operator*() const { return *cur->node; }
+        Ptr operator->() const { return cur->node; }
+        iterator_base& operator++() { ++cur; skip(); return *this; }
+        iterator_base operator++(int) { iterator_base ret = *this; ++*this; return ret; }
+
+        template <typename S, typename R, typename P>
+        bool operator==(const iterator_base<S, R, P>& other) const { return cur == other.cur; }
+        template <typename S, typename R, typename P>
+        bool operator!=(const iterator_base<S, R, P>& other) const { return cur != other.cur; }
+    };
+
+public:
+    typedef iterator_base<Slot*, value_type&, value_type*> iterator;
+    typedef iterator_base<const Slot*, const value_type&, const value_type*> const_iterator;
+
+    explicit flatmap(const Hash& hashIn = Hash()) : nChunkUsed(0), nSize(0), nDeleted(0), hashFn(hashIn) {}
+
+    flatmap(const flatmap& other) : nChunkUsed(0), nSize(0), nDeleted(0), hashFn(other.hashFn)
+    {
+        for (const_iterator it = other.begin(); it != other.end(); ++it)
+            insert(*it);
+    }
+
+    flatmap(flatmap&& other) : nChunkUsed(0), nSize(0), nDeleted(0), hashFn(other.hashFn)
+    {
+        swap(other);
+    }
+
+    flatmap& operator=(flatmap other)
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~flatmap() { clear(); }
+
+    void swap(flatmap& other)
+    {
+        slots.swap(other.slots);
+        chunks.swap(other.chunks);
+        freeNodes.swap(other.freeNodes);
+        std::swap(nChunkUsed, other.nChunkUsed);
+        std::swap(nSize, other.nSize);
+        std::swap(nDeleted, other.nDeleted);
+        std::swap(hashFn, other.hashFn);
+    }
+
+    iterator begin() { return iterator(slots.data(), slots.data() + slots.size()); }
+    iterator end() { return iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+    const_iterator begin() const { return const_iterator(slots.data(), slots.data() + slots.size()); }
+    const_iterator end() const { return const_iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+
+    size_type size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+    size_type bucket_count() const { return slots.size(); }
+
+    iterator find(const key_type& k)
+    {
+        size_t pos = lookup(k, hashOf(k));
+        return pos == slots.size() ? end() : iterator(slots.data() + pos, slots.data() + slots.size());
+    }
+
+    const_iterator find(const key_type& k) const
+    {
+        size_t pos = lookup(k, hashOf(k));
+        return pos == slots.size() ? end() : const_iterator(slots.data() + pos, slots.data() + slots.size());
+    }
+
+    size_type count(const key_type& k) const { return lookup(k, hashOf(k)) == slots.size() ? 0 : 1; }
+
+    mapped_type& at(const key_type& k)
+    {
+        size_t pos = lookup(k, hashOf(k));
+        if (pos == slots.size())
+            throw std::out_of_range("flatmap::at");
+        return slots[pos].node->second;
+    }
+
+    const mapped_type& at(const key_type& k) const
+    {
+        size_t pos = lookup(k, hashOf(k));
+        if (pos == slots.size())
+            throw std::out_of_range("flatmap::at");
+        return slots[pos].node->second;
+    }
+
+    mapped_type& operator[](const key_type& k)
+    {
+        return emplace_key(k, std::piecewise_construct, std::forward_as_tuple(k), std::forward_as_tuple()).first->second;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& v) { return emplace_key(v.first, v); }
+
+    template <typename P>
+    std::pair<iterator, bool> insert(P&& p) { return emplace_key(p.first, std::forward<P>(p)); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        // The key is needed before the entry can be placed, so build it in a
+        // fresh arena node first and hand the node back if the key exists.
+        value_type* node = allocateNode();
+        try {
+            new (node) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            freeNodes.push_back(node);
+            throw;
+        }
+        size_t h = hashOf(node->first);
+        size_t pos = lookup(node->first, h);
+        if (pos != slots.size()) {
+            destroyNode(node);
+            return std::make_pair(iterator(slots.data() + pos, slots.data() + slots.size()), false);
+        }
+        return std::make_pair(place(node, h), true);
+    }
+
+    size_type erase(const key_type& k)
+    {
+        size_t pos = lookup(k, hashOf(k));
+        if (pos == slots.size())
+            return 0;
+        eraseSlot(slots[pos]);
+        return 1;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        Slot* slot = slots.data() + (it.cur - slots.data());
+        eraseSlot(*slot);
+        return iterator(slot + 1, slots.data() + slots.size());
+    }
+
+    iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+    void clear()
+    {
+        for (Slot& slot : slots) {
+            if (slot.node != NULL)
+                slot.node->~value_type();
+        }
+        for (const Chunk& chunk : chunks)
+            delete[] chunk.storage;
+        std::vector<Slot>().swap(slots);
+        std::vector<Chunk>().swap(chunks);
+        std::vector<value_type*>().swap(freeNodes);
+        nChunkUsed = 0;
+        nSize = 0;
+        nDeleted = 0;
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        size_t usage = memusage::DynamicUsage(slots) + memusage::DynamicUsage(chunks) + memusage::DynamicUsage(freeNodes);
+        for (const Chunk& chunk : chunks)
+            usage += memusage::MallocUsage(sizeof(NodeStorage) * chunk.size);
+        return usage;
+    }
+
+private:
+    size_t hashOf(const key_type& k) const
+    {
+        // Keep SLOT_EMPTY and SLOT_DELETED free for the bookkeeping states.
+        size_t h = hashFn(k);
+        return h < 2 ? h + 2 : h;
+    }
+
+    size_t lookup(const key_type& k, size_t h) const
+    {
+        if (nSize == 0)
+            return slots.size();
+        const size_t mask = slots.size() - 1;
+        for (size_t pos = h & mask; ; pos = (pos + 1) & mask) {
+            const Slot& slot = slots[pos];
+            if (slot.node == NULL) {
+                if (slot.hash == SLOT_EMPTY)
+                    return slots.size();
+            } else if (slot.hash == h && slot.node->first == k) {
+                return pos;
+            }
+        }
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace_key(const key_type& k, Args&&... args)
+    {
+        size_t h = hashOf(k);
+        size_t pos = lookup(k, h);
+        if (pos != slots.size())
+            return std::make_pair(iterator(slots.data() + pos, slots.data() + slots.size()), false);
+        value_type* node = allocateNode();
+        try {
+            new (node) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            freeNodes.push_back(node);
+            throw;
+        }
+        return std::make_pair(place(node, h), true);
+    }
+
+    iterator place(value_type* node, size_t h)
+    {
+        // Keep the table at most 3/4 full counting tombstones, so probe
+        // sequences stay short and always reach an empty slot.
+        if ((nSize + nDeleted + 1) * 4 > slots.size() * 3)
+            rehash((nSize + 1) * 2 > slots.size() ? (slots.empty() ? size_t(MIN_SLOTS) : slots.size() * 2) : slots.size());
+        const size_t mask = slots.size() - 1;
+        size_t pos = h & mask;
+        while (slots[pos].node != NULL)
+            pos = (pos + 1) & mask;
+        if (slots[pos].hash == SLOT_DELETED)
+            --nDeleted;
+        slots[pos].node = node;
+        slots[pos].hash = h;
+        ++nSize;
+        return iterator(slots.data() + pos, slots.data() + slots.size());
+    }
+
+    void rehash(size_t nSlots)
+    {
+        std::vector<Slot> old(nSlots, Slot{NULL, SLOT_EMPTY});
+        old.swap(slots);
+        nDeleted = 0;
+        const size_t mask = slots.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.node == NULL)
+                continue;
+            size_t pos = slot.hash & mask;
+            while (slots[pos].node != NULL)
+                pos = (pos + 1) & mask;
+            slots[pos] = slot;
+        }
+    }
+
+    void eraseSlot(Slot& slot)
+    {
+        assert(slot.node != NULL);
+        destroyNode(slot.node);
+        slot.node = NULL;
+        slot.hash = SLOT_DELETED;
+        --nSize;
+        ++nDeleted;
+    }
+
+    value_type* allocateNode()
+    {
+        if (!freeNodes.empty()) {
+            value_type* node = freeNodes.back();
+            freeNodes.pop_back();
+            return node;
+        }
+        if (chunks.empty() || nChunkUsed == chunks.back().size) {
+            size_t nChunk = chunks.empty() ? MIN_CHUNK : std::min(chunks.back().size * 2, size_t(MAX_CHUNK));
+            chunks.push_back(Chunk{new NodeStorage[nChunk], nChunk});
+            nChunkUsed = 0;
+        }
+        return reinterpret_cast<value_type*>(&chunks.back().storage[nChunkUsed++]);
+    }
+
+    void destroyNode(value_type* node)
+    {
+        node->~value_type();
+        freeNodes.push_back(node);
+    }
+};
+
+namespace memusage
+{
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const flatmap<X, Y, Z>& m)
+{
+    return m.DynamicMemoryUsage();
+}
+
+}
+
+#endif // BITCOIN_FLATMAP_H
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <sc/asyncproofverifier.h>
+#include <primitives/certificate.h>
+#include <random.h>
+#include <utiltime.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+static std::vector<NodeId> servedPeers;
+static boost::mutex csServedPeers;
+
+static void RecordVerifiedCert(NodeId fromPeer, const CScCertificate& cert, bool fProofVerified)
+{
+    boost::unique_lock<boost::mutex> lock(csServedPeers);
+    servedPeers.push_back(fromPeer);
+}
+
+static std::shared_ptr<const CScCertificate> MakeCertificate()
+{
+    CMutableScCertificate mcert;
+    mcert.nVersion = SC_CERT_VERSION;
+    mcert.scId = GetRandHash();
+    mcert.epochNumber = 0;
+    mcert.endEpochBlockHash = GetRandHash();
+    return std::make_shared<const CScCertificate>(mcert);
+}
+
+TEST(AsyncProofVerifier, QueuesAreBoundedAndServedRoundRobin)
+{
+    CScAsyncProofVerifier& verifier = CScAsyncProofVerifier::getInstance();
+    verifier.SetCallback(&RecordVerifiedCert);
+    libzendoomc::ScConstant constant;
+    libzendoomc::ScVk vk;
+
+    // fill the queue of the first peer
+    std::vector<std::shared_ptr<const CScCertificate> > certs;
+    for (size_t i = 0; i < MAX_PENDING_CERT_PROOFS_PER_PEER; ++i)
+    {
+        certs.push_back(MakeCertificate());
+        libzendoomc::CScCertProofCheck check(constant, vk, uint256(), *certs.back());
+        ASSERT_TRUE(verifier.Enqueue(1, certs.back(), check));
+        ASSERT_TRUE(verifier.IsPending(certs.back()->GetHash()));
+    }
+
+    // the same certificate can not be queued twice
+    libzendoomc::CScCertProofCheck dupCheck(constant, vk, uint256(), *certs.front());
+    EXPECT_FALSE(verifier.Enqueue(2, certs.front(), dupCheck));
+
+    // the first peer can not queue any more certificate, while the second one can
+    certs.push_back(MakeCertificate());
+    libzendoomc::CScCertProofCheck exceedingCheck(constant, vk, uint256(), *certs.back());
+    EXPECT_FALSE(verifier.Enqueue(1, certs.back(), exceedingCheck));
+    EXPECT_FALSE(verifier.IsPending(certs.back()->GetHash()));
+    EXPECT_TRUE(verifier.Enqueue(2, certs.back(), exceedingCheck));
+
+    EXPECT_EQ(verifier.GetQueueDepth(), MAX_PENDING_CERT_PROOFS_PER_PEER + 1);
+
+    // drain the queues with a single worker
+    boost::thread worker(boost::bind(&CScAsyncProofVerifier::ThreadVerify, &verifier));
+    for (int i = 0; i < 1000 && verifier.GetQueueDepth() != 0; ++i)
+        MilliSleep(10);
+    worker.interrupt();
+    worker.join();
+
+    ASSERT_EQ(verifier.GetQueueDepth(), 0);
+    EXPECT_FALSE(verifier.IsPending(certs.front()->GetHash()));
+
+    // the single certificate of the second peer is served right after the first one of the first peer
+    boost::unique_lock<boost::mutex> lock(csServedPeers);
+    ASSERT_EQ(servedPeers.size(), MAX_PENDING_CERT_PROOFS_PER_PEER + 1);
+    EXPECT_EQ(servedPeers[0], 1);
+    EXPECT_EQ(servedPeers[1], 2);
+    EXPECT_EQ(servedPeers[2], 1);
+}
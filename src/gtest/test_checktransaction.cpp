@@ -408,6 +408,28 @@ TEST(checktransaction_tests, bad_txns_invalid_joinsplit_signature) {
     CheckTransactionWithoutProofVerification(tx, state);
 }
 
+TEST(checktransaction_tests, deferred_joinsplit_checks) {
+    CMutableTransaction mtx = GetValidTransaction();
+    ASSERT_FALSE(mtx.vjoinsplit.empty());
+    CTransaction tx(mtx);
+    auto verifier = libzcash::ProofVerifier::Disabled();
+
+    // the signature and proofs are queued instead of being verified
+    std::vector<CJoinSplitCheck> vChecks;
+    CValidationState state;
+    EXPECT_TRUE(CheckTransaction(tx, state, verifier, &vChecks));
+    ASSERT_EQ(1 + tx.GetVjoinsplit().size(), vChecks.size());
+    for (CJoinSplitCheck& check : vChecks)
+        EXPECT_TRUE(check());
+
+    mtx.joinSplitSig[0] += 1;
+    CTransaction txBadSig(mtx);
+    std::vector<CJoinSplitCheck> vBadChecks;
+    EXPECT_TRUE(CheckTransactionWithoutProofVerification(txBadSig, state, &vBadChecks));
+    ASSERT_EQ(1U, vBadChecks.size());
+    EXPECT_FALSE(vBadChecks[0]());
+}
+
 TEST(checktransaction_tests, non_canonical_ed25519_signature) {
     CMutableTransaction mtx = GetValidTransaction();
 
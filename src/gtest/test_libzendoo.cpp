@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <cstring>
 #include <utilstrencodings.h>
+#include "sc/proofverifier.h"
+#include "primitives/certificate.h"
+#include "arith_uint256.h"
 
 TEST(ZendooLib, FieldTest)
 {
@@ -259,4 +262,64 @@ TEST(ZendooLib, TestProofNoBwt){
     zendoo_sc_proof_free(proof);
     zendoo_sc_vk_free(vk);
     zendoo_field_free(constant);
-}
\ No newline at end of file
+}
+TEST(ZendooLib, DeferredCertProofCheck)
+{
+    CScCertificate cert;
+    libzendoomc::ScConstant constant;
+    libzendoomc::ScVk vk;
+    std::vector<libzendoomc::CScCertProofCheck> vChecks;
+
+    // A disabled verifier neither verifies nor defers anything
+    auto disabledVerifier = libzendoomc::CScProofVerifier::Disabled();
+    ASSERT_TRUE(disabledVerifier.verifyCScCertificate(constant, vk, uint256(), cert, &vChecks));
+    ASSERT_TRUE(vChecks.empty());
+
+    // A strict verifier defers the verification when a check vector is given
+    auto strictVerifier = libzendoomc::CScProofVerifier::Strict();
+    ASSERT_TRUE(strictVerifier.verifyCScCertificate(constant, vk, uint256(), cert, &vChecks));
+    ASSERT_EQ(vChecks.size(), 1);
+
+    // ...and the deferred check fails exactly as the inline verification does on a null proof
+    ASSERT_FALSE(vChecks[0]());
+    ASSERT_FALSE(strictVerifier.verifyCScCertificate(constant, vk, uint256(), cert));
+}
+
+TEST(ZendooLib, ScVkCacheLookupAndEviction)
+{
+    libzendoomc::CScVkCache& cache = libzendoomc::CScVkCache::getInstance();
+    cache.Clear();
+
+    libzendoomc::ScConstant constant(1, 0xAB);
+    libzendoomc::ScVk vk;
+    std::shared_ptr<field_t> constantHandle;
+    std::shared_ptr<sc_vk_t> vkHandle;
+
+    uint256 scId = ArithToUint256(arith_uint256(1));
+    ASSERT_FALSE(cache.Get(scId, constant, vk, constantHandle, vkHandle));
+
+    cache.Put(scId, constant, vk, constantHandle, vkHandle);
+    ASSERT_TRUE(cache.Get(scId, constant, vk, constantHandle, vkHandle));
+
+    // an entry never matches different serialized data
+    libzendoomc::ScConstant otherConstant(1, 0xCD);
+    ASSERT_FALSE(cache.Get(scId, otherConstant, vk, constantHandle, vkHandle));
+
+    cache.Erase(scId);
+    ASSERT_FALSE(cache.Get(scId, constant, vk, constantHandle, vkHandle));
+
+    // filling the cache beyond its capacity evicts the least recently used entry
+    for (size_t i = 0; i < libzendoomc::DEFAULT_SC_VK_CACHE_SIZE; ++i)
+        cache.Put(ArithToUint256(arith_uint256(i)), constant, vk, constantHandle, vkHandle);
+    ASSERT_EQ(cache.Size(), libzendoomc::DEFAULT_SC_VK_CACHE_SIZE);
+
+    // touch the oldest entry so that the second one becomes the eviction candidate
+    ASSERT_TRUE(cache.Get(ArithToUint256(arith_uint256(0)), constant, vk, constantHandle, vkHandle));
+    cache.Put(ArithToUint256(arith_uint256(libzendoomc::DEFAULT_SC_VK_CACHE_SIZE)), constant, vk, constantHandle, vkHandle);
+
+    ASSERT_EQ(cache.Size(), libzendoomc::DEFAULT_SC_VK_CACHE_SIZE);
+    ASSERT_TRUE(cache.Get(ArithToUint256(arith_uint256(0)), constant, vk, constantHandle, vkHandle));
+    ASSERT_FALSE(cache.Get(ArithToUint256(arith_uint256(1)), constant, vk, constantHandle, vkHandle));
+
+    cache.Clear();
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include "sync.h"
+#include "utiltime.h"
+
+#include <boost/thread.hpp>
+
+static const CLockProfileSite* FindLockSite(const std::vector<CLockProfileSite>& vSites, const std::string& strName)
+{
+    for (const CLockProfileSite& site : vSites) {
+        if (site.strName == strName)
+            return &site;
+    }
+    return nullptr;
+}
+
+class LockProfileTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        GetLockProfile(true);
+        fLockProfiling = true;
+    }
+
+    void TearDown() override {
+        fLockProfiling = false;
+        GetLockProfile(true);
+    }
+};
+
+TEST_F(LockProfileTest, RecordsLocksPerSite) {
+    CCriticalSection csProfiled;
+    for (int i = 0; i < 3; i++) {
+        LOCK(csProfiled);
+    }
+
+    std::vector<CLockProfileSite> vSites = GetLockProfile(false);
+    const CLockProfileSite* site = FindLockSite(vSites, "csProfiled");
+    ASSERT_TRUE(site != nullptr);
+    EXPECT_EQ(__FILE__, site->strFile);
+    EXPECT_EQ(3U, site->stats.nLocks);
+    EXPECT_EQ(0U, site->stats.nContended);
+    EXPECT_EQ(0U, site->stats.nTryFailed);
+
+    uint64_t nHoldSamples = 0;
+    for (int i = 0; i < CLockProfileStats::HISTOGRAM_BUCKETS; i++)
+        nHoldSamples += site->stats.vHoldHistogram[i];
+    EXPECT_EQ(3U, nHoldSamples);
+
+    // reset clears the statistics
+    GetLockProfile(true);
+    EXPECT_TRUE(FindLockSite(GetLockProfile(false), "csProfiled") == nullptr);
+
+    // nothing is recorded while profiling is disabled
+    fLockProfiling = false;
+    {
+        LOCK(csProfiled);
+    }
+    EXPECT_TRUE(FindLockSite(GetLockProfile(false), "csProfiled") == nullptr);
+}
+
+TEST_F(LockProfileTest, RecordsContentionAcrossThreads) {
+    CCriticalSection csContended;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fLocked = false;
+    bool fRelease = false;
+
+    boost::thread holder([&] {
+        LOCK(csContended);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fLocked = true;
+            cond.notify_all();
+            while (!fRelease)
+                cond.wait(lock);
+        }
+        MilliSleep(20);
+    });
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (!fLocked)
+            cond.wait(lock);
+    }
+    {
+        TRY_LOCK(csContended, lockTry);
+        EXPECT_FALSE(lockTry);
+    }
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRelease = true;
+        cond.notify_all();
+    }
+    {
+        LOCK(csContended);
+    }
+    holder.join();
+
+    // the samples of the exited thread are kept
+    std::vector<CLockProfileSite> vSites = GetLockProfile(false);
+    uint64_t nLocks = 0, nContended = 0, nTryFailed = 0;
+    int64_t nWaitMax = 0;
+    for (const CLockProfileSite& site : vSites) {
+        if (site.strName != "csContended")
+            continue;
+        nLocks += site.stats.nLocks;
+        nContended += site.stats.nContended;
+        nTryFailed += site.stats.nTryFailed;
+        nWaitMax = std::max(nWaitMax, site.stats.nWaitMax);
+    }
+    EXPECT_EQ(2U, nLocks);
+    EXPECT_EQ(1U, nContended);
+    EXPECT_EQ(1U, nTryFailed);
+    EXPECT_GT(nWaitMax, 0);
+}
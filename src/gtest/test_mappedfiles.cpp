@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "mappedfiles.h"
+#include "util.h"
+
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+
+class MappedFilesTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+        pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        ClearDatadirCache();
+        nMaxMappedFiles = mappedBlockFiles.GetMaxFiles();
+    }
+
+    void TearDown() override {
+        mappedBlockFiles.SetMaxFiles(nMaxMappedFiles);
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+
+    void AppendToFile(const boost::filesystem::path& path, const std::string& str) {
+        FILE* file = fopen(path.string().c_str(), "ab");
+        ASSERT_TRUE(file != NULL);
+        ASSERT_EQ(str.size(), fwrite(str.data(), 1, str.size(), file));
+        fclose(file);
+    }
+
+    boost::filesystem::path pathTemp;
+    size_t nMaxMappedFiles;
+};
+
+#ifndef WIN32
+TEST_F(MappedFilesTest, CacheEvictsLeastRecentlyUsed) {
+    CMappedFileCache cache(2);
+    AppendToFile(pathTemp / "a", "aaaa");
+    AppendToFile(pathTemp / "b", "bb");
+    AppendToFile(pathTemp / "c", "c");
+
+    std::shared_ptr<const CMappedFile> a = cache.Get(pathTemp / "a", 0);
+    ASSERT_TRUE(a != nullptr);
+    EXPECT_EQ("aaaa", std::string(a->data(), a->size()));
+    ASSERT_TRUE(cache.Get(pathTemp / "b", 0) != nullptr);
+    EXPECT_EQ(a, cache.Get(pathTemp / "a", 0));
+    ASSERT_TRUE(cache.Get(pathTemp / "c", 0) != nullptr);
+    EXPECT_EQ(2U, cache.size());
+
+    // "b" was evicted, "a" is still cached
+    EXPECT_EQ(a, cache.Get(pathTemp / "a", 0));
+    cache.Remove(pathTemp / "a");
+    EXPECT_EQ(1U, cache.size());
+
+    // the mapping handed out stays usable after eviction and removal of the file
+    boost::filesystem::remove(pathTemp / "a");
+    EXPECT_EQ("aaaa", std::string(a->data(), a->size()));
+
+    EXPECT_TRUE(cache.Get(pathTemp / "missing", 0) == nullptr);
+    AppendToFile(pathTemp / "empty", "");
+    EXPECT_TRUE(cache.Get(pathTemp / "empty", 0) == nullptr);
+
+    cache.SetMaxFiles(0);
+    EXPECT_EQ(0U, cache.size());
+    EXPECT_TRUE(cache.Get(pathTemp / "b", 0) == nullptr);
+}
+
+TEST_F(MappedFilesTest, CacheRemapsGrownFile) {
+    CMappedFileCache cache(4);
+    AppendToFile(pathTemp / "a", "aa");
+
+    std::shared_ptr<const CMappedFile> a = cache.Get(pathTemp / "a", 2);
+    ASSERT_TRUE(a != nullptr);
+    AppendToFile(pathTemp / "a", "bb");
+    EXPECT_EQ(a, cache.Get(pathTemp / "a", 2));
+
+    std::shared_ptr<const CMappedFile> a2 = cache.Get(pathTemp / "a", 4);
+    ASSERT_TRUE(a2 != nullptr);
+    EXPECT_EQ("aabb", std::string(a2->data(), a2->size()));
+    EXPECT_EQ(1U, cache.size());
+    EXPECT_EQ("aa", std::string(a->data(), a->size()));
+}
+#endif
+
+TEST_F(MappedFilesTest, ReadBlockFromDiskMappedAndBuffered) {
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(0, 0);
+    ASSERT_TRUE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    for (size_t nMaxFiles : {(size_t)0, (size_t)4}) {
+        mappedBlockFiles.SetMaxFiles(nMaxFiles);
+
+        CBlock blockRead;
+        ASSERT_TRUE(ReadBlockFromDisk(blockRead, pos));
+        EXPECT_EQ(block.GetHash(), blockRead.GetHash());
+        EXPECT_EQ(block.vtx.size(), blockRead.vtx.size());
+
+        // a copy appended after the file got mapped is found as well, headers
+        // of modified blocks would fail the proof of work check
+        CDiskBlockPos pos2(0, 0);
+        {
+            CAutoFile file(OpenBlockFile(pos2), SER_DISK, CLIENT_VERSION);
+            ASSERT_FALSE(file.IsNull());
+            fseek(file.Get(), 0, SEEK_END);
+            pos2.nPos = ftell(file.Get());
+        }
+        ASSERT_TRUE(WriteBlockToDisk(block, pos2, Params().MessageStart()));
+        ASSERT_GT(pos2.nPos, pos.nPos);
+        blockRead.SetNull();
+        ASSERT_TRUE(ReadBlockFromDisk(blockRead, pos2));
+        EXPECT_EQ(block.GetHash(), blockRead.GetHash());
+
+        EXPECT_FALSE(ReadBlockFromDisk(blockRead, CDiskBlockPos(pos.nFile + 1, pos.nPos)));
+    }
+}
@@ -517,6 +517,67 @@ TEST(proofs, zksnark_serializes_properly)
     }
 }
 
+TEST(proofs, zksnark_batch_verification)
+{
+    auto example = libsnark::generate_r1cs_example_with_field_input<curve_Fr>(250, 4);
+    example.constraint_system.swap_AB_if_beneficial();
+    auto kp = libsnark::r1cs_ppzksnark_generator<curve_pp>(example.constraint_system);
+    auto vkprecomp = libsnark::r1cs_ppzksnark_verifier_process_vk(kp.vk);
+
+    std::vector<libsnark::r1cs_ppzksnark_proof<curve_pp>> proofs;
+    for (size_t i = 0; i < 8; i++) {
+        proofs.push_back(libsnark::r1cs_ppzksnark_prover<curve_pp>(
+            kp.pk,
+            example.primary_input,
+            example.auxiliary_input,
+            example.constraint_system
+        ));
+    }
+
+    auto verifier = ProofVerifier::Batch();
+    // Nothing pending
+    ASSERT_TRUE(verifier.verify_batch());
+
+    for (auto& proof : proofs) {
+        ASSERT_TRUE(verifier.check(kp.vk, vkprecomp, example.primary_input, proof));
+    }
+    ASSERT_TRUE(verifier.verify_batch());
+
+    // A proof that is well formed but wrong makes the whole batch fail
+    for (size_t bad = 0; bad < proofs.size(); bad += 3) {
+        for (size_t i = 0; i < proofs.size(); i++) {
+            auto proof = proofs[i];
+            if (i == bad) {
+                proof.g_H = proof.g_H + curve_G1::one();
+            }
+            ASSERT_TRUE(verifier.check(kp.vk, vkprecomp, example.primary_input, proof));
+        }
+        ASSERT_FALSE(verifier.verify_batch());
+    }
+
+    // Each call starts a new batch
+    for (auto& proof : proofs) {
+        ASSERT_TRUE(verifier.check(kp.vk, vkprecomp, example.primary_input, proof));
+    }
+    ASSERT_TRUE(verifier.verify_batch());
+
+    // Proofs that fail the cheap checks are rejected straight away
+    auto wrong_input = example.primary_input;
+    wrong_input.push_back(curve_Fr::one());
+    ASSERT_FALSE(verifier.check(kp.vk, vkprecomp, wrong_input, proofs[0]));
+    auto proof = PHGRProof::random_invalid().to_libsnark_proof<libsnark::r1cs_ppzksnark_proof<curve_pp>>();
+    proof.g_A.g.X = curve_Fq::one();
+    ASSERT_FALSE(verifier.check(kp.vk, vkprecomp, example.primary_input, proof));
+    ASSERT_TRUE(verifier.verify_batch());
+
+    // Random invalid proofs are well formed and are only caught by the batch
+    for (size_t i = 0; i < 5; i++) {
+        auto badproof = PHGRProof::random_invalid().to_libsnark_proof<libsnark::r1cs_ppzksnark_proof<curve_pp>>();
+        ASSERT_TRUE(verifier.check(kp.vk, vkprecomp, example.primary_input, badproof));
+        ASSERT_FALSE(verifier.verify_batch());
+    }
+}
+
 TEST(proofs, g1_deserialization)
 {
     CompressedG1 g;
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+class RawBlockTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        SelectParams(CBaseChainParams::REGTEST);
+        pathTemp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+        ClearDatadirCache();
+    }
+
+    void TearDown() override {
+        mapArgs.erase("-datadir");
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+
+    boost::filesystem::path pathTemp;
+};
+
+TEST_F(RawBlockTest, ReadRawBlockMatchesNetworkSerialization) {
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(0, 0);
+    ASSERT_TRUE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    // a second block behind the first one must be found through its own position
+    CBlock block2 = block;
+    block2.nTime += 1;
+    CDiskBlockPos pos2(0, 0);
+    {
+        CAutoFile file(OpenBlockFile(pos2), SER_DISK, CLIENT_VERSION);
+        ASSERT_FALSE(file.IsNull());
+        fseek(file.Get(), 0, SEEK_END);
+        pos2.nPos = ftell(file.Get());
+    }
+    ASSERT_TRUE(WriteBlockToDisk(block2, pos2, Params().MessageStart()));
+
+    std::vector<unsigned char> vchBlock;
+    ASSERT_TRUE(ReadRawBlockFromDisk(vchBlock, pos2, block2.GetHash()));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block2;
+    EXPECT_EQ(std::vector<unsigned char>(ss.begin(), ss.end()), vchBlock);
+
+    ASSERT_TRUE(ReadRawBlockFromDisk(vchBlock, pos, block.GetHash()));
+    CBlock blockRead;
+    CDataStream(vchBlock, SER_NETWORK, PROTOCOL_VERSION) >> blockRead;
+    EXPECT_EQ(block.GetHash(), blockRead.GetHash());
+}
+
+TEST_F(RawBlockTest, ReadRawBlockRejectsWrongHashOrPosition) {
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(0, 0);
+    ASSERT_TRUE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+    std::vector<unsigned char> vchBlock;
+    EXPECT_FALSE(ReadRawBlockFromDisk(vchBlock, pos, uint256()));
+    EXPECT_FALSE(ReadRawBlockFromDisk(vchBlock, CDiskBlockPos(pos.nFile, pos.nPos + 1), block.GetHash()));
+    EXPECT_FALSE(ReadRawBlockFromDisk(vchBlock, CDiskBlockPos(pos.nFile + 1, pos.nPos), block.GetHash()));
+}
@@ -874,6 +874,89 @@ TEST_F(SidechainTestSuite, GetScIdsOnChainstateDbSelectOnlySidechains) {
     boost::system::error_code ec;
     boost::filesystem::remove_all(pathTemp.string(), ec);
 }
+
+TEST_F(SidechainTestSuite, GetScIdsOnChainstateDbTracksFlushedCreationsAndReverts) {
+
+    //init a tmp chainstateDb
+    boost::filesystem::path pathTemp(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path());
+    const unsigned int      chainStateDbSize(2 * 1024 * 1024);
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    CCoinsViewDB chainStateDb(chainStateDbSize,/*fWipe*/true);
+    sidechainsView->SetBackend(chainStateDb);
+
+    //load the (empty) catalog before any sidechain is flushed
+    std::set<uint256> knownScIdsSet;
+    chainStateDb.GetScIds(knownScIdsSet);
+    ASSERT_TRUE(knownScIdsSet.empty());
+
+    CBlock aBlock;
+    int scCreationHeight(11);
+    CTransaction scTx = txCreationUtils::createNewSidechainTxWith(CAmount(1));
+    const uint256& scId = scTx.GetScIdFromScCcOut(0);
+    ASSERT_TRUE(sidechainsView->UpdateScInfo(scTx, aBlock, scCreationHeight));
+    ASSERT_TRUE(sidechainsView->Flush());
+
+    chainStateDb.GetScIds(knownScIdsSet);
+    EXPECT_TRUE(knownScIdsSet.size() == 1)<<"Instead knowScIdSet size is "<<knownScIdsSet.size();
+    EXPECT_TRUE(knownScIdsSet.count(scId) == 1)<<"Actual count is "<<knownScIdsSet.count(scId);
+
+    ASSERT_TRUE(sidechainsView->RevertTxOutputs(scTx, scCreationHeight));
+    ASSERT_TRUE(sidechainsView->Flush());
+
+    chainStateDb.GetScIds(knownScIdsSet);
+    EXPECT_TRUE(knownScIdsSet.empty())<<"Instead knowScIdSet size is "<<knownScIdsSet.size();
+
+    ClearDatadirCache();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(pathTemp.string(), ec);
+}
+
+TEST_F(SidechainTestSuite, FlushBufferServesFlushedSidechainsAndCommitsThemToDb) {
+
+    //init a tmp chainstateDb
+    boost::filesystem::path pathTemp(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path());
+    const unsigned int      chainStateDbSize(2 * 1024 * 1024);
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    CCoinsViewDB chainStateDb(chainStateDbSize,/*fWipe*/true);
+    {
+        CCoinsViewFlushBuffer flushBuffer(&chainStateDb);
+        sidechainsView->SetBackend(flushBuffer);
+
+        CBlock aBlock;
+        int scCreationHeight(11);
+        CTransaction scTx = txCreationUtils::createNewSidechainTxWith(CAmount(1));
+        const uint256& scId = scTx.GetScIdFromScCcOut(0);
+        ASSERT_TRUE(sidechainsView->UpdateScInfo(scTx, aBlock, scCreationHeight));
+        ASSERT_TRUE(sidechainsView->Flush());
+
+        //whether or not the write is still in flight, the front cache sees the sidechain
+        EXPECT_TRUE(sidechainsView->HaveSidechain(scId));
+        EXPECT_TRUE(flushBuffer.HaveSidechain(scId));
+
+        ASSERT_TRUE(flushBuffer.Sync());
+        EXPECT_TRUE(chainStateDb.HaveSidechain(scId));
+        EXPECT_FALSE(flushBuffer.GetFlushStats().fInFlight);
+        EXPECT_TRUE(flushBuffer.GetFlushStats().nFlushes == 1);
+        EXPECT_TRUE(flushBuffer.GetFlushStats().nLastBytes > 0);
+
+        ASSERT_TRUE(sidechainsView->RevertTxOutputs(scTx, scCreationHeight));
+        ASSERT_TRUE(sidechainsView->Flush());
+        EXPECT_FALSE(flushBuffer.HaveSidechain(scId));
+
+        ASSERT_TRUE(flushBuffer.Sync());
+        EXPECT_FALSE(chainStateDb.HaveSidechain(scId));
+
+        sidechainsView->SetBackend(*fakeChainStateDb);
+    }
+
+    ClearDatadirCache();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(pathTemp.string(), ec);
+}
 ///////////////////////////////////////////////////////////////////////////////
 //////////////////////////////// GetSidechain /////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -31,8 +31,14 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    size_t nSizeEstimate;
 
 public:
+    CLevelDBBatch() : nSizeEstimate(0) {}
+
+    //! Approximate number of key and value bytes queued in this batch
+    size_t SizeEstimate() const { return nSizeEstimate; }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +53,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nSizeEstimate += ssKey.size() + ssValue.size();
     }
 
     template <typename K>
@@ -58,6 +65,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nSizeEstimate += ssKey.size();
     }
 };
 
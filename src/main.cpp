@@ -43,6 +43,7 @@
 #include "zen/delay.h"
 
 #include "sc/sidechain.h"
+#include "sc/asyncproofverifier.h"
 
 using namespace zen;
 
@@ -68,6 +69,7 @@ int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nScProofVerificationThreads = 0;
 bool fExperimentalMode = false;
 bool fImporting = false;
 bool fReindex = false;
@@ -83,6 +85,7 @@ bool fIsStartupSyncing = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
+CMappedFileCache mappedBlockFiles(DEFAULT_MAX_MAPPED_BLOCK_FILES);
 
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying and mining) */
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
@@ -584,6 +587,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CCoinsViewFlushBuffer *pcoinsFlushBuffer = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -925,19 +929,22 @@ bool CheckCertificate(const CScCertificate& cert, CValidationState& state)
 
 
 bool CheckTransaction(const CTransaction& tx, CValidationState &state,
-                      libzcash::ProofVerifier& verifier)
+                      libzcash::ProofVerifier& verifier,
+                      std::vector<CJoinSplitCheck>* pvChecks)
 {
     // Don't count coinbase transactions because mining skews the count
     if (!tx.IsCoinBase()) {
         transactionsValidated.increment();
     }
-    if (!CheckTransactionWithoutProofVerification(tx, state)) {
+    if (!CheckTransactionWithoutProofVerification(tx, state, pvChecks)) {
         return false;
     }
 
     // Ensure that zk-SNARKs verify
-    BOOST_FOREACH(const JSDescription &joinsplit, tx.GetVjoinsplit()) {
-        if (!joinsplit.Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
+    for (size_t i = 0; i < tx.GetVjoinsplit().size(); i++) {
+        if (pvChecks) {
+            pvChecks->push_back(CJoinSplitCheck(tx, i, verifier));
+        } else if (!tx.GetVjoinsplit()[i].Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
             return state.DoS(100, error("CheckTransaction(): joinsplit does not verify"),
                                 REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
         }
@@ -949,7 +956,57 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state,
     return true;
 }
 
-bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidationState &state)
+bool CheckJoinSplitSig(const CTransaction& tx, CValidationState &state)
+{
+    // Empty output script.
+    CScript scriptCode;
+    uint256 dataToBeSigned;
+    try {
+        dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL);
+    } catch (std::logic_error& ex) {
+        return state.DoS(100, error("CheckTransaction(): error computing signature hash"),
+                         REJECT_INVALID, "error-computing-signature-hash");
+    }
+
+    BOOST_STATIC_ASSERT(crypto_sign_PUBLICKEYBYTES == 32);
+
+    // We rely on libsodium to check that the signature is canonical.
+    // https://github.com/jedisct1/libsodium/commit/62911edb7ff2275cccd74bf1c8aefcc4d76924e0
+    if (crypto_sign_verify_detached(&tx.joinSplitSig[0],
+                                    dataToBeSigned.begin(), 32,
+                                    tx.joinSplitPubKey.begin()
+                                   ) != 0) {
+        return state.DoS(100, error("CheckTransaction(): invalid joinsplit signature"),
+                         REJECT_INVALID, "bad-txns-invalid-joinsplit-signature");
+    }
+
+    return true;
+}
+
+CJoinSplitCheck::CJoinSplitCheck(): ptx(NULL), nJoinSplit(0), pverifier(NULL) {}
+
+CJoinSplitCheck::CJoinSplitCheck(const CTransaction& txIn):
+    ptx(&txIn), nJoinSplit(SIGNATURE), pverifier(NULL) {}
+
+CJoinSplitCheck::CJoinSplitCheck(const CTransaction& txIn, size_t nJoinSplitIn, libzcash::ProofVerifier& verifierIn):
+    ptx(&txIn), nJoinSplit(nJoinSplitIn), pverifier(&verifierIn) {}
+
+bool CJoinSplitCheck::operator()() {
+    if (nJoinSplit == SIGNATURE) {
+        CValidationState state;
+        return CheckJoinSplitSig(*ptx, state);
+    }
+    return ptx->GetVjoinsplit()[nJoinSplit].Verify(*pzcashParams, *pverifier, ptx->joinSplitPubKey);
+}
+
+void CJoinSplitCheck::swap(CJoinSplitCheck &check) {
+    std::swap(ptx, check.ptx);
+    std::swap(nJoinSplit, check.nJoinSplit);
+    std::swap(pverifier, check.pverifier);
+}
+
+bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidationState &state,
+                                              std::vector<CJoinSplitCheck>* pvChecks)
 {
     if (!tx.IsValidVersion(state))
         return false;
@@ -972,26 +1029,10 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
     if (!tx.IsCoinBase())
     {
         if (tx.GetVjoinsplit().size() > 0) {
-            // Empty output script.
-            CScript scriptCode;
-            uint256 dataToBeSigned;
-            try {
-                dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL);
-            } catch (std::logic_error& ex) {
-                return state.DoS(100, error("CheckTransaction(): error computing signature hash"),
-                                 REJECT_INVALID, "error-computing-signature-hash");
-            }
-
-            BOOST_STATIC_ASSERT(crypto_sign_PUBLICKEYBYTES == 32);
-
-            // We rely on libsodium to check that the signature is canonical.
-            // https://github.com/jedisct1/libsodium/commit/62911edb7ff2275cccd74bf1c8aefcc4d76924e0
-            if (crypto_sign_verify_detached(&tx.joinSplitSig[0],
-                                            dataToBeSigned.begin(), 32,
-                                            tx.joinSplitPubKey.begin()
-                                           ) != 0) {
-                return state.DoS(100, error("CheckTransaction(): invalid joinsplit signature"),
-                                 REJECT_INVALID, "bad-txns-invalid-joinsplit-signature");
+            if (pvChecks) {
+                pvChecks->push_back(CJoinSplitCheck(tx));
+            } else if (!CheckJoinSplitSig(tx, state)) {
+                return false;
             }
         }
     }
@@ -1028,8 +1069,18 @@ CAmount GetMinRelayFee(const CTransactionBase& tx, unsigned int nBytes, bool fAl
     return nMinFee;
 }
 
+static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
+{
+    int expired = pool.Expire(GetTime() - age);
+    if (expired != 0)
+        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+
+    pool.TrimToSize(limit);
+}
+
 bool AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool disconnecting)
+                        bool* pfMissingInputs, bool fRejectAbsurdFee, bool disconnecting,
+                        std::vector<libzendoomc::CScCertProofCheck>* pvProofChecks)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -1114,7 +1165,7 @@ bool AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, co
             }
 
             auto scVerifier = libzendoomc::CScProofVerifier::Strict();   
-            if (!view.IsCertApplicableToState(cert, nextBlockHeight, state, scVerifier))
+            if (!view.IsCertApplicableToState(cert, nextBlockHeight, state, scVerifier, pvProofChecks))
             {
                 LogPrint("sc", "%s():%d - certificate [%s] is not applicable\n", __func__, __LINE__, certHash.ToString());
                 return state.DoS(0, error("%s(): certificate not applicable", __func__),
@@ -1240,8 +1291,21 @@ bool AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, co
             return error("%s(): BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", __func__, certHash.ToString());
         }
 
+        if (pvProofChecks != nullptr && !pvProofChecks->empty())
+        {
+            LogPrint("cert", "%s():%d - cert[%s] passed all checks, proof verification pending\n", __func__, __LINE__, certHash.ToString());
+            return true;
+        }
+
         // Store transaction in memory
-        pool.addUnchecked(certHash, entry, !IsInitialBlockDownload());
+        pool.addUnchecked(certHash, entry, !IsInitialBlockDownload(), &view);
+
+        // Make room by evicting transactions; certificates resurrected by a reorg are trimmed with the rest of the block
+        if (!disconnecting) {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            if (!pool.existsCert(certHash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
 
     return true;
@@ -1444,6 +1508,15 @@ bool AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTran
                                 REJECT_INSUFFICIENTFEE, "insufficient fee");
         }
 
+        // After evictions the pool only takes transactions paying more than the evicted ones did
+        if (!disconnecting) {
+            CAmount mempoolRejectFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+            if (mempoolRejectFee > 0 && nFees < mempoolRejectFee)
+                return state.DoS(0, error("%s(): mempool min fee not met %s, %d < %d",
+                                        __func__, hash.ToString(), nFees, mempoolRejectFee),
+                                REJECT_INSUFFICIENTFEE, "mempool min fee not met");
+        }
+
         // Require that free transactions have sufficient priority to be mined in the next block.
         if (GetBoolArg("-relaypriority", false) && nFees < ::minRelayTxFee.GetFee(nSize) && !AllowFree(view.GetPriority(tx, chainActive.Height() + 1))) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "insufficient priority");
@@ -1502,7 +1575,14 @@ bool AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTran
         }
 
         // Store transaction in memory
-        pool.addUnchecked(hash, entry, !IsInitialBlockDownload());
+        pool.addUnchecked(hash, entry, !IsInitialBlockDownload(), &view);
+
+        // Trim the pool back to its size limit, txs resurrected by a reorg are trimmed with the rest of the block
+        if (!disconnecting) {
+            LimitMempoolSize(pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+            if (!pool.existsTx(hash))
+                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
     }
 
     return true;
@@ -1685,21 +1765,67 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::M
     return true;
 }
 
+/**
+ * Locate the record (block or undo data) written at pos by WriteBlockToDisk or
+ * UndoWriteToDisk in the memory-mapped file, using the size field preceding it.
+ * nTrailerSize extra bytes following the record must be mapped too. Returns
+ * false if the file is not mapped or the record does not fit in it, in which
+ * case callers fall back to buffered reads.
+ */
+static bool GetMappedRecord(const CDiskBlockPos& pos, const char* prefix, size_t nTrailerSize,
+                            std::shared_ptr<const CMappedFile>& mapping, const char*& pbegin, const char*& pend)
+{
+    if (pos.IsNull() || pos.nPos < sizeof(unsigned int))
+        return false;
+
+    boost::filesystem::path path = GetBlockPosFilename(pos, prefix);
+    mapping = mappedBlockFiles.Get(path, pos.nPos);
+    if (!mapping || mapping->size() < pos.nPos)
+        return false;
+
+    const size_t nRecordSize = ReadLE32((const unsigned char*)mapping->data() + pos.nPos - sizeof(unsigned int));
+    const size_t nEnd = (size_t)pos.nPos + nRecordSize + nTrailerSize;
+    if (mapping->size() < nEnd) {
+        // Written after the file was mapped
+        mapping = mappedBlockFiles.Get(path, nEnd);
+        if (!mapping || mapping->size() < nEnd)
+            return false;
+    }
+
+    pbegin = mapping->data() + pos.nPos;
+    pend = mapping->data() + nEnd;
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const CMappedFile> mapping;
+    const char* pbegin;
+    const char* pend;
+    if (GetMappedRecord(pos, "blk", 0, mapping, pbegin, pend)) {
+        // Deserialize straight from the mapped file
+        try {
+            CMemoryReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1710,6 +1836,62 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hashBlock)
+{
+    vchBlock.clear();
+
+    // pos points past the magic and size written by WriteBlockToDisk
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s: invalid block position %s", __func__, pos.ToString());
+
+    std::shared_ptr<const CMappedFile> mapping;
+    const char* pbegin;
+    const char* pend;
+    if (GetMappedRecord(pos, "blk", 0, mapping, pbegin, pend)) {
+        if (memcmp(pbegin - sizeof(unsigned int) - MESSAGE_START_SIZE, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        if (pend - pbegin <= (ptrdiff_t)CBlockHeader::HEADER_SIZE || pend - pbegin > (ptrdiff_t)MAX_BLOCK_SIZE)
+            return error("%s: invalid block size %u at %s", __func__, (unsigned int)(pend - pbegin), pos.ToString());
+        vchBlock.assign(pbegin, pend);
+    } else {
+        CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+        try {
+            CMessageHeader::MessageStartChars blkStart;
+            unsigned int nSize;
+            filein >> FLATDATA(blkStart) >> nSize;
+            if (memcmp(blkStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+                return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+            if (nSize <= CBlockHeader::HEADER_SIZE || nSize > MAX_BLOCK_SIZE)
+                return error("%s: invalid block size %u at %s", __func__, nSize, pos.ToString());
+            vchBlock.resize(nSize);
+            filein.read((char*)&vchBlock[0], nSize);
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    }
+
+    // The block hash covers the header, which ends with the Equihash solution; records too short
+    // to hold at least the first byte of the solution size were rejected above
+    try {
+        CDataStream ssSolutionSize((const char*)vchBlock.data() + CBlockHeader::HEADER_SIZE,
+                                   (const char*)vchBlock.data() + std::min(vchBlock.size(), CBlockHeader::HEADER_SIZE + 9),
+                                   SER_DISK, CLIENT_VERSION);
+        uint64_t nSolutionSize = ReadCompactSize(ssSolutionSize);
+        size_t nHeaderSize = CBlockHeader::HEADER_SIZE + GetSizeOfCompactSize(nSolutionSize) + nSolutionSize;
+        if (nHeaderSize > vchBlock.size() || Hash(vchBlock.begin(), vchBlock.begin() + nHeaderSize) != hashBlock)
+            return error("%s: GetHash() doesn't match %s at %s", __func__, hashBlock.ToString(), pos.ToString());
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -2235,19 +2417,34 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenBlockFile failed", __func__);
-
-    // Read block
     uint256 hashChecksum;
-    try {
-        filein >> blockundo;
-        filein >> hashChecksum;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    std::shared_ptr<const CMappedFile> mapping;
+    const char* pbegin;
+    const char* pend;
+    if (GetMappedRecord(pos, "rev", hashChecksum.size(), mapping, pbegin, pend)) {
+        // Deserialize straight from the mapped file
+        try {
+            CMemoryReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+            reader >> blockundo;
+            reader >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed", __func__);
+
+        // Read block
+        try {
+            filein >> blockundo;
+            filein >> hashChecksum;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Verify checksum
@@ -2435,6 +2632,10 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             return error("DisconnectBlock(): sc creation can not be reverted: data inconsistent");
         }
 
+        // reverted sidechains will never verify certificates again, drop their deserialized verification data
+        for(const auto& scCreationOut: tx.GetVscCcOut())
+            libzendoomc::CScVkCache::getInstance().Erase(scCreationOut.GetScId());
+
         // restore inputs
         if (i > 0) { // not coinbases
             const CTxUndo &txundo = blockUndo.vtxundo[i-1];
@@ -2498,6 +2699,22 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+// each certificate proof verification is expensive, let workers pick them up one at a time
+static CCheckQueue<libzendoomc::CScCertProofCheck> sccertcheckqueue(1);
+
+void ThreadScCertProofCheck() {
+    RenameThread("horizen-certch");
+    sccertcheckqueue.Thread();
+}
+
+// a JoinSplit proof takes milliseconds to verify, so workers pick them up one at a time too
+static CCheckQueue<CJoinSplitCheck> joinsplitcheckqueue(1);
+
+void ThreadJoinSplitCheck() {
+    RenameThread("horizen-jsch");
+    joinsplitcheckqueue.Thread();
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2578,6 +2795,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     bool fExpensiveChecks = true;
+    // Signatures checked while connecting a block are not needed again, so the checks drop them
+    // from the signature cache; block templates (fJustCheck) are checked again when mined, keep theirs
+    bool fCacheResults = fJustCheck;
     if (fCheckpointsEnabled) {
         CBlockIndex *pindexLastCheckpoint = Checkpoints::GetLastCheckpoint(chainparams.Checkpoints());
         if (pindexLastCheckpoint && pindexLastCheckpoint->GetAncestor(pindex->nHeight) == pindex) {
@@ -2586,12 +2806,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    auto verifier = libzcash::ProofVerifier::Strict();
+    auto verifier = libzcash::ProofVerifier::Batch();
     auto disabledVerifier = libzcash::ProofVerifier::Disabled();
 
-    // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in
-    if (!CheckBlock(block, state, fExpensiveChecks ? verifier : disabledVerifier, !fJustCheck, !fJustCheck))
+    // Check it again to verify JoinSplit proofs, and in case a previous version let a bad block in.
+    // With script check threads the proofs are prepared in the background while the block is connected,
+    // and all of them are verified together once they are in.
+    CCheckQueueControl<CJoinSplitCheck> joinSplitControl(fExpensiveChecks && nScriptCheckThreads ? &joinsplitcheckqueue : NULL);
+    std::vector<CJoinSplitCheck> vJoinSplitChecks;
+    if (!CheckBlock(block, state, fExpensiveChecks ? verifier : disabledVerifier, !fJustCheck, !fJustCheck,
+                    fExpensiveChecks && nScriptCheckThreads ? &vJoinSplitChecks : NULL))
         return false;
+    joinSplitControl.Add(vJoinSplitChecks);
 
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == NULL ? uint256() : pindex->pprev->GetBlockHash();
@@ -2635,6 +2861,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CBlockUndo blockundo;
 
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    CCheckQueueControl<libzendoomc::CScCertProofCheck> certControl(fExpensiveChecks && nScriptCheckThreads ? &sccertcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -2701,7 +2928,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nFees += tx.GetFeeAmount(view.GetValueIn(tx));
 
             std::vector<CScriptCheck> vChecks;
-            if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
+            if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, chain, flags, fCacheResults, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
                 return false;
 
             control.Add(vChecks);
@@ -2783,18 +3010,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         nFees += cert.GetFeeAmount(view.GetValueIn(cert));
 
         std::vector<CScriptCheck> vChecks;
-        if (!ContextualCheckInputs(cert, state, view, fExpensiveChecks, chain, flags, false, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
+        if (!ContextualCheckInputs(cert, state, view, fExpensiveChecks, chain, flags, fCacheResults, chainparams.GetConsensus(), nScriptCheckThreads ? &vChecks : NULL))
             return false;
 
         control.Add(vChecks);
 
         auto scVerifier = fExpensiveChecks ? libzendoomc::CScProofVerifier::Strict() : libzendoomc::CScProofVerifier::Disabled();
-        if (!view.IsCertApplicableToState(cert, pindex->nHeight, state, scVerifier) ) {
+        std::vector<libzendoomc::CScCertProofCheck> vCertChecks;
+        if (!view.IsCertApplicableToState(cert, pindex->nHeight, state, scVerifier, nScriptCheckThreads ? &vCertChecks : NULL) ) {
             LogPrint("sc", "%s():%d - ERROR: cert=%s\n", __func__, __LINE__, cert.GetHash().ToString() );
             return state.DoS(100, error("ConnectBlock(): invalid sc certificate [%s]", cert.GetHash().ToString()),
                              REJECT_INVALID, "bad-sc-cert-not-applicable");
         }
 
+        certControl.Add(vCertChecks);
+
         blockundo.vtxundo.push_back(CTxUndo());
         UpdateCoins(cert, view, blockundo.vtxundo.back(), pindex->nHeight);
 
@@ -2876,8 +3106,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             __func__, __LINE__, block.hashScTxsCommitment.ToString());
     }
 
+    if (!joinSplitControl.Wait() || !verifier.verify_batch()) {
+        // Signatures are cheap to check again, tell them apart from bad proofs
+        for (const CTransaction& tx: block.vtx)
+            if (!tx.IsCoinBase() && !tx.GetVjoinsplit().empty() && !CheckJoinSplitSig(tx, state))
+                return false;
+        return state.DoS(100, error("ConnectBlock(): joinsplit does not verify"),
+                         REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+    }
     if (!control.Wait())
         return state.DoS(100, false);
+    if (!certControl.Wait())
+        return state.DoS(100, error("ConnectBlock(): sc certificate proof verification failed"),
+                         REJECT_INVALID, "bad-sc-cert-not-applicable");
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
 
@@ -3008,9 +3249,6 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 return AbortNode(state, "Files to write to block index database");
             }
         }
-        // Finally remove any pruned files
-        if (fFlushForPrune)
-            UnlinkPrunedFiles(setFilesToPrune);
         nLastWrite = nNow;
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -3023,10 +3261,19 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        // The write itself is carried out in background by pcoinsFlushBuffer,
+        // unless the caller needs the state on disk right away, or block files
+        // are about to be pruned: a chainstate still in the buffer could need
+        // their blocks to be replayed after a crash.
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && pcoinsFlushBuffer && !pcoinsFlushBuffer->Sync())
+            return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
     }
+    // Finally remove any pruned files, now that nothing on disk refers to them
+    if (fFlushForPrune)
+        UnlinkPrunedFiles(setFilesToPrune);
     if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
         // Update best block in wallet (so we can detect restored wallets).
         GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3137,6 +3384,7 @@ bool static DisconnectTip(CValidationState &state) {
 
     // remove any certificate, and possible dependancies, that refers to this block as end epoch
     mempool.removeOutOfEpochCertificates(pindexDelete);
+    LimitMempoolSize(mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
@@ -3900,7 +4148,8 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
 
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
-                bool fCheckPOW, bool fCheckMerkleRoot)
+                bool fCheckPOW, bool fCheckMerkleRoot,
+                std::vector<CJoinSplitCheck>* pvJoinSplitChecks)
 {
     // These are checks that are independent of context.
 
@@ -3945,7 +4194,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state,
 
     // Check transactions and certificates
     for(const CTransaction& tx: block.vtx) {
-        if (!CheckTransaction(tx, state, verifier)) {
+        if (!CheckTransaction(tx, state, verifier, pvJoinSplitChecks)) {
             return error("CheckBlock(): CheckTransaction failed");
         }
     }
@@ -4343,6 +4592,8 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        mappedBlockFiles.Remove(GetBlockPosFilename(pos, "blk"));
+        mappedBlockFiles.Remove(GetBlockPosFilename(pos, "rev"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4630,8 +4881,6 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
-    // No need to verify JoinSplits twice
-    auto verifier = libzcash::ProofVerifier::Disabled();
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
         boost::this_thread::interruption_point();
@@ -4642,8 +4891,9 @@ bool CVerifyDB::VerifyDB(CCoinsView *coinsview, int nCheckLevel, int nCheckDepth
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
             return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, verifier))
+        // check level 1: verify block validity, JoinSplit proofs are verified as one batch per block
+        auto verifier = libzcash::ProofVerifier::Batch();
+        if (nCheckLevel >= 1 && !(CheckBlock(block, state, verifier) && verifier.verify_batch()))
             return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 2: verify undo validity
         if (nCheckLevel >= 2 && pindex) {
@@ -5178,14 +5428,117 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Decide whether a block requested by pfrom may be served, and find it on disk.
+ * Requires cs_main.
+ */
+static bool GetBlockToServe(CNode* pfrom, const CInv& inv, CDiskBlockPos& posRet)
+{
+    AssertLockHeld(cs_main);
+
+    bool send = false;
+    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+    if (mi != mapBlockIndex.end())
+    {
+        if (chainActive.Contains(mi->second)) {
+            send = true;
+        } else {
+            static const int nOneMonth = 30 * 24 * 60 * 60;
+            // To prevent fingerprinting attacks, only send blocks outside of the active
+            // chain if they are valid, and no more than a month older (both in time, and in
+            // best equivalent proof of work) than the best header chain we know about.
+
+            // this is set by ConnectBlock method, when a new tip is added to the main chain
+            bool b1 = mi->second->IsValid(BLOCK_VALID_SCRIPTS);
+            bool b2 = (pindexBestHeader != NULL);
+            bool b3 = (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth);
+            bool b4 = (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
+
+            send = b1 && b2 && b3 && b4;
+            if (!send)
+            {
+                if (b2 && b3 && b4)
+                {
+                    // BLOCK_VALID_SCRIPTS is set when connecting block on main chain, but we must
+                    // propagate also when relevant blocks are on a fork. Consider that a further check
+                    // on BLOCK_HAVE_DATA is performed below
+                    LogPrint("forks", "%s():%d: request from peer=%i: status[0x%x]\n",
+                        __func__, __LINE__, pfrom->GetId(), mi->second->nStatus);
+                    send = true;
+                }
+                else
+                {
+                    LogPrint("forks", "%s():%d: ignoring request from peer=%i: %s status[0x%x]\n",
+                        __func__, __LINE__, pfrom->GetId(), inv.hash.ToString(), mi->second->nStatus);
+                }
+            }
+        }
+    }
+    // Pruned nodes may have deleted the block, so check whether
+    // it's available before trying to send.
+    if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+    {
+        posRet = mi->second->GetBlockPos();
+        return true;
+    }
+    if (send)
+    {
+        LogPrint("forks", "%s():%d - NOT Pushing incomplete block [%s]\n", __func__, __LINE__, inv.hash.ToString() );
+    }
+    return false;
+}
+
+/**
+ * Full blocks recently sent to peers in their serialized form, so that peers
+ * syncing the same range share a single disk read. Entries are kept in least
+ * recently served order and evicted from the front once MAX_RAW_BLOCK_CACHE_SIZE
+ * bytes are exceeded; mapRawBlockCache indexes them by block hash.
+ */
+static const size_t MAX_RAW_BLOCK_CACHE_SIZE = 16 * 1000 * 1000;
+typedef std::list<std::pair<uint256, std::shared_ptr<std::vector<unsigned char> > > > RawBlockCacheList;
+static CCriticalSection cs_rawBlockCache;
+static RawBlockCacheList listRawBlockCache;
+static boost::unordered_map<uint256, RawBlockCacheList::iterator, ObjectHasher> mapRawBlockCache;
+static size_t nRawBlockCacheSize = 0;
+
+static std::shared_ptr<std::vector<unsigned char> > GetRawBlockToServe(const uint256& hash, const CDiskBlockPos& pos)
+{
+    {
+        LOCK(cs_rawBlockCache);
+        auto it = mapRawBlockCache.find(hash);
+        if (it != mapRawBlockCache.end()) {
+            listRawBlockCache.splice(listRawBlockCache.end(), listRawBlockCache, it->second);
+            return it->second->second;
+        }
+    }
+
+    std::shared_ptr<std::vector<unsigned char> > pvchBlock = std::make_shared<std::vector<unsigned char> >();
+    if (!ReadRawBlockFromDisk(*pvchBlock, pos, hash))
+        return nullptr;
+
+    LOCK(cs_rawBlockCache);
+    // another peer may have asked for the same block while it was being read
+    auto it = mapRawBlockCache.find(hash);
+    if (it != mapRawBlockCache.end()) {
+        listRawBlockCache.splice(listRawBlockCache.end(), listRawBlockCache, it->second);
+        return it->second->second;
+    }
+    mapRawBlockCache[hash] = listRawBlockCache.insert(listRawBlockCache.end(), std::make_pair(hash, pvchBlock));
+    nRawBlockCacheSize += pvchBlock->size();
+    while (nRawBlockCacheSize > MAX_RAW_BLOCK_CACHE_SIZE && listRawBlockCache.size() > 1) {
+        nRawBlockCacheSize -= listRawBlockCache.front().second->size();
+        mapRawBlockCache.erase(listRawBlockCache.front().first);
+        listRawBlockCache.pop_front();
+    }
+    return pvchBlock;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
-
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
         if (pfrom->nSendSize >= SendBufferSize())
@@ -5198,56 +5551,38 @@ void static ProcessGetData(CNode* pfrom)
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
             {
+                CDiskBlockPos blockPos;
                 bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-
-                        // this is set by ConnectBlock method, when a new tip is added to the main chain
-                        bool b1 = mi->second->IsValid(BLOCK_VALID_SCRIPTS);
-                        bool b2 = (pindexBestHeader != NULL);
-                        bool b3 = (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth);
-                        bool b4 = (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, Params().GetConsensus()) < nOneMonth);
-
-                        send = b1 && b2 && b3 && b4;
-                        if (!send)
-                        {
-                            if (b2 && b3 && b4)
-                            {
-                                // BLOCK_VALID_SCRIPTS is set when connecting block on main chain, but we must
-                                // propagate also when relevant blocks are on a fork. Consider that a further check
-                                // on BLOCK_HAVE_DATA is performed below
-                                LogPrint("forks", "%s():%d: request from peer=%i: status[0x%x]\n",
-                                    __func__, __LINE__, pfrom->GetId(), mi->second->nStatus);
-                                send = true;
-                            }
-                            else
-                            {
-                                LogPrint("forks", "%s():%d: ignoring request from peer=%i: %s status[0x%x]\n",
-                                    __func__, __LINE__, pfrom->GetId(), inv.hash.ToString(), mi->second->nStatus);
-                            }
-                        }
+                    LOCK(cs_main);
+                    send = GetBlockToServe(pfrom, inv, blockPos);
+                }
+                // Read and serialize the block without holding cs_main, so that a peer
+                // catching up on old blocks doesn't hold up validation and other peers.
+                // Full blocks are sent as stored in the block file, which holds the
+                // network serialization, so only filtered blocks get deserialized.
+                CBlock block;
+                std::shared_ptr<std::vector<unsigned char> > pvchBlock;
+                if (send)
+                {
+                    bool fRead;
+                    if (inv.type == MSG_BLOCK)
+                        fRead = (pvchBlock = GetRawBlockToServe(inv.hash, blockPos)) != nullptr;
+                    else
+                        fRead = ReadBlockFromDisk(block, blockPos) && block.GetHash() == inv.hash;
+                    if (!fRead)
+                    {
+                        // the block file may have been pruned since cs_main was released
+                        LogPrintf("%s: cannot load block %s from disk\n", __func__, inv.hash.ToString());
+                        send = false;
                     }
                 }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                if (send)
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
                     {
-                        LogPrint("forks", "%s():%d - Pushing block [%s]\n", __func__, __LINE__, block.GetHash().ToString() );
-                        pfrom->PushMessage("block", block);
+                        LogPrint("forks", "%s():%d - Pushing block [%s]\n", __func__, __LINE__, inv.hash.ToString() );
+                        pfrom->PushMessage("block", CFlatData(*pvchBlock));
                     }
                     else // MSG_FILTERED_BLOCK)
                     if (inv.type == MSG_FILTERED_BLOCK)
@@ -5302,19 +5637,15 @@ void static ProcessGetData(CNode* pfrom)
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        {
+                            LOCK(cs_main);
+                            vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        }
                         LogPrint("forks", "%s():%d - Pushing inv\n", __func__, __LINE__);
                         pfrom->PushMessage("inv", vInv);
                         pfrom->hashContinue.SetNull();
                     }
                 }
-                else
-                {
-                    if (send && !(mi->second->nStatus & BLOCK_HAVE_DATA) )
-                    {
-                        LogPrint("forks", "%s():%d - NOT Pushing incomplete block [%s]\n", __func__, __LINE__, inv.hash.ToString() );
-                    }
-                }
             }
             else if (inv.IsKnownType())
             {
@@ -5395,7 +5726,34 @@ void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
     pfrom->setAskFor.erase(inv.hash);
     mapAlreadyAskedFor.erase(inv);
 
-    if (!AlreadyHave(inv) && AcceptTxBaseToMemoryPool(mempool, state, txBase, true, &fMissingInputs))
+    // certificate already received and waiting for its proof to be verified
+    if (CScAsyncProofVerifier::getInstance().IsPending(inv.hash))
+        return;
+
+    bool fAccepted = false;
+    std::vector<libzendoomc::CScCertProofCheck> vCertProofChecks;
+    std::shared_ptr<const CScCertificate> pCert;
+    if (!AlreadyHave(inv))
+    {
+        if (txBase.IsCertificate() && nScProofVerificationThreads > 0)
+        {
+            // the proof is verified without holding cs_main, the certificate is added to the mempool afterwards
+            pCert = std::make_shared<const CScCertificate>(dynamic_cast<const CScCertificate&>(txBase));
+            fAccepted = AcceptCertificateToMemoryPool(mempool, state, *pCert, true, &fMissingInputs, false, false, &vCertProofChecks);
+        }
+        else
+            fAccepted = AcceptTxBaseToMemoryPool(mempool, state, txBase, true, &fMissingInputs);
+    }
+
+    if (fAccepted && !vCertProofChecks.empty())
+    {
+        if (!CScAsyncProofVerifier::getInstance().Enqueue(pfrom->GetId(), pCert, vCertProofChecks.back()))
+            LogPrint("mempool", "%s(): peer=%d: cert %s dropped, could not queue it for proof verification\n", __func__,
+                pfrom->id, txBase.GetHash().ToString());
+        return;
+    }
+
+    if (fAccepted)
     {
         mempool.check(pcoinsTip);
         txBase.Relay();
@@ -5505,6 +5863,242 @@ void ProcessTxBaseMsg(const CTransactionBase& txBase, CNode* pfrom)
     }
 }
 
+void ProcessVerifiedCertificate(NodeId fromPeer, const CScCertificate& cert, bool fProofVerified)
+{
+    LOCK(cs_main);
+    const uint256& certHash = cert.GetHash();
+
+    if (!fProofVerified)
+    {
+        LogPrint("mempool", "%s(): cert %s from peer=%d was not accepted into the memory pool: proof not verified\n",
+            __func__, certHash.ToString(), fromPeer);
+        assert(recentRejects);
+        recentRejects->insert(certHash);
+        return;
+    }
+
+    // The state may have changed while the proof was being verified, hence all the checks are performed again.
+    // The proof itself is now known to be valid and is not verified twice.
+    CValidationState state;
+    if (AcceptCertificateToMemoryPool(mempool, state, cert, true, nullptr))
+    {
+        mempool.check(pcoinsTip);
+        cert.Relay();
+        LogPrint("mempool", "%s(): peer=%d: accepted %s (poolsz %u)\n", __func__,
+            fromPeer, certHash.ToString(), mempool.size());
+        return;
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint("mempool", "%s(): cert %s from peer=%d was not accepted into the memory pool: %s\n", __func__,
+            certHash.ToString(), fromPeer, state.GetRejectReason());
+        assert(recentRejects);
+        recentRejects->insert(certHash);
+        if (nDoS > 0)
+            Misbehaving(fromPeer, nDoS);
+    }
+}
+
+/**
+ * Collect the headers answering a getheaders request. Returns false if no
+ * headers message should be sent. Requires cs_main.
+ */
+static bool GetHeadersToSend(CNode* pfrom, const CBlockLocator& locator, const uint256& hashStop,
+                             vector<CBlockHeaderForNetwork>& vHeadersRet)
+{
+    AssertLockHeld(cs_main);
+
+    if (IsInitialBlockDownload())
+        return false;
+
+    CBlockIndex* pindexReference = NULL;
+    bool onMain = getHeadersIsOnMain(locator, hashStop, &pindexReference);
+
+    if (onMain)
+    {
+        CBlockIndex* pindex = NULL;
+        if (locator.IsNull())
+        {
+            // If locator is null, return the hashStop block
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+            if (mi == mapBlockIndex.end())
+                return false;
+            pindex = (*mi).second;
+        }
+        else
+        {
+            // Find the last block the caller has in the main chain
+            pindex = FindForkInGlobalIndex(chainActive, locator);
+            if (pindex)
+                pindex = chainActive.Next(pindex);
+        }
+ 
+        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+        vector<CBlockHeaderForNetwork> vHeaders;
+        int nLimit = MAX_HEADERS_RESULTS;
+        LogPrint("net", "getheaders from h(%d) to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
+        for (; pindex; pindex = chainActive.Next(pindex))
+        {
+            vHeaders.push_back(CBlockHeaderForNetwork(pindex->GetBlockHeader()) );
+            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+                break;
+        }
+        LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
+        vHeadersRet.swap(vHeaders);
+    }
+    else
+    {
+        if(!pindexReference)
+        {
+            // should never happen
+            LogPrint("forks", "%s():%d - reference not found\n", __func__, __LINE__ );
+            return false;
+        }
+
+        if (hashStop != uint256() )
+        {
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+            if (mi == mapBlockIndex.end() ) 
+            {
+                // should never happen
+                LogPrint("forks", "%s():%d - block [%s] not found\n", __func__, __LINE__, hashStop.ToString() );
+                return false;
+            }
+    
+            LogPrint("forks", "%s():%d - peer is not using chain active! Starting from %s at h(%d)\n",
+                __func__, __LINE__, pindexReference->GetBlockHash().ToString(), pindexReference->nHeight );
+ 
+            std::deque<CBlockHeaderForNetwork> dHeadersAlternative;
+
+            bool found = false;
+
+            // the reference is the block which triggered the getheader request (the hashStop)
+            while ( pindexReference )
+            {
+                dHeadersAlternative.push_front(CBlockHeaderForNetwork(pindexReference->GetBlockHeader()));
+ 
+                BOOST_FOREACH(const uint256& hash, locator.vHave)
+                {
+                    if (hash == pindexReference->GetBlockHash() )
+                    {
+                        // we found the tip passed along in locator, we must stop here 
+                        LogPrint("forks", "%s():%d - matched fork tip in locator [%s]\n",
+                            __func__, __LINE__, hash.ToString() );
+                        found = true;
+                        break;
+                    } 
+                }
+ 
+                if (found || pindexReference->pprev == chainActive.Genesis() )
+                {
+                    break;
+                }
+ 
+                pindexReference = pindexReference->pprev;
+            }
+
+            vector<CBlockHeaderForNetwork> vHeaders;
+            int nLimit = MAX_HEADERS_RESULTS;
+            // we are on a fork: fill the vector rewinding the deque so that we have the correct ordering
+            LogPrint("forks", "%s():%d - Found %d headers to push to node[%s]:\n", __func__, __LINE__, dHeadersAlternative.size(), pfrom->addrName);
+            for(const auto& cb : dHeadersAlternative) {
+                LogPrint("forks", "%s():%d -- [%s]\n", __func__, __LINE__, cb.GetHash().ToString() );
+                vHeaders.push_back(cb);
+                if (--nLimit <= 0)
+                    break;
+            }
+            LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
+            vHeadersRet.swap(vHeaders);
+        }
+        else
+        {
+            LogPrint("forks", "%s():%d - hashStop block is null\n", __func__, __LINE__);
+
+            // this is the case when we just sent 160 headers, reference is the header which the last getheader
+            // request has reached: more must be sent starting from this one
+            std::set<const CBlockIndex*> sProcessed;
+            std::vector<CBlockHeaderForNetwork> vHeadersMulti;
+            int nLimit = MAX_HEADERS_RESULTS;
+
+            int h = pindexReference->nHeight;
+
+            LogPrint("forks", "%s():%d - Searching up to %s h(%d) from tips backwards\n",
+                __func__, __LINE__, pindexReference->GetBlockHash().ToString(), pindexReference->nHeight);
+
+            // we must follow all forks backwards because we can not tell which is the concerned one
+            // peer will discard headers already known if any
+            BOOST_FOREACH(auto mapPair, mGlobalForkTips)
+            {
+                const CBlockIndex* block = mapPair.first;
+                if (block == chainActive.Tip() || block == pindexBestHeader )
+                {
+                    LogPrint("forks", "%s():%d - skipping tips\n", __func__, __LINE__);
+                    continue;
+                }
+
+                std::deque<CBlockHeaderForNetwork> dHeadersAlternativeMulti;
+
+                LogPrint("forks", "%s():%d - tips %s h(%d)\n",
+                    __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
+
+                while (block && 
+                       block != pindexReference &&
+                       block->nHeight >= h)
+                {
+                    if (!sProcessed.count(block) )
+                    {
+                        LogPrint("forks", "%s():%d - adding %s h(%d)\n",
+                            __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
+                        dHeadersAlternativeMulti.push_front(CBlockHeaderForNetwork(block->GetBlockHeader()));
+                        sProcessed.insert(block);
+                    }
+                    block = block->pprev;
+                }
+
+                if (block == pindexReference)
+                {
+                    // we exited from the while loop with the right condition, therefore we must take this branch into account
+                    LogPrint("forks", "%s():%d - found reference %s h(%d)\n",
+                        __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
+
+                    // we must process each deque in order to have a resulting vector with headers in the correct order
+                    // for all possible forks
+                    for(const auto& cb : dHeadersAlternativeMulti)
+                    {
+                        if (--nLimit > 0)
+                        {
+                            LogPrint("forks", "%s():%d -- [%s]\n", __func__, __LINE__, cb.GetHash().ToString() );
+                            vHeadersMulti.push_back(cb);
+                        }
+                    }
+                }
+                else
+                if (block->nHeight < h)
+                {
+                    // we must neglect this branch since not linked to the reference
+                    LogPrint("forks", "%s():%d - could not find reference, stopped at %s h(%d)\n",
+                        __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
+                }
+                else
+                {
+                    // should never happen
+                    LogPrint("forks", "%s():%d - block ptr is null\n", __func__, __LINE__);
+                }
+            }
+
+            LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n",
+                __func__, __LINE__, vHeadersMulti.size(), pfrom->addrName);
+            vHeadersRet.swap(vHeadersMulti);
+
+        } // end of hashstop is null
+
+    } // end of is on main
+
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     const CChainParams& chainparams = Params();
@@ -5524,6 +6118,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (pfrom->nVersion != 0)
         {
             pfrom->PushMessage("reject", strCommand, REJECT_DUPLICATE, string("Duplicate version message"));
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 1);
             return false;
         }
@@ -5641,7 +6236,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (pfrom->nVersion == 0)
     {
-        // Must have a version message before anything else
+        // Must have a version message before anything else. getdata, getheaders and getblocks
+        // get here on several message handler threads at once: node states need cs_main.
+        LOCK(cs_main);
         Misbehaving(pfrom->GetId(), 1);
         return false;
     }
@@ -5669,6 +6266,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return true;
         if (vAddr.size() > 1000)
         {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message addr size() = %u", vAddr.size());
         }
@@ -5732,6 +6330,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vRecv >> vInv;
         if (vInv.size() > MAX_INV_SZ)
         {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message inv size() = %u", vInv.size());
         }
@@ -5826,6 +6425,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vRecv >> vInv;
         if (vInv.size() > MAX_INV_SZ)
         {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("message getdata size() = %u", vInv.size());
         }
@@ -5888,194 +6488,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
-        LOCK(cs_main);
-
-        if (IsInitialBlockDownload())
-            return true;
-
-        CBlockIndex* pindexReference = NULL;
-        bool onMain = getHeadersIsOnMain(locator, hashStop, &pindexReference);
-
-        if (onMain)
+        vector<CBlockHeaderForNetwork> vHeaders;
+        bool fSend = false;
         {
-            CBlockIndex* pindex = NULL;
-            if (locator.IsNull())
-            {
-                // If locator is null, return the hashStop block
-                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-                if (mi == mapBlockIndex.end())
-                    return true;
-                pindex = (*mi).second;
-            }
-            else
-            {
-                // Find the last block the caller has in the main chain
-                pindex = FindForkInGlobalIndex(chainActive, locator);
-                if (pindex)
-                    pindex = chainActive.Next(pindex);
-            }
- 
-            // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-            vector<CBlockHeaderForNetwork> vHeaders;
-            int nLimit = MAX_HEADERS_RESULTS;
-            LogPrint("net", "getheaders from h(%d) to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-            for (; pindex; pindex = chainActive.Next(pindex))
-            {
-                vHeaders.push_back(CBlockHeaderForNetwork(pindex->GetBlockHeader()) );
-                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                    break;
-            }
-            LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
-            pfrom->PushMessage("headers", vHeaders);
+            LOCK(cs_main);
+            fSend = GetHeadersToSend(pfrom, locator, hashStop, vHeaders);
         }
-        else
-        {
-            if(!pindexReference)
-            {
-                // should never happen
-                LogPrint("forks", "%s():%d - reference not found\n", __func__, __LINE__ );
-                return true;
-            }
-
-            if (hashStop != uint256() )
-            {
-                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-                if (mi == mapBlockIndex.end() ) 
-                {
-                    // should never happen
-                    LogPrint("forks", "%s():%d - block [%s] not found\n", __func__, __LINE__, hashStop.ToString() );
-                    return true;
-                }
-    
-                LogPrint("forks", "%s():%d - peer is not using chain active! Starting from %s at h(%d)\n",
-                    __func__, __LINE__, pindexReference->GetBlockHash().ToString(), pindexReference->nHeight );
- 
-                std::deque<CBlockHeaderForNetwork> dHeadersAlternative;
-
-                bool found = false;
-
-                // the reference is the block which triggered the getheader request (the hashStop)
-                while ( pindexReference )
-                {
-                    dHeadersAlternative.push_front(CBlockHeaderForNetwork(pindexReference->GetBlockHeader()));
- 
-                    BOOST_FOREACH(const uint256& hash, locator.vHave)
-                    {
-                        if (hash == pindexReference->GetBlockHash() )
-                        {
-                            // we found the tip passed along in locator, we must stop here 
-                            LogPrint("forks", "%s():%d - matched fork tip in locator [%s]\n",
-                                __func__, __LINE__, hash.ToString() );
-                            found = true;
-                            break;
-                        } 
-                    }
- 
-                    if (found || pindexReference->pprev == chainActive.Genesis() )
-                    {
-                        break;
-                    }
- 
-                    pindexReference = pindexReference->pprev;
-                }
-
-                vector<CBlockHeaderForNetwork> vHeaders;
-                int nLimit = MAX_HEADERS_RESULTS;
-                // we are on a fork: fill the vector rewinding the deque so that we have the correct ordering
-                LogPrint("forks", "%s():%d - Found %d headers to push to node[%s]:\n", __func__, __LINE__, dHeadersAlternative.size(), pfrom->addrName);
-                for(const auto& cb : dHeadersAlternative) {
-                    LogPrint("forks", "%s():%d -- [%s]\n", __func__, __LINE__, cb.GetHash().ToString() );
-                    vHeaders.push_back(cb);
-                    if (--nLimit <= 0)
-                        break;
-                }
-                LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n", __func__, __LINE__, vHeaders.size(), pfrom->addrName);
-                pfrom->PushMessage("headers", vHeaders);
-            }
-            else
-            {
-                LogPrint("forks", "%s():%d - hashStop block is null\n", __func__, __LINE__);
-
-                // this is the case when we just sent 160 headers, reference is the header which the last getheader
-                // request has reached: more must be sent starting from this one
-                std::set<const CBlockIndex*> sProcessed;
-                std::vector<CBlockHeaderForNetwork> vHeadersMulti;
-                int nLimit = MAX_HEADERS_RESULTS;
-
-                int h = pindexReference->nHeight;
-
-                LogPrint("forks", "%s():%d - Searching up to %s h(%d) from tips backwards\n",
-                    __func__, __LINE__, pindexReference->GetBlockHash().ToString(), pindexReference->nHeight);
-
-                // we must follow all forks backwards because we can not tell which is the concerned one
-                // peer will discard headers already known if any
-                BOOST_FOREACH(auto mapPair, mGlobalForkTips)
-                {
-                    const CBlockIndex* block = mapPair.first;
-                    if (block == chainActive.Tip() || block == pindexBestHeader )
-                    {
-                        LogPrint("forks", "%s():%d - skipping tips\n", __func__, __LINE__);
-                        continue;
-                    }
-
-                    std::deque<CBlockHeaderForNetwork> dHeadersAlternativeMulti;
-
-                    LogPrint("forks", "%s():%d - tips %s h(%d)\n",
-                        __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
-
-                    while (block && 
-                           block != pindexReference &&
-                           block->nHeight >= h)
-                    {
-                        if (!sProcessed.count(block) )
-                        {
-                            LogPrint("forks", "%s():%d - adding %s h(%d)\n",
-                                __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
-                            dHeadersAlternativeMulti.push_front(CBlockHeaderForNetwork(block->GetBlockHeader()));
-                            sProcessed.insert(block);
-                        }
-                        block = block->pprev;
-                    }
-
-                    if (block == pindexReference)
-                    {
-                        // we exited from the while loop with the right condition, therefore we must take this branch into account
-                        LogPrint("forks", "%s():%d - found reference %s h(%d)\n",
-                            __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
-
-                        // we must process each deque in order to have a resulting vector with headers in the correct order
-                        // for all possible forks
-                        for(const auto& cb : dHeadersAlternativeMulti)
-                        {
-                            if (--nLimit > 0)
-                            {
-                                LogPrint("forks", "%s():%d -- [%s]\n", __func__, __LINE__, cb.GetHash().ToString() );
-                                vHeadersMulti.push_back(cb);
-                            }
-                        }
-                    }
-                    else
-                    if (block->nHeight < h)
-                    {
-                        // we must neglect this branch since not linked to the reference
-                        LogPrint("forks", "%s():%d - could not find reference, stopped at %s h(%d)\n",
-                            __func__, __LINE__, block->GetBlockHash().ToString(), block->nHeight);
-                    }
-                    else
-                    {
-                        // should never happen
-                        LogPrint("forks", "%s():%d - block ptr is null\n", __func__, __LINE__);
-                    }
-                }
-
-                LogPrint("forks", "%s():%d - Pushing %d headers to node[%s]\n",
-                    __func__, __LINE__, vHeadersMulti.size(), pfrom->addrName);
-                pfrom->PushMessage("headers", vHeadersMulti);
-
-            } // end of hashstop is null
-
-        } // end of is on main
-
+        // serialize and queue the headers after releasing cs_main
+        if (fSend)
+            pfrom->PushMessage("headers", vHeaders);
     } // end of command getheaders
 
 
@@ -6123,6 +6544,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
         unsigned int nCount = ReadCompactSize(vRecv);
         if (nCount > MAX_HEADERS_RESULTS) {
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
             return error("headers message size = %u", nCount);
         }
@@ -6367,6 +6789,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 // This isn't a Misbehaving(100) (immediate ban) because the
                 // peer might be an older or different implementation with
                 // a different signature key, etc.
+                LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), 10);
             }
         }
@@ -6379,8 +6802,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         vRecv >> filter;
 
         if (!filter.IsWithinSizeConstraints())
+        {
             // There is no excuse for sending a too-large filter
+            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100);
+        }
         else
         {
             LOCK(pfrom->cs_filter);
@@ -6399,15 +6825,22 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
         // and thus, the maximum size any matched object can have) in a filteradd message
+        bool bad = false;
         if (vData.size() > MAX_SCRIPT_ELEMENT_SIZE)
         {
-            Misbehaving(pfrom->GetId(), 100);
+            bad = true;
         } else {
             LOCK(pfrom->cs_filter);
             if (pfrom->pfilter)
                 pfrom->pfilter->insert(vData);
             else
-                Misbehaving(pfrom->GetId(), 100);
+                bad = true;
+        }
+        if (bad)
+        {
+            // cs_main is taken before cs_filter elsewhere, so not inside it
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
         }
     }
 
@@ -6460,6 +6893,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     return true;
 }
 
+/**
+ * Messages whose handlers only read shared state under its own locks (and only
+ * write to pfrom), so different message handler threads may run them while
+ * another peer's message is processed under cs_messageProcessing.
+ */
+static bool IsConcurrentMessage(const std::string& strCommand)
+{
+    return strCommand == "getdata" || strCommand == "getheaders" || strCommand == "getblocks";
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -6537,7 +6980,13 @@ bool ProcessMessages(CNode* pfrom)
         bool fRet = false;
         try
         {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            if (IsConcurrentMessage(strCommand))
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            else
+            {
+                LOCK(cs_messageProcessing);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            }
             boost::this_thread::interruption_point();
         }
         catch (const std::ios_base::failure& e)
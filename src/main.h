@@ -15,6 +15,7 @@
 #include "chainparams.h"
 #include "coins.h"
 #include "consensus/consensus.h"
+#include "mappedfiles.h"
 #include "net.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
@@ -40,8 +41,10 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewFlushBuffer;
 class CBloomFilter;
 class CInv;
+class CJoinSplitCheck;
 class CScriptCheck;
 class CValidationInterface;
 class CValidationState;
@@ -68,12 +71,22 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 100;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxmempool, maximum megabytes of mempool memory usage */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** -maxmappedblockfiles default: number of blk/rev files kept memory-mapped for reading (0 = buffered reads only) */
+#if defined(WIN32) || SIZE_MAX <= UINT32_MAX
+static const unsigned int DEFAULT_MAX_MAPPED_BLOCK_FILES = 0;
+#else
+static const unsigned int DEFAULT_MAX_MAPPED_BLOCK_FILES = 64;
+#endif
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
@@ -121,6 +134,7 @@ extern bool fExperimentalMode;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern int nScProofVerificationThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
@@ -131,6 +145,8 @@ extern bool fCoinbaseEnforcedProtectionEnabled;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
+/** Read-only mappings of the blk/rev files, used by ReadBlockFromDisk and UndoReadFromDisk */
+extern CMappedFileCache mappedBlockFiles;
 
 /** Comparison function for sorting the getchaintips heads.  */
 struct CompareBlocksByHeight
@@ -225,6 +241,10 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the certificate proof checking thread */
+void ThreadScCertProofCheck();
+/** Run an instance of the JoinSplit proof and signature checking thread */
+void ThreadJoinSplitCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -278,7 +298,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
-/** Increase a node's misbehavior score. */
+/** Increase a node's misbehavior score. Requires cs_main, which guards the node states. */
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
@@ -292,8 +312,15 @@ bool AcceptTxBaseToMemoryPool(CTxMemPool& pool, CValidationState &state, const C
 bool AcceptTxToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool disconnecting = false);
 
+/** If pvProofChecks is not null and the certificate proof is not known to be valid yet, the proof verification is
+ *  appended to pvProofChecks and the certificate is NOT added to the pool: the caller is in charge of verifying the
+ *  proof and of submitting the certificate again. */
 bool AcceptCertificateToMemoryPool(CTxMemPool& pool, CValidationState &state, const CScCertificate &cert, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool disconnecting = false);
+                        bool* pfMissingInputs, bool fRejectAbsurdFee=false, bool disconnecting = false,
+                        std::vector<libzendoomc::CScCertProofCheck>* pvProofChecks = nullptr);
+
+/** Final stage of the asynchronous acceptance of a certificate received from a peer, once its proof has been checked */
+void ProcessVerifiedCertificate(NodeId fromPeer, const CScCertificate& cert, bool fProofVerified);
 
 struct CNodeStateStats {
     int nMisbehavior;
@@ -385,9 +412,14 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache &inputs, CTxUndo& txund
 void UpdateCoins(const CScCertificate& cert, CCoinsViewCache &inputs, CTxUndo& txundo, int nHeight);
 
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, CValidationState& state, libzcash::ProofVerifier& verifier);
+/** If pvChecks is not null, the JoinSplit proofs and joinSplitSig are not verified but appended to pvChecks */
+bool CheckTransaction(const CTransaction& tx, CValidationState& state, libzcash::ProofVerifier& verifier,
+                      std::vector<CJoinSplitCheck>* pvChecks = nullptr);
 bool CheckCertificate(const CScCertificate& cert, CValidationState& state);
-bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidationState &state);
+bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidationState &state,
+                                              std::vector<CJoinSplitCheck>* pvChecks = nullptr);
+/** Check the joinSplitSig of a transaction that has JoinSplits */
+bool CheckJoinSplitSig(const CTransaction& tx, CValidationState &state);
 
 /** Check for standard transaction types
  * @return True if all outputs (scriptPubKeys) use only standard transaction forms
@@ -432,11 +464,36 @@ public:
     ScriptError GetScriptError() const;
 };
 
+/**
+ * Closure representing the verification of one JoinSplit proof, or of the
+ * joinSplitSig, of a transaction. The transaction and the verifier must
+ * outlive the check.
+ */
+class CJoinSplitCheck
+{
+private:
+    const CTransaction *ptx;
+    //! Index of the JSDescription whose proof is verified, or SIGNATURE
+    size_t nJoinSplit;
+    libzcash::ProofVerifier *pverifier;
+
+public:
+    static const size_t SIGNATURE = (size_t)-1;
+
+    CJoinSplitCheck();
+    explicit CJoinSplitCheck(const CTransaction& txIn);
+    CJoinSplitCheck(const CTransaction& txIn, size_t nJoinSplitIn, libzcash::ProofVerifier& verifierIn);
+    bool operator()();
+    void swap(CJoinSplitCheck &check);
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read a block in its serialized form, checking that it hashes to hashBlock */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -454,9 +511,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
+/** If pvJoinSplitChecks is not null, the JoinSplit proofs and signatures are appended to it instead of being verified */
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 libzcash::ProofVerifier& verifier,
-                bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+                bool fCheckPOW = true, bool fCheckMerkleRoot = true,
+                std::vector<CJoinSplitCheck>* pvJoinSplitChecks = nullptr);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex *pindexPrev);
@@ -558,6 +617,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the background writer in front of the coin database */
+extern CCoinsViewFlushBuffer *pcoinsFlushBuffer;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
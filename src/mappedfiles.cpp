@@ -0,0 +1,117 @@
+// Copyright (c) 2020 The Zen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfiles.h"
+
+#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <limits>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const boost::filesystem::path& path)
+{
+#ifdef WIN32
+    return std::shared_ptr<const CMappedFile>();
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return std::shared_ptr<const CMappedFile>();
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > std::numeric_limits<size_t>::max()) {
+        close(fd);
+        return std::shared_ptr<const CMappedFile>();
+    }
+
+    size_t nSize = st.st_size;
+    void* p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrint("mmap", "Unable to map %s: %s\n", path.string(), strerror(errno));
+        return std::shared_ptr<const CMappedFile>();
+    }
+
+    return std::shared_ptr<const CMappedFile>(new CMappedFile((const char*)p, nSize));
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pbegin, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFileCache::Get(const boost::filesystem::path& path, size_t nMinSize)
+{
+    const std::string strPath = path.string();
+
+    LOCK(cs);
+    if (nMaxFiles == 0)
+        return std::shared_ptr<const CMappedFile>();
+
+    for (MappedFileList::iterator it = lruFiles.begin(); it != lruFiles.end(); ++it) {
+        if (it->first != strPath)
+            continue;
+        if (it->second->size() >= nMinSize) {
+            lruFiles.splice(lruFiles.begin(), lruFiles, it);
+            return it->second;
+        }
+        // The file has grown since it was mapped, map it again
+        lruFiles.erase(it);
+        break;
+    }
+
+    std::shared_ptr<const CMappedFile> mapping = CMappedFile::Open(path);
+    if (!mapping)
+        return mapping;
+
+    lruFiles.push_front(std::make_pair(strPath, mapping));
+    while (lruFiles.size() > nMaxFiles)
+        lruFiles.pop_back();
+    return mapping;
+}
+
+void CMappedFileCache::Remove(const boost::filesystem::path& path)
+{
+    const std::string strPath = path.string();
+
+    LOCK(cs);
+    for (MappedFileList::iterator it = lruFiles.begin(); it != lruFiles.end(); ++it) {
+        if (it->first == strPath) {
+            lruFiles.erase(it);
+            return;
+        }
+    }
+}
+
+void CMappedFileCache::SetMaxFiles(size_t nMaxFilesIn)
+{
+    LOCK(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (lruFiles.size() > nMaxFiles)
+        lruFiles.pop_back();
+}
+
+size_t CMappedFileCache::GetMaxFiles()
+{
+    LOCK(cs);
+    return nMaxFiles;
+}
+
+size_t CMappedFileCache::size()
+{
+    LOCK(cs);
+    return lruFiles.size();
+}
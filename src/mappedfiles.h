@@ -0,0 +1,75 @@
+// Copyright (c) 2020 The Zen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILES_H
+#define BITCOIN_MAPPEDFILES_H
+
+#include "sync.h"
+
+#include <stddef.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+
+/** A read-only memory mapping of a whole file, unmapped when destroyed. */
+class CMappedFile
+{
+public:
+    /** Map path for reading. Returns an empty pointer if the file is empty or
+     *  cannot be mapped (e.g. on platforms without mmap support). */
+    static std::shared_ptr<const CMappedFile> Open(const boost::filesystem::path& path);
+
+    ~CMappedFile();
+
+    const char* data() const { return pbegin; }
+    size_t size() const { return nSize; }
+
+private:
+    CMappedFile(const char* pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pbegin;
+    size_t nSize;
+};
+
+/**
+ * Keeps a bounded number of files mapped, evicting the least recently used
+ * one. A mapping handed out by Get() stays valid for as long as the caller
+ * holds on to it, even if it is evicted or the file is removed meanwhile.
+ */
+class CMappedFileCache
+{
+public:
+    explicit CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Mapping of path covering at least nMinSize bytes if the file is that
+     *  large. A cached mapping that is too short because the file has grown
+     *  since it was mapped is replaced. Returns an empty pointer when the
+     *  file cannot be mapped or caching is disabled. */
+    std::shared_ptr<const CMappedFile> Get(const boost::filesystem::path& path, size_t nMinSize);
+
+    /** Forget the mapping of path, e.g. before the file is deleted. */
+    void Remove(const boost::filesystem::path& path);
+
+    /** Change the number of mapped files; 0 disables mapping. */
+    void SetMaxFiles(size_t nMaxFilesIn);
+
+    size_t GetMaxFiles();
+    size_t size();
+
+private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<const CMappedFile> > > MappedFileList;
+
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    //! most recently used first
+    MappedFileList lruFiles;
+};
+
+#endif // BITCOIN_MAPPEDFILES_H
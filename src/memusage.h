@@ -86,6 +86,12 @@ static inline size_t DynamicUsage(const std::map<X, Y>& m)
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X, Y> >)) * m.size();
 }
 
+template<typename X, typename Y>
+static inline size_t DynamicUsage(const std::multimap<X, Y>& m)
+{
+    return MallocUsage(sizeof(stl_tree_node<std::pair<const X, Y> >)) * m.size();
+}
+
 // Boost data structures
 
 template<typename X>
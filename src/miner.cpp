@@ -155,7 +155,14 @@ bool GetTxInputsDependencies(const CTransactionBase& txBase, CAmount& nTotalIn,
 {
     const uint256& hash = txBase.GetHash();
 
-    // Detect orphan transaction and its dependencies
+    // The mempool keeps track of what each object waits for (inputs from other mempool objects and
+    // the creation of the sidechains it sends funds to), so objects depending only on the chain are
+    // recognized without looking at their inputs.
+    std::map<uint256, std::set<uint256> >::const_iterator itDeps = mempool.mapDependencies.find(hash);
+    if (itDeps == mempool.mapDependencies.end())
+        return true;
+
+    // Account the value of the inputs spent from mempool objects, the others are added by AddTxToPriorities
     BOOST_FOREACH(const CTxIn& txin, txBase.GetVin())
     {
         if (mempool.mapCertificate.count(txin.prevout.hash))
@@ -174,34 +181,25 @@ bool GetTxInputsDependencies(const CTransactionBase& txBase, CAmount& nTotalIn,
                 if (fDebug) assert("mempool transaction unspendable input that is an unconfirmed certificate output" == 0);
                 return false;
             }
-            if (!porphan)
-            {
-                // Use list for automatic deletion
-                vOrphan.push_back(COrphan(&txBase));
-                porphan = &vOrphan.back();
-            }
-            mapDependers[txin.prevout.hash].push_back(porphan);
-            porphan->setDependsOn.insert(txin.prevout.hash);
-            nTotalIn += mempool.mapCertificate[txin.prevout.hash].GetCertificate().GetVout()[txin.prevout.n].nValue;
-            LogPrint("sc", "%s():%d - [%s] depends on [%s] for input\n",
-                __func__, __LINE__, txBase.GetHash().ToString(), txin.prevout.hash.ToString());
+            nTotalIn += inputCert.GetVout()[txin.prevout.n].nValue;
         }
         else
         if (mempool.mapTx.count(txin.prevout.hash))
         {
-            if (!porphan)
-            {
-                // Use list for automatic deletion
-                vOrphan.push_back(COrphan(&txBase));
-                porphan = &vOrphan.back();
-            }
-            mapDependers[txin.prevout.hash].push_back(porphan);
-            porphan->setDependsOn.insert(txin.prevout.hash);
             nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().GetVout()[txin.prevout.n].nValue;
-            LogPrint("sc", "%s():%d - [%s] depends on [%s] for input\n",
-                __func__, __LINE__, txBase.GetHash().ToString(), txin.prevout.hash.ToString());
         }
     }
+
+    // Use list for automatic deletion
+    vOrphan.push_back(COrphan(&txBase));
+    porphan = &vOrphan.back();
+    for (const uint256& parentHash: itDeps->second)
+    {
+        mapDependers[parentHash].push_back(porphan);
+        porphan->setDependsOn.insert(parentHash);
+        LogPrint("sc", "%s():%d - [%s] depends on [%s]\n",
+            __func__, __LINE__, hash.ToString(), parentHash.ToString());
+    }
     return true;
 }
 
@@ -300,44 +298,423 @@ void GetBlockCertPriorityData(const CBlock *pblock, int nHeight, const CCoinsVie
     }
 }
 
-void GetBlockTxPriorityData(const CBlock *pblock, int nHeight, int64_t nMedianTimePast, const CCoinsViewCache& view,
-                               vector<TxPriority>& vecPriority, list<COrphan>& vOrphan, map<uint256, vector<COrphan*> >& mapDependers)
+//
+// Block assembly on top of the mempool indexes: the certificates first, then the transactions with
+// enough priority to be included for free, then the transaction packages by ancestor fee rate.
+//
+struct CBlockAssembly
 {
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-         mi != mempool.mapTx.end(); ++mi)
+    CBlock* pblock;
+    CBlockTemplate* pblocktemplate;
+    CCoinsViewCache& view;
+    const int nHeight;
+    const int64_t nLockTimeCutoff;
+    const unsigned int nBlockMaxSize;
+    const unsigned int nBlockMaxComplexitySize; // 0 for no limit
+    const bool fPrintPriority;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    int nBlockSigOps;
+    int nBlockComplexity;
+    CAmount nFees;
+
+    // objects already in the block, and those that cannot be added to it
+    std::set<uint256> setInBlock;
+    std::set<uint256> setFailed;
+
+    // ancestor packages of the txs that have some ancestors in the block already, without them
+    std::map<uint256, CTxMemPoolAncestorState> mapModified;
+    std::set<std::pair<CFeeRate, uint256> > setModified;
+
+    CBlockAssembly(CBlockTemplate* pblocktemplateIn, CCoinsViewCache& viewIn, int nHeightIn, int64_t nLockTimeCutoffIn,
+                   unsigned int nBlockMaxSizeIn, unsigned int nBlockMaxComplexitySizeIn, bool fPrintPriorityIn):
+        pblock(&pblocktemplateIn->block), pblocktemplate(pblocktemplateIn), view(viewIn), nHeight(nHeightIn),
+        nLockTimeCutoff(nLockTimeCutoffIn), nBlockMaxSize(nBlockMaxSizeIn), nBlockMaxComplexitySize(nBlockMaxComplexitySizeIn),
+        fPrintPriority(fPrintPriorityIn), nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nBlockComplexity(0), nFees(0) {}
+};
+
+static bool AddToBlockIfValid(const CTransactionBase& tx, CBlockAssembly& block, CAmount& nTxFees)
+{
+    const uint256& hash = tx.GetHash();
+
+    // Size limits
+    unsigned int nTxSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    if (block.nBlockSize + nTxSize >= block.nBlockMaxSize)
+        return false;
+
+    // Legacy limits on sigOps:
+    unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+    if (block.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+        return false;
+
+    // Skip transaction if max block complexity reached.
+    int nTxComplexity = tx.GetVin().size() * tx.GetVin().size();
+    if (block.nBlockMaxComplexitySize > 0 && block.nBlockComplexity + nTxComplexity >= block.nBlockMaxComplexitySize)
+        return false;
+
+    if (!block.view.HaveInputs(tx))
     {
-        const CTransaction& tx = mi->second.GetTx();
+        LogPrint("sc", "%s():%d - Skipping [%s] because it has no inputs\n",
+            __func__, __LINE__, hash.ToString() );
+        return false;
+    }
 
-        int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
-                ? nMedianTimePast
-                : pblock->GetBlockTime();
+    nTxFees = tx.GetFeeAmount(block.view.GetValueIn(tx));
 
-        if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight, nLockTimeCutoff))
+    nTxSigOps += GetP2SHSigOpCount(tx, block.view);
+    if (block.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+    {
+        LogPrint("sc", "%s():%d - Skipping [%s] because too many sigops in block\n",
+            __func__, __LINE__, hash.ToString() );
+        return false;
+    }
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    CValidationState state;
+    if (!tx.ContextualCheckInputs(state, block.view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
+        return false;
+
+    CTxUndo dummyUndo;
+    try {
+        if (tx.IsCertificate())
+            UpdateCoins(dynamic_cast<const CScCertificate&>(tx), block.view, dummyUndo, block.nHeight);
+        else
+            UpdateCoins(dynamic_cast<const CTransaction&>(tx), block.view, dummyUndo, block.nHeight);
+    } catch (...) {
+        LogPrintf("%s():%d - ERROR: tx [%s] cast error\n",
+            __func__, __LINE__, hash.ToString());
+        assert("could not cast txbase obj" == 0);
+    }
+
+    tx.AddToBlock(block.pblock);
+    tx.AddToBlockTemplate(block.pblocktemplate, nTxFees, nTxSigOps);
+
+    block.nBlockSize += nTxSize;
+    ++block.nBlockTx;
+    block.nBlockSigOps += nTxSigOps;
+    block.nFees += nTxFees;
+    block.nBlockComplexity += nTxComplexity;
+    block.setInBlock.insert(hash);
+    return true;
+}
+
+static const CTransactionBase* GetMempoolObject(const uint256& hash)
+{
+    std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mempool.mapTx.find(hash);
+    if (itTx != mempool.mapTx.end())
+        return &itTx->second.GetTx();
+    std::map<uint256, CCertificateMemPoolEntry>::const_iterator itCert = mempool.mapCertificate.find(hash);
+    if (itCert != mempool.mapCertificate.end())
+        return &itCert->second.GetCertificate();
+    return nullptr;
+}
+
+static CTxMemPoolAncestorState GetPackageState(const uint256& hash, const CBlockAssembly& block)
+{
+    std::map<uint256, CTxMemPoolAncestorState>::const_iterator it = block.mapModified.find(hash);
+    if (it != block.mapModified.end())
+        return it->second;
+    return mempool.mapAncestorState.at(hash);
+}
+
+static double GetModifiedPriority(const uint256& hash, int nHeight)
+{
+    double dPriority = mempool.mapTx.at(hash).GetPriority(nHeight);
+    CAmount nFeeDelta = 0;
+    mempool.ApplyDeltas(hash, dPriority, nFeeDelta);
+    return dPriority;
+}
+
+// The descendants of a tx just added to the block do not need it in their packages anymore
+static void UpdatePackagesForAddedTx(const uint256& hash, CBlockAssembly& block)
+{
+    const CTxMemPoolEntry& entry = mempool.mapTx.at(hash);
+    double dPriorityDelta = 0;
+    CAmount nModFee = entry.GetFee();
+    mempool.ApplyDeltas(hash, dPriorityDelta, nModFee);
+
+    std::set<uint256> setDescendants;
+    mempool.CalculateDescendants(hash, setDescendants);
+    for (const uint256& descendantHash: setDescendants)
+    {
+        if (block.setInBlock.count(descendantHash) || !mempool.mapAncestorState.count(descendantHash))
             continue;
 
-        CAmount nTotalIn = 0;
-        COrphan* porphan = nullptr;
+        CTxMemPoolAncestorState state = GetPackageState(descendantHash, block);
+        block.setModified.erase(std::make_pair(state.GetFeeRate(), descendantHash));
+        state.nCountWithAncestors--;
+        state.nSizeWithAncestors -= entry.GetTxSize();
+        state.nModFeesWithAncestors -= nModFee;
+        block.mapModified[descendantHash] = state;
+        block.setModified.insert(std::make_pair(state.GetFeeRate(), descendantHash));
+
+        // a smaller package may fit where the former did not
+        block.setFailed.erase(descendantHash);
+    }
 
-        if (!GetTxInputsDependencies(tx, nTotalIn, nHeight, vOrphan, mapDependers, porphan) )
+    std::map<uint256, CTxMemPoolAncestorState>::iterator itModified = block.mapModified.find(hash);
+    if (itModified != block.mapModified.end())
+    {
+        block.setModified.erase(std::make_pair(itModified->second.GetFeeRate(), hash));
+        block.mapModified.erase(itModified);
+    }
+}
+
+static void SortByDependencies(const uint256& hash, const std::set<uint256>& setPackage,
+                               std::set<uint256>& setVisited, std::vector<uint256>& vSorted)
+{
+    if (!setPackage.count(hash) || !setVisited.insert(hash).second)
+        return;
+    std::map<uint256, std::set<uint256> >::const_iterator itDeps = mempool.mapDependencies.find(hash);
+    if (itDeps != mempool.mapDependencies.end())
+    {
+        for (const uint256& parentHash: itDeps->second)
+            SortByDependencies(parentHash, setPackage, setVisited, vSorted);
+    }
+    vSorted.push_back(hash);
+}
+
+// Adds a tx or certificate preceded by its in-pool ancestors not yet in the block. On failure, the
+// ancestors added before the failing object stay in the block: they do not depend on it.
+static bool AddPackageToBlock(const uint256& hash, CBlockAssembly& block, const CFeeRate& feeRate)
+{
+    std::set<uint256> setAncestors;
+    mempool.CalculateAncestors(hash, setAncestors);
+    std::set<uint256> setPackage;
+    for (const uint256& ancestorHash: setAncestors)
+    {
+        if (!block.setInBlock.count(ancestorHash))
+            setPackage.insert(ancestorHash);
+    }
+
+    std::vector<uint256> vPackage;
+    std::set<uint256> setVisited;
+    for (const uint256& packageHash: setPackage)
+        SortByDependencies(packageHash, setPackage, setVisited, vPackage);
+
+    uint64_t nPackageSize = 0;
+    for (const uint256& packageHash: vPackage)
+    {
+        if (block.setFailed.count(packageHash))
+            return false;
+        const CTransactionBase* ptx = GetMempoolObject(packageHash);
+        assert(ptx);
+        if (!ptx->IsCertificate())
         {
-            if (porphan)
-                vOrphan.pop_back();
+            const CTransaction& tx = dynamic_cast<const CTransaction&>(*ptx);
+            if (tx.IsCoinBase() || !IsFinalTx(tx, block.nHeight, block.nLockTimeCutoff))
+            {
+                block.setFailed.insert(packageHash);
+                return false;
+            }
+        }
+        nPackageSize += ptx->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    }
+    if (block.nBlockSize + nPackageSize >= block.nBlockMaxSize)
+        return false;
+
+    for (const uint256& packageHash: vPackage)
+    {
+        const CTransactionBase& tx = *GetMempoolObject(packageHash);
+        CAmount nTxFees = 0;
+        if (!AddToBlockIfValid(tx, block, nTxFees))
+        {
+            block.setFailed.insert(packageHash);
+            return false;
+        }
+        if (!tx.IsCertificate())
+            UpdatePackagesForAddedTx(packageHash, block);
+
+        if (block.fPrintPriority)
+        {
+            LogPrintf("package feeRate %s fee %d txid %s\n",
+                feeRate.ToString(), nTxFees, packageHash.ToString());
+        }
+    }
+    return true;
+}
+
+// Certificates go first, whatever the fee rate of their packages: a sidechain needs its certificate
+// in the chain within the submission window of the epoch, while a tx can always wait another block.
+// They are taken by sidechain and epoch, so the template does not depend on the pool insertion order.
+static void AddCertificatesToBlock(CBlockAssembly& block)
+{
+    for (const auto& entry: mempool.mapCertByScEpoch)
+    {
+        if (block.setInBlock.count(entry.second))
+            continue;
+        const CCertificateMemPoolEntry& certEntry = mempool.mapCertificate.at(entry.second);
+        if (!AddPackageToBlock(entry.second, block, CFeeRate(certEntry.GetFee(), certEntry.GetCertificateSize())))
+        {
+            LogPrint("cert", "%s():%d - cert [%s] of sc [%s], epoch %d, not added to block\n",
+                __func__, __LINE__, entry.second.ToString(), entry.first.first.ToString(), entry.first.second);
+            block.setFailed.insert(entry.second);
+        }
+    }
+}
+
+// The area of the block reserved to free txs is filled by priority. Priority grows with the height,
+// so it cannot be indexed: this step visits the whole pool once, while with -blockprioritysize=0 the
+// template is assembled only from the indexes.
+static void AddPriorityTxsToBlock(CBlockAssembly& block, unsigned int nBlockPrioritySize)
+{
+    typedef std::pair<double, uint256> TxByPriority;
+    std::vector<TxByPriority> vecPriority;
+    for (const auto& entry: mempool.mapTx)
+    {
+        std::map<uint256, std::set<uint256> >::const_iterator itDeps = mempool.mapDependencies.find(entry.first);
+        if (itDeps == mempool.mapDependencies.end() ||
+            std::includes(block.setInBlock.begin(), block.setInBlock.end(), itDeps->second.begin(), itDeps->second.end()))
+        {
+            if (!block.setInBlock.count(entry.first) && !block.setFailed.count(entry.first))
+                vecPriority.push_back(TxByPriority(GetModifiedPriority(entry.first, block.nHeight), entry.first));
+        }
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end());
+
+    while (!vecPriority.empty())
+    {
+        // Take highest priority transaction off the priority queue:
+        double dPriority = vecPriority.front().first;
+        uint256 hash = vecPriority.front().second;
+        std::pop_heap(vecPriority.begin(), vecPriority.end());
+        vecPriority.pop_back();
+
+        // Prioritise by fee once past the priority size or we run out of high-priority
+        // transactions:
+        const CTransaction& tx = mempool.mapTx.at(hash).GetTx();
+        unsigned int nTxSize = mempool.mapTx.at(hash).GetTxSize();
+        if (block.nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(dPriority))
+            break;
+
+        if (!IsFinalTx(tx, block.nHeight, block.nLockTimeCutoff))
+        {
+            block.setFailed.insert(hash);
             continue;
         }
 
-        if (!VerifyForwardTransfersDependencies(tx, view, vOrphan, mapDependers, porphan) )
+        CAmount nTxFees = 0;
+        if (!AddToBlockIfValid(tx, block, nTxFees))
         {
-            if (porphan)
-                vOrphan.pop_back();
+            block.setFailed.insert(hash);
             continue;
         }
+        UpdatePackagesForAddedTx(hash, block);
 
-        const CMemPoolEntry& mpEntry = mi->second;
-        if (!AddTxToPriorities(tx, view, nTotalIn, nHeight, mpEntry, vecPriority, porphan) )
+        if (block.fPrintPriority)
         {
-            if (porphan)
-                vOrphan.pop_back();
+            LogPrintf("priority %.1f fee %d txid %s\n",
+                dPriority, nTxFees, hash.ToString());
+        }
+
+        // Add transactions that depend on this one to the priority queue
+        std::map<uint256, std::set<uint256> >::const_iterator itDependents = mempool.mapDependents.find(hash);
+        if (itDependents == mempool.mapDependents.end())
             continue;
+        for (const uint256& childHash: itDependents->second)
+        {
+            if (!mempool.mapTx.count(childHash) || block.setInBlock.count(childHash))
+                continue;
+            const std::set<uint256>& setDependsOn = mempool.mapDependencies.at(childHash);
+            if (std::includes(block.setInBlock.begin(), block.setInBlock.end(), setDependsOn.begin(), setDependsOn.end()))
+            {
+                vecPriority.push_back(TxByPriority(GetModifiedPriority(childHash, block.nHeight), childHash));
+                std::push_heap(vecPriority.begin(), vecPriority.end());
+            }
+        }
+    }
+}
+
+static std::set<std::pair<CFeeRate, uint256> >::const_reverse_iterator GetBestModified(const CBlockAssembly& block)
+{
+    std::set<std::pair<CFeeRate, uint256> >::const_reverse_iterator it = block.setModified.rbegin();
+    while (it != block.setModified.rend() && block.setFailed.count(it->second))
+        ++it;
+    return it;
+}
+
+// The best package is the one with the highest ancestor fee rate, either straight from the mempool
+// index or, for the txs whose ancestors are partly in the block already, from the modified ones.
+// Packages paying the same fee rate are taken by priority.
+static void AddTxPackagesToBlock(CBlockAssembly& block, unsigned int nBlockMinSize)
+{
+    // Limit the number of attempts to add packages to the block when it is close to full
+    static const int MAX_CONSECUTIVE_FAILURES = 1000;
+    int nConsecutiveFailed = 0;
+
+    typedef std::set<std::pair<CFeeRate, uint256> >::const_reverse_iterator FeeRateIterator;
+    FeeRateIterator itIndex = mempool.setTxByAncestorFeeRate.rbegin();
+
+    while (true)
+    {
+        // entries of the index that are in the block, failed, or superseded by a modified package
+        while (itIndex != mempool.setTxByAncestorFeeRate.rend() &&
+               (block.setInBlock.count(itIndex->second) || block.setFailed.count(itIndex->second) ||
+                block.mapModified.count(itIndex->second)))
+            ++itIndex;
+
+        FeeRateIterator itModified = GetBestModified(block);
+
+        if (itIndex == mempool.setTxByAncestorFeeRate.rend() && itModified == block.setModified.rend())
+            break;
+
+        CFeeRate feeRate;
+        if (itIndex == mempool.setTxByAncestorFeeRate.rend())
+            feeRate = itModified->first;
+        else if (itModified == block.setModified.rend())
+            feeRate = itIndex->first;
+        else
+            feeRate = std::max(itIndex->first, itModified->first);
+
+        // Skip free transactions if we're past the minimum block size: the rest pays even less
+        if (feeRate < ::minRelayTxFee && block.nBlockSize >= nBlockMinSize)
+            break;
+
+        typedef std::pair<double, uint256> TxByPriority;
+        std::vector<TxByPriority> vecTies;
+        for (FeeRateIterator it = itIndex; it != mempool.setTxByAncestorFeeRate.rend() && it->first == feeRate; ++it)
+        {
+            if (!block.setInBlock.count(it->second) && !block.setFailed.count(it->second) && !block.mapModified.count(it->second))
+                vecTies.push_back(TxByPriority(GetModifiedPriority(it->second, block.nHeight), it->second));
+        }
+        for (FeeRateIterator it = itModified; it != block.setModified.rend() && it->first == feeRate; ++it)
+        {
+            if (!block.setFailed.count(it->second))
+                vecTies.push_back(TxByPriority(GetModifiedPriority(it->second, block.nHeight), it->second));
+        }
+        std::sort(vecTies.rbegin(), vecTies.rend());
+
+        for (const TxByPriority& candidate: vecTies)
+        {
+            const uint256& hash = candidate.second;
+            if (block.setInBlock.count(hash) || block.setFailed.count(hash))
+                continue;
+
+            // including a package may have changed the packages of its descendants
+            CTxMemPoolAncestorState state = GetPackageState(hash, block);
+            if (!(state.GetFeeRate() == feeRate))
+                continue;
+            FeeRateIterator itBest = GetBestModified(block);
+            if (itBest != block.setModified.rend() && feeRate < itBest->first)
+                break;
+
+            if (block.nBlockSize + state.nSizeWithAncestors >= block.nBlockMaxSize)
+            {
+                block.setFailed.insert(hash);
+                if (block.nBlockSize > block.nBlockMaxSize - 4000 && ++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES)
+                    return;
+                continue;
+            }
+
+            if (!AddPackageToBlock(hash, block, feeRate))
+            {
+                block.setFailed.insert(hash);
+                continue;
+            }
+            nConsecutiveFailed = 0;
         }
     }
 }
@@ -436,6 +813,107 @@ void GetBlockTxPriorityDataOld(const CBlock *pblock, int nHeight, int64_t nMedia
     }
 }
 
+// DEPRECATED. Assembly of the block by the priority, or fee rate, of every single object, with the
+// certificates competing with the transactions.
+static void AddToBlockDeprecated(CBlockAssembly& block, int64_t nMedianTimePast, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize)
+{
+    // Priority order to process transactions
+    list<COrphan> vOrphan; // list memory doesn't move
+    map<uint256, vector<COrphan*> > mapDependers;
+
+    // This vector will be sorted into a priority queue:
+    vector<TxPriority> vecPriority;
+    vecPriority.reserve(mempool.size()); // both tx and cert
+
+    GetBlockTxPriorityDataOld(block.pblock, block.nHeight, nMedianTimePast, block.view, vecPriority, vOrphan, mapDependers);
+    GetBlockCertPriorityData(block.pblock, block.nHeight, block.view, vecPriority, vOrphan, mapDependers);
+
+    bool fSortedByFee = (nBlockPrioritySize <= 0);
+
+    TxPriorityCompare comparer(fSortedByFee);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    while (!vecPriority.empty())
+    {
+        // Take highest priority transaction off the priority queue:
+        double dPriority = vecPriority.front().get<0>();
+        CFeeRate feeRate = vecPriority.front().get<1>();
+        const CTransactionBase& tx = *(vecPriority.front().get<2>());
+
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        // Size limits
+        unsigned int nTxSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+        if (block.nBlockSize + nTxSize >= block.nBlockMaxSize)
+            continue;
+
+        // Legacy limits on sigOps:
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        if (block.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            continue;
+
+        const uint256& hash = tx.GetHash();
+
+        // Skip free transactions / certificates if we're past the minimum block size:
+        double dPriorityDelta = 0;
+        CAmount nFeeDelta = 0;
+        mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
+        if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (block.nBlockSize + nTxSize >= nBlockMinSize))
+        {
+            LogPrint("sc", "%s():%d - Skipping [%s] because it is free (feeDelta=%lld/feeRate=%s, blsz=%u/txsz=%u/blminsz=%u)\n",
+                __func__, __LINE__, tx.GetHash().ToString(), nFeeDelta, feeRate.ToString(), block.nBlockSize, nTxSize, nBlockMinSize );
+            continue;
+        }
+
+        // Prioritise by fee once past the priority size or we run out of high-priority
+        // transactions:
+        if (!fSortedByFee &&
+            ((block.nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
+        {
+            fSortedByFee = true;
+            comparer = TxPriorityCompare(fSortedByFee);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        }
+
+        CAmount nTxFees = 0;
+        if (!AddToBlockIfValid(tx, block, nTxFees))
+            continue;
+
+        if (block.fPrintPriority)
+        {
+            LogPrintf("priority %.1f fee %d feeRate %s txid %s\n",
+                dPriority, nTxFees, feeRate.ToString(), tx.GetHash().ToString());
+        }
+
+        // Add transactions that depend on this one to the priority queue
+        if (mapDependers.count(hash))
+        {
+            LogPrint("sc", "%s():%d - tx[%s] has %d orphans\n",
+                __func__, __LINE__, hash.ToString(), mapDependers[hash].size());
+            BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
+            {
+                if (!porphan->setDependsOn.empty())
+                {
+                    porphan->setDependsOn.erase(hash);
+                    LogPrint("sc", "%s():%d - erasing tx[%s] frim orphan %p\n", __func__, __LINE__, hash.ToString(), porphan);
+                    if (porphan->setDependsOn.empty())
+                    {
+                        LogPrint("sc", "%s():%d - tx[%s] resolved all dependencies, adding to prio vec\n",
+                            __func__, __LINE__, porphan->ptx->GetHash().ToString());
+                        vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
+                        std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                    }
+                }
+                else
+                {
+                    LogPrint("sc", "%s():%d - tx[%s] orphan %p empty\n", __func__, __LINE__, hash.ToString(), porphan);
+                }
+            }
+        }
+    }
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn)
 {
     // Block complexity is a sum of block transactions complexity. Transaction complexisty equals to number of inputs squared.
@@ -478,8 +956,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
     unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
-    int nBlockComplexity = 0;
-
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
     {
@@ -498,192 +974,32 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn,  unsigned int nBlo
 
         CCoinsViewCache view(pcoinsTip);
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
         bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.size()); // both tx and cert
-
         bool fDeprecatedGetBlockTemplate = GetBoolArg("-deprecatedgetblocktemplate", false);
-        if (fDeprecatedGetBlockTemplate)
-            GetBlockTxPriorityDataOld(pblock, nHeight, nMedianTimePast, view, vecPriority, vOrphan, mapDependers);
-        else
-            GetBlockTxPriorityData(pblock, nHeight, nMedianTimePast, view, vecPriority, vOrphan, mapDependers);
 
-        GetBlockCertPriorityData(pblock, nHeight, view, vecPriority, vOrphan, mapDependers);
+        int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                ? nMedianTimePast
+                : pblock->GetBlockTime();
 
         // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-#if 0
-        for (auto entry : vecPriority)
+        CBlockAssembly assembly(pblocktemplate.get(), view, nHeight, nLockTimeCutoff, nBlockMaxSize,
+                                fDeprecatedGetBlockTemplate ? 0 : nBlockMaxComplexitySize, fPrintPriority);
+        if (fDeprecatedGetBlockTemplate)
         {
-            LogPrint("sc", "%s():%d - tx[%s] prio[%f], feerate[%s]\n",
-                __func__, __LINE__, (entry.get<2>())->GetHash().ToString(), entry.get<0>(), entry.get<1>().ToString());
+            AddToBlockDeprecated(assembly, nMedianTimePast, nBlockPrioritySize, nBlockMinSize);
         }
-#endif
-
-        // considering certs having a higher priority than any possible tx.
-        // An algorithm for managing tx/cert priorities could be devised
-        while (!vecPriority.empty())
-        {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransactionBase& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = tx.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            const uint256& hash = tx.GetHash();
-
-            // Skip free transactions / certificates if we're past the minimum block size:
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-            {
-                LogPrint("sc", "%s():%d - Skipping [%s] because it is free (feeDelta=%lld/feeRate=%s, blsz=%u/txsz=%u/blminsz=%u)\n",
-                    __func__, __LINE__, tx.GetHash().ToString(), nFeeDelta, feeRate.ToString(), nBlockSize, nTxSize, nBlockMinSize );
-                continue;
-            }
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
-            {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            // Skip transaction if max block complexity reached.
-            int nTxComplexity = tx.GetVin().size() * tx.GetVin().size();
-            if (!fDeprecatedGetBlockTemplate && nBlockMaxComplexitySize > 0 && nBlockComplexity + nTxComplexity >= nBlockMaxComplexitySize)
-                continue;
-
-            if (!view.HaveInputs(tx))
-            {
-                LogPrint("sc", "%s():%d - Skipping [%s] because it has no inputs\n",
-                    __func__, __LINE__, tx.GetHash().ToString() );
-                continue;
-            }
-
-            CAmount nTxFees = tx.GetFeeAmount(view.GetValueIn(tx));
-#if 0
-            if (nTxFees < 0) {
-                LogPrintf("%s():%d - tx=%s has a negative fee (fee=%s)\n",
-                    __func__, __LINE__, tx.GetHash().ToString(), FormatMoney(nTxFees));
-                continue;
-            }
-#endif
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-            {
-                LogPrint("sc", "%s():%d - Skipping [%s] because too many sigops in block\n",
-                    __func__, __LINE__, tx.GetHash().ToString() );
-                continue;
-            }
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!tx.ContextualCheckInputs(state, view, true, chainActive, MANDATORY_SCRIPT_VERIFY_FLAGS | SCRIPT_VERIFY_CHECKBLOCKATHEIGHT, true, Params().GetConsensus()))
-                continue;
-
-            CTxUndo dummyUndo;
-            try {
-                if (tx.IsCertificate())
-                    UpdateCoins(dynamic_cast<const CScCertificate&>(tx), view, dummyUndo, nHeight);
-                else
-                    UpdateCoins(dynamic_cast<const CTransaction&>(tx), view, dummyUndo, nHeight);
-            } catch (...) {
-                LogPrintf("%s():%d - ERROR: tx [%s] cast error\n",
-                    __func__, __LINE__, hash.ToString());
-                assert("could not cast txbase obj" == 0);
-            }
-
-
-            // Added
-#if 0
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-#else
-            tx.AddToBlock(pblock);
-            tx.AddToBlockTemplate(pblocktemplate.get(), nTxFees, nTxSigOps);
-#endif
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-            nBlockComplexity += nTxComplexity;
-
-            if (fPrintPriority)
-            {
-                LogPrintf("priority %.1f fee %d feeRate %s txid %s\n",
-                    dPriority, nTxFees, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash))
-            {
-                LogPrint("sc", "%s():%d - tx[%s] has %d orphans\n",
-                    __func__, __LINE__, hash.ToString(), mapDependers[hash].size());
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
-                {
-                    if (!porphan->setDependsOn.empty())
-                    {
-                        porphan->setDependsOn.erase(hash);
-                        LogPrint("sc", "%s():%d - erasing tx[%s] frim orphan %p\n", __func__, __LINE__, hash.ToString(), porphan);
-                        if (porphan->setDependsOn.empty())
-                        {
-                            LogPrint("sc", "%s():%d - tx[%s] resolved all dependencies, adding to prio vec\n",
-                                __func__, __LINE__, porphan->ptx->GetHash().ToString());
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-#if 0
-        for (auto entry : vecPriority)
+        else
         {
-            LogPrint("sc", "%s():%d - tx[%s] prio[%20.6f], feerate[%12s]\n",
-                __func__, __LINE__, (entry.get<2>())->GetHash().ToString(), entry.get<0>(), entry.get<1>().ToString());
-        }
-#endif
-                        }
-                    }
-                    else
-                    {
-                        LogPrint("sc", "%s():%d - tx[%s] orphan %p empty\n", __func__, __LINE__, hash.ToString(), porphan);
-                    }
-                }
-            }
+            AddCertificatesToBlock(assembly);
+            if (nBlockPrioritySize > 0)
+                AddPriorityTxsToBlock(assembly, nBlockPrioritySize);
+            AddTxPackagesToBlock(assembly, nBlockMinSize);
         }
+        nFees = assembly.nFees;
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u, tx/certs fee=%d\n", nBlockSize, nFees);
+        nLastBlockTx = assembly.nBlockTx;
+        nLastBlockSize = assembly.nBlockSize;
+        LogPrintf("CreateNewBlock(): total size %u, tx/certs fee=%d\n", nLastBlockSize, nFees);
 
         // Create coinbase tx
         CMutableTransaction txNew;
@@ -63,6 +63,14 @@ using namespace std;
 namespace {
     const int MAX_OUTBOUND_CONNECTIONS = 8;
 
+#ifdef USE_EPOLL
+    // epoll user data of the wakeup pipe and of the listening sockets, which
+    // count down from EPOLL_LISTEN_TAG; node sockets carry their NodeId
+    const uint64_t EPOLL_WAKEUP_TAG = std::numeric_limits<uint64_t>::max();
+    const uint64_t EPOLL_LISTEN_TAG = EPOLL_WAKEUP_TAG - 1;
+    const int EPOLL_MAX_EVENTS = 1024;
+#endif
+
     struct ListenSocket {
         SOCKET socket;
         bool whitelisted;
@@ -107,7 +115,28 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
-boost::condition_variable messageHandlerCondition;
+
+CCriticalSection cs_messageProcessing;
+
+// Wakes a ThreadMessageHandler. The flag keeps a notification that arrives while
+// the handler is busy with a pass from being lost.
+struct CMessageHandlerWakeup
+{
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fWake;
+
+    CMessageHandlerWakeup() : fWake(false) {}
+};
+static CMessageHandlerWakeup messageHandlerWakeup[MAX_MESSAGE_HANDLER_THREADS];
+static int nMessageHandlerThreads = 1;
+
+#ifndef WIN32
+// Self-pipe interrupting the socket handler's epoll_wait()/select(). A byte is
+// only written when no wakeup is pending yet.
+static int hSocketWakeupPipe[2] = { -1, -1 };
+static std::atomic<bool> fSocketWakePending(false);
+#endif
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -724,7 +753,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            WakeMessageHandler(id);
         }
     }
 
@@ -790,6 +819,8 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 void SocketSendData(CNode *pnode)
 {
     std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    // readiness events arriving after this point make the socket writable again
+    const unsigned int nSendSeq = pnode->nSendReadySeq.load();
 
     while (it != pnode->vSendMsg.end())
     {
@@ -837,6 +868,7 @@ void SocketSendData(CNode *pnode)
             else
             {
                 // could not send full message; stop sending more
+                pnode->nSendBlockedSeq = nSendSeq;
                 break;
             }
         }
@@ -855,14 +887,28 @@ void SocketSendData(CNode *pnode)
                     }
                     else
                     {
+#ifdef USE_EPOLL
+                        if (nRet == SSL_ERROR_WANT_WRITE) {
+                            pnode->nSendBlockedSeq = nSendSeq;
+                        } else {
+                            // preventive measure from exhausting CPU usage
+                            //
+                            MilliSleep(1);    // 1 msec
+                        }
+#else
+                        if (nRet == SSL_ERROR_WANT_WRITE)
+                            pnode->nSendBlockedSeq = nSendSeq;
                         // preventive measure from exhausting CPU usage
                         //
                         MilliSleep(1);    // 1 msec
+#endif
                     }
                 }
                 else
                 {
-                    if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS)
+                    if (nRet == WSAEWOULDBLOCK)
+                        pnode->nSendBlockedSeq = nSendSeq;
+                    else if (nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS)
                     {
                         LogPrintf("ERROR: send %s; closing connection\n", NetworkErrorString(nRet));
                         pnode->CloseSocketDisconnect();
@@ -883,6 +929,52 @@ void SocketSendData(CNode *pnode)
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
 }
 
+void WakeMessageHandler(NodeId nodeid)
+{
+    CMessageHandlerWakeup& wakeup = messageHandlerWakeup[nodeid % nMessageHandlerThreads];
+    {
+        boost::lock_guard<boost::mutex> lock(wakeup.mutex);
+        wakeup.fWake = true;
+    }
+    wakeup.cond.notify_one();
+}
+
+void WakeSocketHandler()
+{
+#ifndef WIN32
+    // read the descriptor once, it is reset to -1 when the pipe is closed at shutdown
+    const int hWakeup = hSocketWakeupPipe[1];
+    if (hWakeup != -1 && !fSocketWakePending.exchange(true)) {
+        char c = 0;
+        // a full pipe already guarantees a wakeup
+        if (write(hWakeup, &c, 1) != 1)
+            return;
+    }
+#endif
+}
+
+#ifndef WIN32
+static bool InitSocketWakeup()
+{
+    if (pipe(hSocketWakeupPipe) != 0)
+        return false;
+    for (int i = 0; i < 2; i++) {
+        fcntl(hSocketWakeupPipe[i], F_SETFD, FD_CLOEXEC);
+        fcntl(hSocketWakeupPipe[i], F_SETFL, fcntl(hSocketWakeupPipe[i], F_GETFL, 0) | O_NONBLOCK);
+    }
+    return true;
+}
+
+// Called right after the wait returns and before any socket is serviced, so a
+// wakeup that races with clearing the flag is still acted upon in this pass.
+static void DrainSocketWakeup()
+{
+    char buf[64];
+    while (read(hSocketWakeupPipe[0], buf, sizeof(buf)) > 0) {}
+    fSocketWakePending = false;
+}
+#endif
+
 static list<CNode*> vNodesDisconnected;
 
 class CNodeRef {
@@ -1188,9 +1280,78 @@ void ThreadNonTLSPoolsCleaner()
 #endif // USE_TLS && COMPAT_NON_TLS
 
 
+/**
+ * Decide which directions to service for a node:
+ * * If there is data to send, wait for sending data. As this only
+ *   happens when optimistic write failed, we choose to first drain the
+ *   write buffer in this case before receiving more. This avoids
+ *   needlessly queueing received data, if the remote peer is not themselves
+ *   receiving data. This means properly utilizing TCP flow control signalling.
+ * * Otherwise, if there is no (complete) message in the receive buffer,
+ *   or there is space left in the buffer, wait for receiving data.
+ * * (if neither of the above applies, there is certainly one message
+ *   in the receiver buffer ready to be processed).
+ * Together, that means that at least one of the following is always possible,
+ * so we don't deadlock:
+ * * We send some data.
+ * * We wait for data to be received (and disconnect after timeout).
+ * * We process a message in the buffer (message handler thread).
+ */
+static void GetSocketInterest(CNode* pnode, bool& fWantRecv, bool& fWantSend)
+{
+    fWantRecv = fWantSend = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fWantSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv && (
+            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+            fWantRecv = true;
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+#ifdef USE_EPOLL
+    // Node sockets are registered once, edge-triggered, and their readiness is
+    // latched in CNode until a recv or send runs into EAGAIN. Listening sockets
+    // stay level-triggered so that one accept per iteration is enough.
+    int hEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (hEpoll == -1)
+    {
+        LogPrintf("ThreadSocketHandler: epoll_create1 failed: %s\n", NetworkErrorString(errno));
+        return;
+    }
+    struct EpollCloser {
+        int fd;
+        ~EpollCloser() { close(fd); }
+    } epollCloser = { hEpoll };
+
+    for (size_t i = 0; i < vhListenSocket.size(); i++)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = EPOLL_LISTEN_TAG - i;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) == -1)
+            LogPrintf("ThreadSocketHandler: cannot watch listening socket: %s\n", NetworkErrorString(errno));
+    }
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = EPOLL_WAKEUP_TAG;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hSocketWakeupPipe[0], &event) == -1)
+            LogPrintf("ThreadSocketHandler: cannot watch wakeup pipe: %s\n", NetworkErrorString(errno));
+    }
+    vector<struct epoll_event> vEvents(EPOLL_MAX_EVENTS);
+    bool fMoreWork = false;
+#endif
     while (true)
     {
         //
@@ -1259,6 +1420,34 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
+        vector<bool> vListenReady(vhListenSocket.size(), false);
+#ifdef USE_EPOLL
+        int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), fMoreWork ? 0 : 50);
+        boost::this_thread::interruption_point();
+
+        if (nEvents == -1)
+        {
+            int nErr = errno;
+            if (nErr != EINTR)
+            {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+                MilliSleep(50);
+            }
+            nEvents = 0;
+        }
+
+        std::map<NodeId, uint32_t> mapNodeEvents;
+        for (int i = 0; i < nEvents; i++)
+        {
+            uint64_t nTag = vEvents[i].data.u64;
+            if (nTag == EPOLL_WAKEUP_TAG)
+                DrainSocketWakeup();
+            else if (nTag > EPOLL_LISTEN_TAG - vhListenSocket.size())
+                vListenReady[EPOLL_LISTEN_TAG - nTag] = true;
+            else
+                mapNodeEvents[(NodeId)nTag] |= vEvents[i].events;
+        }
+#else
         struct timeval timeout;
         timeout.tv_sec  = 0;
         timeout.tv_usec = 50000; // frequency to poll pnode->vSend
@@ -1277,6 +1466,11 @@ void ThreadSocketHandler()
             hSocketMax = max(hSocketMax, hListenSocket.socket);
             have_fds = true;
         }
+#ifndef WIN32
+        FD_SET(hSocketWakeupPipe[0], &fdsetRecv);
+        hSocketMax = max(hSocketMax, (SOCKET)hSocketWakeupPipe[0]);
+        have_fds = true;
+#endif
 
         {
             LOCK(cs_vNodes);
@@ -1291,36 +1485,12 @@ void ThreadSocketHandler()
                 hSocketMax = max(hSocketMax, pnode->hSocket);
                 have_fds = true;
 
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+                bool fWantRecv, fWantSend;
+                GetSocketInterest(pnode, fWantRecv, fWantSend);
+                if (fWantSend)
+                    FD_SET(pnode->hSocket, &fdsetSend);
+                if (fWantRecv)
+                    FD_SET(pnode->hSocket, &fdsetRecv);
             }
         }
 
@@ -1342,14 +1512,22 @@ void ThreadSocketHandler()
             MilliSleep(timeout.tv_usec/1000);
         }
 
+#ifndef WIN32
+        if (FD_ISSET(hSocketWakeupPipe[0], &fdsetRecv))
+            DrainSocketWakeup();
+#endif
+        for (size_t i = 0; i < vhListenSocket.size(); i++)
+            vListenReady[i] = FD_ISSET(vhListenSocket[i].socket, &fdsetRecv);
+#endif
+
         //
         // Accept new connections
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        for (size_t i = 0; i < vhListenSocket.size(); i++)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (vhListenSocket[i].socket != INVALID_SOCKET && vListenReady[i])
             {
-                AcceptConnection(hListenSocket);
+                AcceptConnection(vhListenSocket[i]);
             }
         }
 
@@ -1363,14 +1541,73 @@ void ThreadSocketHandler()
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
+#ifdef USE_EPOLL
+        fMoreWork = false;
+#endif
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             boost::this_thread::interruption_point();
 
-            if (tlsmanager.threadSocketHandler(pnode,fdsetRecv,fdsetSend,fdsetError)==-1){
+            bool fRecv = false, fSend = false;
+#ifdef USE_EPOLL
+            std::map<NodeId, uint32_t>::const_iterator itEvents = mapNodeEvents.find(pnode->id);
+            if (itEvents != mapNodeEvents.end())
+            {
+                if (itEvents->second & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    pnode->fRecvReady = true;
+                if (itEvents->second & EPOLLOUT)
+                    pnode->nSendReadySeq++;
+            }
+            {
+                LOCK(pnode->cs_hSocket);
+                if (pnode->hSocket != INVALID_SOCKET && !pnode->fPollRegistered)
+                {
+                    // The closed socket of a previous node may linger in the
+                    // interest list under the same descriptor, so fall back to
+                    // rebinding it to this node.
+                    struct epoll_event event;
+                    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    event.data.u64 = (uint64_t)pnode->id;
+                    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1 &&
+                        (errno != EEXIST || epoll_ctl(hEpoll, EPOLL_CTL_MOD, pnode->hSocket, &event) == -1))
+                    {
+                        LogPrintf("socket epoll registration failed for peer=%d: %s\n", pnode->id, NetworkErrorString(errno));
+                        pnode->fDisconnect = true;
+                    }
+                    pnode->fPollRegistered = true;
+                }
+            }
+            bool fWantRecv, fWantSend;
+            GetSocketInterest(pnode, fWantRecv, fWantSend);
+            fRecv = fWantRecv && pnode->fRecvReady;
+            fSend = fWantSend && pnode->IsSendReady();
+#else
+            {
+                LOCK(pnode->cs_hSocket);
+                if (pnode->hSocket != INVALID_SOCKET)
+                {
+                    fRecv = FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError);
+                    fSend = FD_ISSET(pnode->hSocket, &fdsetSend);
+                }
+            }
+#endif
+
+#ifdef USE_EPOLL
+            uint64_t nRecvBytesBefore = pnode->nRecvBytes;
+            uint64_t nSendBytesBefore = pnode->nSendBytes;
+#endif
+            if (tlsmanager.threadSocketHandler(pnode, fRecv, fSend) == -1){
                 continue;
             }
 
+#ifdef USE_EPOLL
+            // Edges are only reported once, so keep polling without a timeout
+            // while a serviced socket makes progress and has not run into EAGAIN
+            if ((fRecv && pnode->fRecvReady && pnode->nRecvBytes != nRecvBytesBefore) ||
+                (fSend && pnode->IsSendReady() && pnode->nSendBytes != nSendBytesBefore))
+                fMoreWork = true;
+#endif
+
             //
             // Inactivity checking
             //
@@ -1715,28 +1952,37 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+// Each message handler thread serves the peers with NodeId % nMessageHandlerThreads == nThread,
+// so messages of a single peer are still processed in order
+void ThreadMessageHandler(int nThread)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
+    CMessageHandlerWakeup& wakeup = messageHandlerWakeup[nThread];
 
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
     {
+        // Wakeups from here on are covered by this pass or trigger the next one
+        {
+            boost::lock_guard<boost::mutex> lock(wakeup.mutex);
+            wakeup.fWake = false;
+        }
+
         vector<CNode*> vNodesCopy;
+        CNode* pnodeTrickle = NULL;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy) {
-                pnode->AddRef();
+            // Pick the trickle node among all peers, so that there is still one
+            // per pass regardless of the number of threads
+            if (!vNodes.empty())
+                pnodeTrickle = vNodes[GetRand(vNodes.size())];
+            BOOST_FOREACH(CNode* pnode, vNodes) {
+                if (pnode->id % nMessageHandlerThreads == nThread) {
+                    vNodesCopy.push_back(pnode);
+                    pnode->AddRef();
+                }
             }
         }
 
-        // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
-
         bool fSleep = true;
 
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
@@ -1749,9 +1995,15 @@ void ThreadMessageHandler()
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
                 {
+                    bool fFlooded = pnode->GetTotalRecvSize() > ReceiveFloodSize();
+
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
 
+                    // the socket handler stopped reading from this peer, resume it now
+                    if (fFlooded && pnode->GetTotalRecvSize() <= ReceiveFloodSize())
+                        WakeSocketHandler();
+
                     if (pnode->nSendSize < SendBufferSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
@@ -1765,6 +2017,7 @@ void ThreadMessageHandler()
 
             // Send messages
             {
+                LOCK(cs_messageProcessing);
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle || pnode->fWhitelisted);
@@ -1779,7 +2032,11 @@ void ThreadMessageHandler()
         }
 
         if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        {
+            boost::unique_lock<boost::mutex> lock(wakeup.mutex);
+            wakeup.cond.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100),
+                                   [&wakeup] { return wakeup.fWake; });
+        }
     }
 }
 
@@ -1995,6 +2252,17 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     else
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "dnsseed", &ThreadDNSAddressSeed));
 
+#ifndef WIN32
+    if (!InitSocketWakeup())
+    {
+        LogPrintf("%s: ERROR: cannot create socket handler wakeup pipe: %s. Node can't be started.\n", __func__, NetworkErrorString(errno));
+        return;
+    }
+#endif
+
+    // before any thread may call WakeMessageHandler
+    nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MESSAGE_HANDLER_THREADS), MAX_MESSAGE_HANDLER_THREADS));
+
     // Send and receive from sockets, accept connections
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
@@ -2005,7 +2273,8 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 
 #if defined(USE_TLS) && defined(COMPAT_NON_TLS)
     // Clean pools of addresses for non-TLS connections
@@ -2055,6 +2324,16 @@ public:
         vNodes.clear();
         vNodesDisconnected.clear();
         vhListenSocket.clear();
+#ifndef WIN32
+        // forget the descriptors before closing them, so that a late WakeSocketHandler() does not
+        // write to a number the OS has handed out again
+        for (int i = 0; i < 2; i++) {
+            const int hPipe = hSocketWakeupPipe[i];
+            hSocketWakeupPipe[i] = -1;
+            if (hPipe != -1)
+                close(hPipe);
+        }
+#endif
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -2292,6 +2571,10 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     ssl = sslIn;
     nServices = 0;
     hSocket = hSocketIn;
+    fPollRegistered = false;
+    fRecvReady = true;
+    nSendReadySeq = 1;
+    nSendBlockedSeq = 0;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2454,8 +2737,15 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
-    if (it == vSendMsg.begin())
+    if (it == vSendMsg.begin()) {
         SocketSendData(this);
+#ifndef USE_EPOLL
+        // select() only watches for writability of sockets with queued data,
+        // which this one did not have when the current wait started
+        if (!vSendMsg.empty())
+            WakeSocketHandler();
+#endif
+    }
 
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
@@ -19,6 +19,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -63,6 +64,10 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** The default number of message handler threads, peers are spread over them by NodeId */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** The maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -80,6 +85,8 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Interrupt ThreadSocketHandler's wait for socket events */
+void WakeSocketHandler();
 SSL_CTX* create_context(bool server_side);
 EVP_PKEY *generate_key();
 X509 *generate_x509(EVP_PKEY *pkey);
@@ -96,6 +103,9 @@ static std::string validationdescription;
 
 typedef int NodeId;
 
+/** Make the message handler thread serving this peer run another pass without waiting for its timeout */
+void WakeMessageHandler(NodeId nodeid);
+
 struct CombinerAll
 {
     typedef bool result_type;
@@ -162,6 +172,8 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
+/** Serializes SendMessages and all messages not handled concurrently by ProcessMessages */
+extern CCriticalSection cs_messageProcessing;
 extern std::map<CInv, CDataStream> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
@@ -272,6 +284,16 @@ public:
     std::deque<CSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
 
+    // Socket readiness for the edge-triggered event loop in ThreadSocketHandler.
+    // fRecvReady is only touched by the socket handler thread. SocketSendData
+    // also runs from the message handler thread, so send readiness is kept as
+    // a pair of sequence numbers: the socket is writable unless the last
+    // blocked send happened after the last EPOLLOUT event.
+    bool fPollRegistered;
+    bool fRecvReady;
+    std::atomic<unsigned int> nSendReadySeq;
+    std::atomic<unsigned int> nSendBlockedSeq;
+
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
@@ -357,6 +379,11 @@ public:
     CNode(SOCKET hSocketIn, const CAddress &addrIn, const std::string &addrNameIn = "", bool fInboundIn = false, SSL *sslIn = NULL);
     ~CNode();
 
+    bool IsSendReady() const
+    {
+        return nSendReadySeq.load() != nSendBlockedSeq.load();
+    }
+
 private:
     // Network usage totals
     static CCriticalSection cs_totalBytesRecv;
@@ -447,6 +474,9 @@ public:
             if (!setInventoryKnown.count(inv))
                 vInventoryToSend.push_back(inv);
         }
+        // blocks are announced without trickling, don't let them wait for the next pass
+        if (inv.type == MSG_BLOCK)
+            WakeMessageHandler(id);
     }
 
     void AskFor(const CInv& inv);
@@ -203,6 +203,12 @@ std::string NetworkErrorString(int err);
 bool CloseSocket(SOCKET& hSocket);
 /** Disable or enable blocking-mode for a socket */
 bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
+/**
+ * Wait up to nTimeout milliseconds for a single socket to become readable
+ * (or writable if fWrite). Returns like select(): 1 if ready, 0 on timeout,
+ * SOCKET_ERROR on failure. Not limited to FD_SETSIZE outside of Windows.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout);
 /**
  * Convert milliseconds to a struct timeval for e.g. select.
  */
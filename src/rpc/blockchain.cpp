@@ -13,6 +13,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "util.h"
 #include "zen/delay.h"
 
@@ -24,6 +25,7 @@
 
 #include "sc/sidechain.h"
 #include "sc/sidechainrpc.h"
+#include "sc/asyncproofverifier.h"
 
 #include "validationinterface.h"
 
@@ -770,6 +772,13 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"commitments\": xxxxxx,    (numeric) the current number of note commitments in the commitment tree\n"
+            "  \"chainstateflush\": {      (object) background writes of the coins cache to the chainstate db\n"
+            "     \"flushes\": xx,         (numeric) number of writes committed since startup\n"
+            "     \"lastduration\": xx,    (numeric) duration of the last write in milliseconds\n"
+            "     \"lastbytes\": xx,       (numeric) approximate size in bytes of the last write\n"
+            "     \"totalbytes\": xx,      (numeric) approximate size in bytes of all the writes\n"
+            "     \"inflight\": xx,        (boolean) true if a write is in progress\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -805,6 +814,17 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     pcoinsTip->GetAnchorAt(pcoinsTip->GetBestAnchor(), tree);
     obj.push_back(Pair("commitments",           tree.size()));
 
+    if (pcoinsFlushBuffer) {
+        CCoinsFlushStats flushStats = pcoinsFlushBuffer->GetFlushStats();
+        UniValue chainstateFlush(UniValue::VOBJ);
+        chainstateFlush.push_back(Pair("flushes",      (uint64_t)flushStats.nFlushes));
+        chainstateFlush.push_back(Pair("lastduration", flushStats.nLastDurationMicros / 1000.0));
+        chainstateFlush.push_back(Pair("lastbytes",    (uint64_t)flushStats.nLastBytes));
+        chainstateFlush.push_back(Pair("totalbytes",   (uint64_t)flushStats.nTotalBytes));
+        chainstateFlush.push_back(Pair("inflight",     flushStats.fInFlight));
+        obj.push_back(Pair("chainstateflush",       chainstateFlush));
+    }
+
     CBlockIndex* tip = chainActive.Tip();
     UniValue valuePools(UniValue::VARR);
     valuePools.push_back(ValuePoolDesc("sprout", tip->nChainSproutValue, boost::none));
@@ -927,6 +947,13 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
+    ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
+    ret.push_back(Pair("evictedtxs", (int64_t) mempool.GetEvictedTxs()));
+    ret.push_back(Pair("evictedcerts", (int64_t) mempool.GetEvictedCerts()));
+    ret.push_back(Pair("expiredtxs", (int64_t) mempool.GetExpiredTxs()));
+    ret.push_back(Pair("pendingcertproofs", (int64_t) CScAsyncProofVerifier::getInstance().GetQueueDepth()));
 
     if (Params().NetworkIDString() == "regtest") {
         ret.push_back(Pair("fullyNotified", mempool.IsFullyNotified()));
@@ -946,6 +973,12 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"maxmempool\": xxxxx          (numeric) Maximum memory usage for the mempool\n"
+            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for a tx to be accepted after evictions\n"
+            "  \"evictedtxs\": xxxxx          (numeric) Transactions evicted to keep the mempool below maxmempool\n"
+            "  \"evictedcerts\": xxxxx        (numeric) Certificates evicted to keep the mempool below maxmempool\n"
+            "  \"expiredtxs\": xxxxx          (numeric) Transactions removed for staying longer than -mempoolexpiry\n"
+            "  \"pendingcertproofs\": xxxxx   (numeric) Relayed certificates waiting for their proof to be verified\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
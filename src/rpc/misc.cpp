@@ -466,3 +466,134 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
 
     return NullUniValue;
 }
+
+static UniValue LockProfileHistogram(const uint64_t* vHistogram)
+{
+    int nBuckets = CLockProfileStats::HISTOGRAM_BUCKETS;
+    while (nBuckets > 0 && vHistogram[nBuckets - 1] == 0)
+        nBuckets--;
+    UniValue histogram(UniValue::VARR);
+    for (int i = 0; i < nBuckets; i++)
+        histogram.push_back((uint64_t)vHistogram[i]);
+    return histogram;
+}
+
+static void LockProfileStatsToJSON(const CLockProfileStats& stats, bool fHistograms, UniValue& obj)
+{
+    obj.push_back(Pair("acquired",      (uint64_t)stats.nLocks));
+    obj.push_back(Pair("contended",     (uint64_t)stats.nContended));
+    obj.push_back(Pair("tryfailed",     (uint64_t)stats.nTryFailed));
+    obj.push_back(Pair("wait_total_us", stats.nWaitTotal / 1000));
+    obj.push_back(Pair("wait_max_us",   stats.nWaitMax / 1000));
+    obj.push_back(Pair("hold_total_us", stats.nHoldTotal / 1000));
+    obj.push_back(Pair("hold_max_us",   stats.nHoldMax / 1000));
+    if (fHistograms) {
+        obj.push_back(Pair("wait_histogram", LockProfileHistogram(stats.vWaitHistogram)));
+        obj.push_back(Pair("hold_histogram", LockProfileHistogram(stats.vHoldHistogram)));
+    }
+}
+
+static bool CompareLockProfileWait(const std::pair<std::string, CLockProfileStats>& a, const std::pair<std::string, CLockProfileStats>& b)
+{
+    return a.second.nWaitTotal > b.second.nWaitTotal;
+}
+
+static bool CompareLockProfileSiteWait(const CLockProfileSite& a, const CLockProfileSite& b)
+{
+    return a.stats.nWaitTotal > b.stats.nWaitTotal;
+}
+
+UniValue getlockprofile(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlockprofile ( reset )\n"
+            "\nReturns the lock contention statistics collected while lock profiling is enabled (see setlockprofiling).\n"
+            "Times are in microseconds. Entry 0 of a histogram counts times below one microsecond, entry i times of at\n"
+            "least 2^(i-1) and less than 2^i microseconds, and the last of the " + itostr(CLockProfileStats::HISTOGRAM_BUCKETS) + " entries all longer times.\n"
+            "Trailing empty entries are omitted.\n"
+            "\nArguments:\n"
+            "1. reset          (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,     (boolean) whether lock profiling is enabled\n"
+            "  \"locks\": [                 (array) totals per lock, by total wait time\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",         (string) the lock, e.g. cs_main\n"
+            "      \"acquired\": n,          (numeric) number of times the lock was taken\n"
+            "      \"contended\": n,         (numeric) how many of them had to wait for another thread\n"
+            "      \"tryfailed\": n,         (numeric) number of TRY_LOCK attempts that failed\n"
+            "      \"wait_total_us\": n,     (numeric) total time spent waiting for the lock\n"
+            "      \"wait_max_us\": n,       (numeric) longest wait for the lock\n"
+            "      \"hold_total_us\": n,     (numeric) total time the lock was held\n"
+            "      \"hold_max_us\": n        (numeric) longest time the lock was held at once\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"sites\": [                 (array) statistics per place the lock is taken, by total wait time\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",         (string) the lock\n"
+            "      \"location\": \"file:line\", (string) where the lock is taken\n"
+            "      ...                      same fields as above, plus\n"
+            "      \"wait_histogram\": [n, ...], (array) distribution of the wait times\n"
+            "      \"hold_histogram\": [n, ...]  (array) distribution of the hold times\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockprofile", "")
+            + HelpExampleCli("getlockprofile", "true")
+            + HelpExampleRpc("getlockprofile", "")
+        );
+
+    bool fReset = params.size() > 0 && params[0].get_bool();
+    std::vector<CLockProfileSite> vSites = GetLockProfile(fReset);
+
+    std::map<std::string, CLockProfileStats> mapLocks;
+    BOOST_FOREACH(const CLockProfileSite& site, vSites)
+        mapLocks[site.strName].Add(site.stats);
+
+    std::vector<std::pair<std::string, CLockProfileStats> > vLocks(mapLocks.begin(), mapLocks.end());
+    std::sort(vLocks.begin(), vLocks.end(), CompareLockProfileWait);
+    UniValue locks(UniValue::VARR);
+    for (size_t i = 0; i < vLocks.size(); i++) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", vLocks[i].first));
+        LockProfileStatsToJSON(vLocks[i].second, false, obj);
+        locks.push_back(obj);
+    }
+
+    std::sort(vSites.begin(), vSites.end(), CompareLockProfileSiteWait);
+    UniValue sites(UniValue::VARR);
+    BOOST_FOREACH(const CLockProfileSite& site, vSites) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", site.strName));
+        obj.push_back(Pair("location", strprintf("%s:%d", site.strFile, site.nLine)));
+        LockProfileStatsToJSON(site.stats, true, obj);
+        sites.push_back(obj);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("enabled", fLockProfiling.load()));
+    result.push_back(Pair("locks", locks));
+    result.push_back(Pair("sites", sites));
+    return result;
+}
+
+UniValue setlockprofiling(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "setlockprofiling enabled\n"
+            "\nStart or stop collecting lock contention statistics, see getlockprofile.\n"
+            "Statistics collected so far are kept until getlockprofile is called with reset.\n"
+            "\nArguments:\n"
+            "1. enabled        (boolean, required) true to start profiling, false to stop\n"
+            "\nExamples:\n"
+            + HelpExampleCli("setlockprofiling", "true")
+            + HelpExampleRpc("setlockprofiling", "true")
+        );
+
+    fLockProfiling = params[0].get_bool();
+    LogPrintf("Lock profiling %s\n", fLockProfiling ? "enabled" : "disabled");
+    return NullUniValue;
+}
@@ -265,6 +265,8 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "dbg_do",                 &dbg_do,                 true  },
     { "control",            "getscinfo",              &getscinfo,              true  },
     { "control",            "getscgenesisinfo",       &getscgenesisinfo,       true  },
+    { "control",            "getlockprofile",         &getlockprofile,         true  },
+    { "control",            "setlockprofiling",       &setlockprofiling,       true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
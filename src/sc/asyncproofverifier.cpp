@@ -0,0 +1,106 @@
+#include "sc/asyncproofverifier.h"
+
+#include "util.h"
+
+CScAsyncProofVerifier& CScAsyncProofVerifier::getInstance()
+{
+    static CScAsyncProofVerifier instance;
+    return instance;
+}
+
+void CScAsyncProofVerifier::SetCallback(const VerifiedCertCallback& callbackIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    callback = callbackIn;
+}
+
+bool CScAsyncProofVerifier::Enqueue(NodeId nodeId, const std::shared_ptr<const CScCertificate>& pCert,
+                                    const libzendoomc::CScCertProofCheck& check)
+{
+    const uint256& certHash = pCert->GetHash();
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (setPendingCerts.count(certHash))
+            return false;
+
+        std::deque<CJob>& peerQueue = mapPeerQueues[nodeId];
+        if (nQueued >= MAX_PENDING_CERT_PROOFS || peerQueue.size() >= MAX_PENDING_CERT_PROOFS_PER_PEER)
+        {
+            LogPrint("cert", "%s():%d - cert[%s] from peer=%d dropped: proof verification queue full (%d pending)\n",
+                __func__, __LINE__, certHash.ToString(), nodeId, nQueued);
+            if (peerQueue.empty())
+                mapPeerQueues.erase(nodeId);
+            return false;
+        }
+
+        peerQueue.push_back(CJob{nodeId, pCert, check});
+        setPendingCerts.insert(certHash);
+        ++nQueued;
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+bool CScAsyncProofVerifier::IsPending(const uint256& certHash)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return setPendingCerts.count(certHash) != 0;
+}
+
+size_t CScAsyncProofVerifier::GetQueueDepth()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nQueued + nInFlight;
+}
+
+bool CScAsyncProofVerifier::PopNextJob(CJob& job)
+{
+    if (mapPeerQueues.empty())
+        return false;
+
+    // serve the peer following the last served one, wrapping around
+    auto it = mapPeerQueues.upper_bound(nLastServedNode);
+    if (it == mapPeerQueues.end())
+        it = mapPeerQueues.begin();
+
+    job = it->second.front();
+    it->second.pop_front();
+    nLastServedNode = it->first;
+    if (it->second.empty())
+        mapPeerQueues.erase(it);
+
+    --nQueued;
+    return true;
+}
+
+void CScAsyncProofVerifier::ThreadVerify()
+{
+    RenameThread("horizen-certproof");
+
+    while (true)
+    {
+        CJob job;
+        VerifiedCertCallback verifiedCallback;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!PopNextJob(job))
+                condWorker.wait(lock); // interruption point
+            ++nInFlight;
+            verifiedCallback = callback;
+        }
+
+        bool fVerified = job.check();
+        LogPrint("cert", "%s():%d - cert[%s] from peer=%d: proof %s\n", __func__, __LINE__,
+            job.pCert->GetHash().ToString(), job.nodeId, fVerified ? "verified" : "NOT verified");
+
+        if (verifiedCallback)
+            verifiedCallback(job.nodeId, *job.pCert, fVerified);
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            setPendingCerts.erase(job.pCert->GetHash());
+            --nInFlight;
+        }
+        boost::this_thread::interruption_point();
+    }
+}
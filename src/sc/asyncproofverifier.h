@@ -0,0 +1,78 @@
+#ifndef _SC_ASYNC_PROOF_VERIFIER_H
+#define _SC_ASYNC_PROOF_VERIFIER_H
+
+#include "sc/proofverifier.h"
+#include "primitives/certificate.h"
+#include "net.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/* Default number of threads verifying the proofs of the certificates received from peers, 0 = verify inline */
+static const int DEFAULT_SC_PROOF_VERIFICATION_THREADS = 1;
+/* Maximum number of threads verifying the proofs of the certificates received from peers */
+static const int MAX_SC_PROOF_VERIFICATION_THREADS = 8;
+/* Maximum number of certificates waiting for proof verification, overall and for a single peer */
+static const size_t MAX_PENDING_CERT_PROOFS = 100;
+static const size_t MAX_PENDING_CERT_PROOFS_PER_PEER = 10;
+
+/**
+ * Bounded pool of workers verifying, without holding cs_main, the SNARK proofs of the certificates
+ * received from peers. Certificates get here only after all the cheap contextual checks have passed;
+ * once their proof is verified the callback is in charge of re-validating them against the current
+ * state and of adding them to the mempool.
+ * Jobs are queued per peer and served round robin, so that a peer flooding certificates cannot
+ * delay the ones sent by the others.
+ */
+class CScAsyncProofVerifier
+{
+public:
+    typedef boost::function<void(NodeId, const CScCertificate&, bool)> VerifiedCertCallback;
+
+    static CScAsyncProofVerifier& getInstance();
+
+    void SetCallback(const VerifiedCertCallback& callbackIn);
+
+    // Returns false if the queue of the peer or the overall queue is full, or if the certificate is already pending
+    bool Enqueue(NodeId nodeId, const std::shared_ptr<const CScCertificate>& pCert, const libzendoomc::CScCertProofCheck& check);
+
+    bool IsPending(const uint256& certHash);
+
+    // Number of certificates queued or being verified
+    size_t GetQueueDepth();
+
+    // Worker thread body, returns when the thread is interrupted
+    void ThreadVerify();
+
+private:
+    struct CJob {
+        NodeId nodeId;
+        std::shared_ptr<const CScCertificate> pCert;
+        libzendoomc::CScCertProofCheck check;
+    };
+
+    CScAsyncProofVerifier(): nLastServedNode(-1), nQueued(0), nInFlight(0) {}
+    CScAsyncProofVerifier(const CScAsyncProofVerifier&) = delete;
+    CScAsyncProofVerifier& operator=(const CScAsyncProofVerifier&) = delete;
+
+    // Must be called with mutex held
+    bool PopNextJob(CJob& job);
+
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    VerifiedCertCallback callback;
+
+    std::map<NodeId, std::deque<CJob> > mapPeerQueues;
+    std::set<uint256> setPendingCerts;
+    NodeId nLastServedNode;
+    size_t nQueued;
+    size_t nInFlight;
+};
+
+#endif // _SC_ASYNC_PROOF_VERIFIER_H
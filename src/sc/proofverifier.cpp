@@ -2,6 +2,8 @@
 #include "primitives/certificate.h"
 
 #include "main.h"
+#include "hash.h"
+#include "random.h"
 
 #include "util.h"
 #include "sync.h"
@@ -65,27 +67,97 @@ namespace libzendoomc{
         return true;
     }
 
-    // Let's define a struct to hold the inputs, with a function to free the memory Rust-side
+    CScVkCache& CScVkCache::getInstance()
+    {
+        static CScVkCache instance(DEFAULT_SC_VK_CACHE_SIZE);
+        return instance;
+    }
+
+    bool CScVkCache::Get(const uint256& scId, const ScConstant& constant, const ScVk& wCertVk,
+                         std::shared_ptr<field_t>& constantOut, std::shared_ptr<sc_vk_t>& wCertVkOut)
+    {
+        LOCK(cs);
+        auto it = mapEntries.find(scId);
+        if (it == mapEntries.end())
+            return false;
+
+        const CEntry& entry = it->second.first;
+        if (entry.constant != constant || entry.wCertVk != wCertVk)
+            return false;
+
+        lruList.splice(lruList.begin(), lruList, it->second.second);
+        constantOut = entry.deserializedConstant;
+        wCertVkOut = entry.deserializedVk;
+        return true;
+    }
+
+    void CScVkCache::Put(const uint256& scId, const ScConstant& constant, const ScVk& wCertVk,
+                         const std::shared_ptr<field_t>& constantIn, const std::shared_ptr<sc_vk_t>& wCertVkIn)
+    {
+        LOCK(cs);
+        auto it = mapEntries.find(scId);
+        if (it != mapEntries.end())
+        {
+            lruList.erase(it->second.second);
+            mapEntries.erase(it);
+        }
+
+        while (!lruList.empty() && mapEntries.size() >= nMaxSize)
+        {
+            mapEntries.erase(lruList.back());
+            lruList.pop_back();
+        }
+
+        lruList.push_front(scId);
+        CEntry& entry = mapEntries[scId].first;
+        entry.constant = constant;
+        entry.wCertVk = wCertVk;
+        entry.deserializedConstant = constantIn;
+        entry.deserializedVk = wCertVkIn;
+        mapEntries[scId].second = lruList.begin();
+    }
+
+    void CScVkCache::Erase(const uint256& scId)
+    {
+        LOCK(cs);
+        auto it = mapEntries.find(scId);
+        if (it == mapEntries.end())
+            return;
+
+        lruList.erase(it->second.second);
+        mapEntries.erase(it);
+        LogPrint("sc", "%s():%d - scId[%s] removed from vk cache\n", __func__, __LINE__, scId.ToString());
+    }
+
+    void CScVkCache::Clear()
+    {
+        LOCK(cs);
+        lruList.clear();
+        mapEntries.clear();
+    }
+
+    size_t CScVkCache::Size()
+    {
+        LOCK(cs);
+        return mapEntries.size();
+    }
+
+    // Let's define a struct to hold the inputs, with a function to free the memory Rust-side.
+    // The constant and the vk are shared with the CScVkCache, they are released when the last reference goes away
     struct WCertVerifierInputs {
         std::vector<backward_transfer_t> bt_list;
-        field_t* constant;
+        std::shared_ptr<field_t> constant;
         field_t* proofdata;
         sc_proof_t* sc_proof;
-        sc_vk_t* sc_vk;
+        std::shared_ptr<sc_vk_t> sc_vk;
 
         ~WCertVerifierInputs(){
 
-            zendoo_field_free(constant);
-            constant = nullptr;
-
             zendoo_field_free(proofdata);
             proofdata = nullptr;
 
             zendoo_sc_proof_free(sc_proof);
             sc_proof = nullptr;
-
-            zendoo_sc_vk_free(sc_vk);
-            sc_vk = nullptr;
         }
     };
 
@@ -98,24 +170,44 @@ namespace libzendoomc{
         // Collect verifier inputs
 
         WCertVerifierInputs inputs;
+        inputs.proofdata = nullptr;
+        inputs.sc_proof = nullptr;
+
+        if (!CScVkCache::getInstance().Get(scCert.GetScId(), constant, wCertVk, inputs.constant, inputs.sc_vk))
+        {
+            //Deserialize constant
+            if (constant.size() == 0){ //Constant can be optional
+                inputs.constant = nullptr;
+
+            } else {
+
+                inputs.constant = std::shared_ptr<field_t>(deserialize_field(constant.data()), zendoo_field_free);
+
+                if (inputs.constant == nullptr) {
+
+                    LogPrint("zendoo_mc_cryptolib",
+                            "%s():%d - failed to deserialize \"constant\": %s \n", 
+                            __func__, __LINE__, ToString(zendoo_get_last_error()));
+                    zendoo_clear_error();
+
+                    return false;
+                }
+            }
+
+            //Deserialize sc_vk
+            inputs.sc_vk = std::shared_ptr<sc_vk_t>(deserialize_sc_vk(wCertVk.begin()), zendoo_sc_vk_free);
+
+            if (inputs.sc_vk == nullptr){
 
-        //Deserialize constant
-        if (constant.size() == 0){ //Constant can be optional
-            inputs.constant = nullptr;
-       
-        } else {
-            
-            inputs.constant = deserialize_field(constant.data()); 
-            
-            if (inputs.constant == nullptr) {
-                
                 LogPrint("zendoo_mc_cryptolib",
-                        "%s():%d - failed to deserialize \"constant\": %s \n", 
-                        __func__, __LINE__, ToString(zendoo_get_last_error()));
+                    "%s():%d - failed to deserialize \"wCertVk\": %s \n", 
+                    __func__, __LINE__, ToString(zendoo_get_last_error()));
                 zendoo_clear_error();
 
                 return false;
             }
+
+            CScVkCache::getInstance().Put(scCert.GetScId(), constant, wCertVk, inputs.constant, inputs.sc_vk);
         }
 
         //Initialize quality and proofdata
@@ -136,19 +228,6 @@ namespace libzendoomc{
             return false;
         }
 
-        //Deserialize sc_vk
-        inputs.sc_vk = deserialize_sc_vk(wCertVk.begin());
-
-        if (inputs.sc_vk == nullptr){
-
-            LogPrint("zendoo_mc_cryptolib",
-                "%s():%d - failed to deserialize \"wCertVk\": %s \n", 
-                __func__, __LINE__, ToString(zendoo_get_last_error()));
-            zendoo_clear_error();
-
-            return false;
-        }
-
         //Retrieve BT list
         for(int pos = scCert.nFirstBwtPos; pos < scCert.GetVout().size(); ++pos)
         {
@@ -179,7 +258,7 @@ namespace libzendoomc{
         // Call verifier
         if (!verify_sc_proof(scCert.endEpochBlockHash.begin(), prev_end_epoch_block_hash.begin(),
                             inputs.bt_list.data(), inputs.bt_list.size(), scCert.quality,
-                            inputs.constant, inputs.proofdata, inputs.sc_proof, inputs.sc_vk))
+                            inputs.constant.get(), inputs.proofdata, inputs.sc_proof, inputs.sc_vk.get()))
         {
             Error err = zendoo_get_last_error();
             if (err.category == CRYPTO_ERROR){ // Proof verification returned false due to an error, we must log it
@@ -193,16 +272,73 @@ namespace libzendoomc{
         return true;
     }
 
+    // Set of the verification hashes of the proofs known to be valid, with random eviction
+    static CCriticalSection csVerifiedProofs;
+    static std::set<uint256> setVerifiedProofs;
+
+    uint256 CScCertProofCheck::GetVerificationHash() const
+    {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << pCert->GetHash() << prevEndEpochBlockHash << wCertVk << constant;
+        return ss.GetHash();
+    }
+
+    bool CScCertProofCheck::IsAlreadyVerified() const
+    {
+        LOCK(csVerifiedProofs);
+        return setVerifiedProofs.count(GetVerificationHash()) != 0;
+    }
+
+    bool CScCertProofCheck::operator()()
+    {
+        const uint256 verificationHash = GetVerificationHash();
+        {
+            LOCK(csVerifiedProofs);
+            if (setVerifiedProofs.count(verificationHash))
+                return true;
+        }
+
+        if (!CScWCertProofVerification().verifyScCert(constant, wCertVk, prevEndEpochBlockHash, *pCert))
+            return false;
+
+        LOCK(csVerifiedProofs);
+        while (setVerifiedProofs.size() >= MAX_SC_VERIFIED_PROOFS_CACHE_SIZE)
+        {
+            auto it = setVerifiedProofs.lower_bound(GetRandHash());
+            if (it == setVerifiedProofs.end())
+                it = setVerifiedProofs.begin();
+            setVerifiedProofs.erase(it);
+        }
+        setVerifiedProofs.insert(verificationHash);
+        return true;
+    }
+
+    void CScCertProofCheck::swap(CScCertProofCheck& check)
+    {
+        constant.swap(check.constant);
+        std::swap(wCertVk, check.wCertVk);
+        std::swap(prevEndEpochBlockHash, check.prevEndEpochBlockHash);
+        std::swap(pCert, check.pCert);
+    }
+
     bool CScProofVerifier::verifyCScCertificate(
         const ScConstant& constant,
         const ScVk& wCertVk,
         const uint256& prev_end_epoch_block_hash,
-        const CScCertificate& cert
+        const CScCertificate& cert,
+        std::vector<CScCertProofCheck>* pvChecks
     ) const 
     {
         if(!perform_verification)
             return true;
-        else
-            return CScWCertProofVerification().verifyScCert(constant, wCertVk, prev_end_epoch_block_hash, cert);
+
+        CScCertProofCheck check(constant, wCertVk, prev_end_epoch_block_hash, cert);
+        if (pvChecks != nullptr && !check.IsAlreadyVerified()) {
+            pvChecks->push_back(CScCertProofCheck());
+            check.swap(pvChecks->back());
+            return true;
+        }
+
+        return check();
     }
 }
@@ -5,7 +5,13 @@
 #include <zendoo/zendoo_mc.h>
 #include "uint256.h"
 
+#include "sync.h"
+
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 #include <boost/foreach.hpp>
 #include <boost/variant.hpp>
 #include <boost/filesystem.hpp>
@@ -36,6 +42,51 @@ namespace libzendoomc{
     /* Write scVk to file in vkPath. Returns true if operation succeeds, false otherwise. */
     bool SaveScVkToFile(const boost::filesystem::path& vkPath, const ScVk& scVk);
 
+    /* Maximum number of successfully verified certificate proofs remembered, so that they are not verified twice */
+    static const size_t MAX_SC_VERIFIED_PROOFS_CACHE_SIZE = 1000;
+
+    /* Default number of sidechains whose deserialized wCertVk and constant are kept in memory */
+    static const size_t DEFAULT_SC_VK_CACHE_SIZE = 256;
+
+    /*
+     * LRU cache of the deserialized wCertVk and constant of each sidechain. Both are fixed at sidechain
+     * creation, so there is no need to deserialize them again for every certificate. Handles are shared,
+     * hence an entry can be evicted while a verification is still using it.
+     * The serialized data are stored along with the handles and compared on lookup, so a stale entry can
+     * never be returned; entries of reverted sidechains are anyway dropped via Erase().
+     */
+    class CScVkCache {
+        public:
+            static CScVkCache& getInstance();
+
+            // Returns true and fills the handles if an entry matching both scId and serialized data is found
+            bool Get(const uint256& scId, const ScConstant& constant, const ScVk& wCertVk,
+                     std::shared_ptr<field_t>& constantOut, std::shared_ptr<sc_vk_t>& wCertVkOut);
+            void Put(const uint256& scId, const ScConstant& constant, const ScVk& wCertVk,
+                     const std::shared_ptr<field_t>& constantIn, const std::shared_ptr<sc_vk_t>& wCertVkIn);
+            void Erase(const uint256& scId);
+            void Clear();
+            size_t Size();
+
+        private:
+            struct CEntry {
+                ScConstant constant;
+                ScVk wCertVk;
+                std::shared_ptr<field_t> deserializedConstant;
+                std::shared_ptr<sc_vk_t> deserializedVk;
+            };
+
+            CScVkCache(size_t nMaxSizeIn): nMaxSize(nMaxSizeIn) {}
+            CScVkCache(const CScVkCache&) = delete;
+            CScVkCache& operator=(const CScVkCache&) = delete;
+
+            CCriticalSection cs;
+            size_t nMaxSize;
+            // most recently used scId first
+            std::list<uint256> lruList;
+            std::map<uint256, std::pair<CEntry, std::list<uint256>::iterator> > mapEntries;
+    };
+
     /* Support class for WCert SNARK proof verification. */
     class CScWCertProofVerification {
         public:
@@ -87,6 +138,33 @@ namespace libzendoomc{
             }
     };
 
+    /*
+     * Closure representing the WCert SNARK proof verification of a single certificate.
+     * Like CScriptCheck, it can be run inline or collected and dispatched into a CCheckQueue.
+     * The referenced certificate must outlive the check.
+     */
+    class CScCertProofCheck {
+        private:
+            ScConstant constant;
+            ScVk wCertVk;
+            uint256 prevEndEpochBlockHash;
+            const CScCertificate* pCert;
+
+        public:
+            CScCertProofCheck(): pCert(nullptr) {}
+            CScCertProofCheck(const ScConstant& constantIn, const ScVk& wCertVkIn,
+                              const uint256& prevEndEpochBlockHashIn, const CScCertificate& certIn):
+                constant(constantIn), wCertVk(wCertVkIn), prevEndEpochBlockHash(prevEndEpochBlockHashIn), pCert(&certIn) {}
+
+            bool operator()();
+            void swap(CScCertProofCheck& check);
+
+            // Hash of all the inputs of the verification: a proof successfully verified for a given
+            // hash does not need to be verified again (e.g. at block connection after mempool acceptance)
+            uint256 GetVerificationHash() const;
+            bool IsAlreadyVerified() const;
+    };
+
     /* Class for instantiating a verifier able to verify different kind of ScProof for different kind of ScProof(s) */
     class CScProofVerifier {
         protected:
@@ -110,11 +188,14 @@ namespace libzendoomc{
 
             // Returns false if proof verification has failed or deserialization of certificate's elements
             // into libzendoomc's elements has failed.
+            // If pvChecks is not null the verification is not performed here: a check is appended to
+            // pvChecks instead, and it is up to the caller to run it (e.g. through a CCheckQueue).
             bool verifyCScCertificate(
                 const ScConstant& constant,
                 const ScVk& wCertVk,
                 const uint256& prev_end_epoch_block_hash,
-                const CScCertificate& scCert
+                const CScCertificate& scCert,
+                std::vector<CScCertProofCheck>* pvChecks = nullptr
             ) const;
     };
 }
@@ -10,6 +10,11 @@
 
 #include <vector>
 
+//! -maxsigcachemib default, in MiB. Each entry takes 32 bytes.
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+//! Upper bound of -maxsigcachemib (and of the deprecated -maxsigcachesize entry count, once converted), in MiB
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
@@ -32,4 +37,7 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Size the signature cache from -maxsigcachemib (or the deprecated -maxsigcachesize entry count); until this is called nothing is cached */
+void InitSignatureCache();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
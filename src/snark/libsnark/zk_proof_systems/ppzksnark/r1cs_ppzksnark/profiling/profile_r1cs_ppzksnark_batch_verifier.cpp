@@ -0,0 +1,95 @@
+/** @file
+ *****************************************************************************
+ Profiling program that compares the online verifier of the ppzkSNARK with the
+ batch verifier on proofs for a synthetic R1CS instance.
+
+ The command
+
+     $ src/zk_proof_systems/ppzksnark/r1cs_ppzksnark/profiling/profile_r1cs_ppzksnark_batch_verifier 1000 10 100
+
+ generates 100 proofs for an R1CS instance with 1000 equations and an input
+ consisting of 10 field elements, then verifies them one by one with
+ r1cs_ppzksnark_online_verifier_strong_IC and all at once with
+ r1cs_ppzksnark_batch_verifier.
+
+ *****************************************************************************
+ * @author     This file is part of libsnark, developed by SCIPR Lab
+ *             and contributors (see AUTHORS).
+ * @copyright  MIT license (see LICENSE file)
+ *****************************************************************************/
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include "common/default_types/r1cs_ppzksnark_pp.hpp"
+#include "common/profiling.hpp"
+#include "common/utils.hpp"
+#include "relations/constraint_satisfaction_problems/r1cs/examples/r1cs_examples.hpp"
+#include "zk_proof_systems/ppzksnark/r1cs_ppzksnark/r1cs_ppzksnark.hpp"
+
+using namespace libsnark;
+
+int main(int argc, const char * argv[])
+{
+    typedef default_r1cs_ppzksnark_pp ppT;
+
+    ppT::init_public_params();
+    start_profiling();
+
+    if (argc != 4)
+    {
+        printf("usage: %s num_constraints input_size num_proofs\n", argv[0]);
+        return 1;
+    }
+    const size_t num_constraints = atoi(argv[1]);
+    const size_t input_size = atoi(argv[2]);
+    const size_t num_proofs = atoi(argv[3]);
+
+    enter_block("Generate R1CS example");
+    r1cs_example<Fr<ppT> > example = generate_r1cs_example_with_field_input<Fr<ppT> >(num_constraints, input_size);
+    example.constraint_system.swap_AB_if_beneficial();
+    leave_block("Generate R1CS example");
+
+    r1cs_ppzksnark_keypair<ppT> keypair = r1cs_ppzksnark_generator<ppT>(example.constraint_system);
+    r1cs_ppzksnark_processed_verification_key<ppT> pvk = r1cs_ppzksnark_verifier_process_vk<ppT>(keypair.vk);
+
+    enter_block("Generate proofs");
+    std::vector<r1cs_ppzksnark_proof<ppT> > proofs;
+    for (size_t i = 0; i < num_proofs; ++i)
+    {
+        proofs.emplace_back(r1cs_ppzksnark_prover<ppT>(keypair.pk, example.primary_input, example.auxiliary_input, example.constraint_system));
+    }
+    leave_block("Generate proofs");
+
+    /* the per-proof verifiers open their own blocks, so time both runs directly */
+    inhibit_profiling_info = true;
+
+    const int64_t individual_start = get_nsec_time();
+    bool individual_ok = true;
+    for (size_t i = 0; i < num_proofs; ++i)
+    {
+        individual_ok = r1cs_ppzksnark_online_verifier_strong_IC<ppT>(pvk, example.primary_input, proofs[i]) && individual_ok;
+    }
+    const int64_t individual_time = get_nsec_time() - individual_start;
+
+    const int64_t batch_start = get_nsec_time();
+    r1cs_ppzksnark_batch_verifier<ppT> batch;
+    bool batch_ok = true;
+    for (size_t i = 0; i < num_proofs; ++i)
+    {
+        batch_ok = batch.add(keypair.vk, example.primary_input, proofs[i]) && batch_ok;
+    }
+    batch_ok = batch.verify(pvk) && batch_ok;
+    const int64_t batch_time = get_nsec_time() - batch_start;
+
+    inhibit_profiling_info = false;
+
+    print_header("Verification of proofs");
+    print_indent(); printf("* Online verifier: %s, %.4fs (%.4fs/proof)\n", individual_ok ? "PASS" : "FAIL",
+                           individual_time * 1e-9, individual_time * 1e-9 / num_proofs);
+    print_indent(); printf("* Batch verifier: %s, %.4fs (%.4fs/proof)\n", batch_ok ? "PASS" : "FAIL",
+                           batch_time * 1e-9, batch_time * 1e-9 / num_proofs);
+    assert(individual_ok && batch_ok);
+
+    return 0;
+}
@@ -13,6 +13,7 @@
  - prover algorithm
  - verifier algorithm (with strong or weak input consistency)
  - online verifier algorithm (with strong or weak input consistency)
+ - batch verifier for many proofs under one verification key
 
  The implementation instantiates (a modification of) the protocol of \[PGHR13],
  by following extending, and optimizing the approach described in \[BCTV14].
@@ -463,6 +464,54 @@ bool r1cs_ppzksnark_online_verifier_strong_IC(const r1cs_ppzksnark_processed_ver
                                               const r1cs_ppzksnark_primary_input<ppT> &primary_input,
                                               const r1cs_ppzksnark_proof<ppT> &proof);
 
+/**
+ * A batch verifier for the R1CS ppzkSNARK, with strong input consistency.
+ *
+ * The five pairing-product equations checked by the online verifier are
+ * combined, for each added proof, with independent random 128-bit scalars.
+ * Terms that pair against a fixed element of the verification key are summed
+ * in G1 across all proofs, so verifying N proofs costs N Miller loops (for the
+ * terms that pair against each proof's B), six more for the verification key
+ * and a single final exponentiation; the online verifier needs twelve Miller
+ * loops and five final exponentiations per proof.
+ *
+ * A batch that contains an invalid proof is rejected except with probability
+ * about 2^-128; the batch does not tell which proof was invalid.
+ * All proofs in a batch must be checked against the same verification key.
+ */
+template<typename ppT>
+class r1cs_ppzksnark_batch_verifier {
+private:
+    G1<ppT> alphaA_acc;
+    G1<ppT> alphaC_acc;
+    G1<ppT> rC_Z_acc;
+    G1<ppT> gamma_acc;
+    G1<ppT> gamma_beta_acc;
+    G1<ppT> one_acc;
+    Fqk<ppT> B_miller_acc;
+    size_t num_proofs;
+
+public:
+    r1cs_ppzksnark_batch_verifier();
+
+    /**
+     * Add a proof to the batch. Returns false, leaving the batch unchanged, if
+     * the proof can be rejected without pairings: wrong input length, points not
+     * on the curve, or g_B.g outside the order-r subgroup of G2.
+     */
+    bool add(const r1cs_ppzksnark_verification_key<ppT> &vk,
+             const r1cs_ppzksnark_primary_input<ppT> &primary_input,
+             const r1cs_ppzksnark_proof<ppT> &proof);
+
+    /** Add all proofs of another batch for the same verification key. */
+    void merge(const r1cs_ppzksnark_batch_verifier<ppT> &other);
+
+    /** Returns true if every proof in the batch verifies (an empty batch does). */
+    bool verify(const r1cs_ppzksnark_processed_verification_key<ppT> &pvk) const;
+
+    size_t size() const { return num_proofs; }
+};
+
 /****************************** Miscellaneous ********************************/
 
 /**
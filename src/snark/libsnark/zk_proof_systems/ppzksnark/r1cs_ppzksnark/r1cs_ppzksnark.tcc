@@ -792,6 +792,108 @@ bool r1cs_ppzksnark_verifier_strong_IC(const r1cs_ppzksnark_verification_key<ppT
     return result;
 }
 
+template<typename ppT>
+r1cs_ppzksnark_batch_verifier<ppT>::r1cs_ppzksnark_batch_verifier() :
+    alphaA_acc(G1<ppT>::zero()),
+    alphaC_acc(G1<ppT>::zero()),
+    rC_Z_acc(G1<ppT>::zero()),
+    gamma_acc(G1<ppT>::zero()),
+    gamma_beta_acc(G1<ppT>::zero()),
+    one_acc(G1<ppT>::zero()),
+    B_miller_acc(Fqk<ppT>::one()),
+    num_proofs(0)
+{
+}
+
+template<typename ppT>
+bool r1cs_ppzksnark_batch_verifier<ppT>::add(const r1cs_ppzksnark_verification_key<ppT> &vk,
+                                              const r1cs_ppzksnark_primary_input<ppT> &primary_input,
+                                              const r1cs_ppzksnark_proof<ppT> &proof)
+{
+    if (vk.encoded_IC_query.domain_size() != primary_input.size())
+    {
+        return false;
+    }
+
+    if (!proof.is_well_formed())
+    {
+        return false;
+    }
+
+    /* Random combinations are only sound inside prime-order groups; G1 has cofactor 1 but G2 does not. */
+    if (!(G2<ppT>::order() * proof.g_B.g).is_zero())
+    {
+        return false;
+    }
+
+    const accumulation_vector<G1<ppT> > accumulated_IC = vk.encoded_IC_query.template accumulate_chunk<Fr<ppT> >(primary_input.begin(), primary_input.end(), 0);
+    const G1<ppT> A_g_acc = proof.g_A.g + accumulated_IC.first;
+
+    bigint<2> r[5];
+    for (size_t i = 0; i < 5; ++i)
+    {
+        r[i].randomize();
+    }
+
+    /*
+      With the checks of the online verifier written as
+        (1) e(A, alphaA) = e(A', P2)
+        (2) e(alphaB, B) = e(B', P2)
+        (3) e(C, alphaC) = e(C', P2)
+        (4) e(A+acc, B) = e(H, rC_Z) * e(C, P2)
+        (5) e(K, gamma) = e(A+acc+C, gamma_beta_g2) * e(gamma_beta_g1, B)
+      raise each to r[0..4] and multiply; everything that pairs with B is
+      folded into one Miller loop, the rest into the per-key accumulators.
+    */
+    alphaA_acc = alphaA_acc + r[0] * proof.g_A.g;
+    alphaC_acc = alphaC_acc + r[2] * proof.g_C.g;
+    rC_Z_acc = rC_Z_acc - r[3] * proof.g_H;
+    gamma_acc = gamma_acc + r[4] * proof.g_K;
+    gamma_beta_acc = gamma_beta_acc - r[4] * (A_g_acc + proof.g_C.g);
+    one_acc = one_acc - (r[0] * proof.g_A.h + r[1] * proof.g_B.h + r[2] * proof.g_C.h + r[3] * proof.g_C.g);
+
+    const G1<ppT> B_pair = r[1] * vk.alphaB_g1 + r[3] * A_g_acc - r[4] * vk.gamma_beta_g1;
+    B_miller_acc = B_miller_acc * ppT::miller_loop(ppT::precompute_G1(B_pair), ppT::precompute_G2(proof.g_B.g));
+
+    ++num_proofs;
+    return true;
+}
+
+template<typename ppT>
+void r1cs_ppzksnark_batch_verifier<ppT>::merge(const r1cs_ppzksnark_batch_verifier<ppT> &other)
+{
+    alphaA_acc = alphaA_acc + other.alphaA_acc;
+    alphaC_acc = alphaC_acc + other.alphaC_acc;
+    rC_Z_acc = rC_Z_acc + other.rC_Z_acc;
+    gamma_acc = gamma_acc + other.gamma_acc;
+    gamma_beta_acc = gamma_beta_acc + other.gamma_beta_acc;
+    one_acc = one_acc + other.one_acc;
+    B_miller_acc = B_miller_acc * other.B_miller_acc;
+    num_proofs += other.num_proofs;
+}
+
+template<typename ppT>
+bool r1cs_ppzksnark_batch_verifier<ppT>::verify(const r1cs_ppzksnark_processed_verification_key<ppT> &pvk) const
+{
+    if (num_proofs == 0)
+    {
+        return true;
+    }
+
+    enter_block("Call to r1cs_ppzksnark_batch_verifier::verify");
+
+    const Fqk<ppT> miller_1 = ppT::double_miller_loop(ppT::precompute_G1(alphaA_acc), pvk.vk_alphaA_g2_precomp,
+                                                       ppT::precompute_G1(alphaC_acc), pvk.vk_alphaC_g2_precomp);
+    const Fqk<ppT> miller_2 = ppT::double_miller_loop(ppT::precompute_G1(rC_Z_acc), pvk.vk_rC_Z_g2_precomp,
+                                                       ppT::precompute_G1(gamma_acc), pvk.vk_gamma_g2_precomp);
+    const Fqk<ppT> miller_3 = ppT::double_miller_loop(ppT::precompute_G1(gamma_beta_acc), pvk.vk_gamma_beta_g2_precomp,
+                                                       ppT::precompute_G1(one_acc), pvk.pp_G2_one_precomp);
+    const GT<ppT> result = ppT::final_exponentiation(B_miller_acc * miller_1 * miller_2 * miller_3);
+
+    leave_block("Call to r1cs_ppzksnark_batch_verifier::verify");
+    return result == GT<ppT>::one();
+}
+
 template<typename ppT>
 bool r1cs_ppzksnark_affine_verifier_weak_IC(const r1cs_ppzksnark_verification_key<ppT> &vk,
                                             const r1cs_ppzksnark_primary_input<ppT> &primary_input,
@@ -8,6 +8,12 @@
 #include "utilstrencodings.h"
 
 #include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <tuple>
 
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
@@ -20,6 +26,176 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> fLockProfiling(false);
+
+int64_t LockProfileTime()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CLockProfileStats::CLockProfileStats() :
+    nLocks(0), nContended(0), nTryFailed(0), nWaitTotal(0), nWaitMax(0), nHoldTotal(0), nHoldMax(0)
+{
+    memset(vWaitHistogram, 0, sizeof(vWaitHistogram));
+    memset(vHoldHistogram, 0, sizeof(vHoldHistogram));
+}
+
+void CLockProfileStats::Add(const CLockProfileStats& other)
+{
+    nLocks += other.nLocks;
+    nContended += other.nContended;
+    nTryFailed += other.nTryFailed;
+    nWaitTotal += other.nWaitTotal;
+    nWaitMax = std::max(nWaitMax, other.nWaitMax);
+    nHoldTotal += other.nHoldTotal;
+    nHoldMax = std::max(nHoldMax, other.nHoldMax);
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        vWaitHistogram[i] += other.vWaitHistogram[i];
+        vHoldHistogram[i] += other.vHoldHistogram[i];
+    }
+}
+
+namespace {
+
+int LockProfileBucket(int64_t nTime)
+{
+    int64_t nMicros = nTime / 1000;
+    int nBucket = 0;
+    while (nMicros > 0 && nBucket < CLockProfileStats::HISTOGRAM_BUCKETS - 1) {
+        nMicros >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+/** A lock site is identified by the string literals passed by LOCK and friends */
+struct CLockSiteKey
+{
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+
+    bool operator<(const CLockSiteKey& other) const
+    {
+        return std::tie(pszFile, nLine, pszName) < std::tie(other.pszFile, other.nLine, other.pszName);
+    }
+};
+
+typedef std::map<CLockSiteKey, CLockProfileStats> LockSiteMap;
+
+/** Samples of one thread. Its mutex is only contended while GetLockProfile() runs */
+struct CLockProfileBuffer
+{
+    boost::mutex mutex;
+    LockSiteMap mapSites;
+};
+
+void RetireLockProfileBuffer(CLockProfileBuffer* pbuffer);
+
+/**
+ * Never destroyed, so that locks taken while static objects are torn
+ * down can still be profiled.
+ */
+struct CLockProfileState
+{
+    boost::mutex mutex;
+    std::set<CLockProfileBuffer*> setBuffers;
+    //! Samples of threads that have exited
+    LockSiteMap mapRetiredSites;
+    boost::thread_specific_ptr<CLockProfileBuffer> threadBuffer;
+
+    CLockProfileState() : threadBuffer(RetireLockProfileBuffer) {}
+};
+
+CLockProfileState& GetLockProfileState()
+{
+    static CLockProfileState* pstate = new CLockProfileState();
+    return *pstate;
+}
+
+void MergeLockSites(LockSiteMap& mapTo, const LockSiteMap& mapFrom)
+{
+    for (LockSiteMap::const_iterator it = mapFrom.begin(); it != mapFrom.end(); ++it)
+        mapTo[it->first].Add(it->second);
+}
+
+void RetireLockProfileBuffer(CLockProfileBuffer* pbuffer)
+{
+    CLockProfileState& state = GetLockProfileState();
+    {
+        boost::lock_guard<boost::mutex> lock(state.mutex);
+        state.setBuffers.erase(pbuffer);
+        boost::lock_guard<boost::mutex> lockBuffer(pbuffer->mutex);
+        MergeLockSites(state.mapRetiredSites, pbuffer->mapSites);
+    }
+    delete pbuffer;
+}
+
+} // namespace
+
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine, bool fAcquired, bool fContended, int64_t nWaitTime, int64_t nHoldTime)
+{
+    CLockProfileState& state = GetLockProfileState();
+    CLockProfileBuffer* pbuffer = state.threadBuffer.get();
+    if (!pbuffer) {
+        pbuffer = new CLockProfileBuffer();
+        state.threadBuffer.reset(pbuffer);
+        boost::lock_guard<boost::mutex> lock(state.mutex);
+        state.setBuffers.insert(pbuffer);
+    }
+
+    boost::lock_guard<boost::mutex> lock(pbuffer->mutex);
+    CLockProfileStats& stats = pbuffer->mapSites[CLockSiteKey{pszName, pszFile, nLine}];
+    if (!fAcquired) {
+        stats.nTryFailed++;
+        return;
+    }
+    stats.nLocks++;
+    if (fContended)
+        stats.nContended++;
+    stats.nWaitTotal += nWaitTime;
+    stats.nWaitMax = std::max(stats.nWaitMax, nWaitTime);
+    stats.vWaitHistogram[LockProfileBucket(nWaitTime)]++;
+    stats.nHoldTotal += nHoldTime;
+    stats.nHoldMax = std::max(stats.nHoldMax, nHoldTime);
+    stats.vHoldHistogram[LockProfileBucket(nHoldTime)]++;
+}
+
+std::vector<CLockProfileSite> GetLockProfile(bool fReset)
+{
+    CLockProfileState& state = GetLockProfileState();
+    LockSiteMap mapSites;
+    {
+        boost::lock_guard<boost::mutex> lock(state.mutex);
+        MergeLockSites(mapSites, state.mapRetiredSites);
+        if (fReset)
+            state.mapRetiredSites.clear();
+        BOOST_FOREACH(CLockProfileBuffer* pbuffer, state.setBuffers) {
+            boost::lock_guard<boost::mutex> lockBuffer(pbuffer->mutex);
+            MergeLockSites(mapSites, pbuffer->mapSites);
+            if (fReset)
+                pbuffer->mapSites.clear();
+        }
+    }
+
+    // The same literal may live at different addresses in different translation units
+    std::map<std::tuple<std::string, int, std::string>, CLockProfileStats> mapByName;
+    for (LockSiteMap::const_iterator it = mapSites.begin(); it != mapSites.end(); ++it)
+        mapByName[std::make_tuple(std::string(it->first.pszFile), it->first.nLine, std::string(it->first.pszName))].Add(it->second);
+
+    std::vector<CLockProfileSite> vSites;
+    vSites.reserve(mapByName.size());
+    for (auto it = mapByName.begin(); it != mapByName.end(); ++it) {
+        CLockProfileSite site;
+        site.strFile = std::get<0>(it->first);
+        site.nLine = std::get<1>(it->first);
+        site.strName = std::get<2>(it->first);
+        site.stats = it->second;
+        vSites.push_back(site);
+    }
+    return vSites;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -8,6 +8,12 @@
 
 #include "threadsafety.h"
 
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -99,6 +105,50 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock contention profiling. While enabled (-lockprofiling or the
+ * setlockprofiling RPC) LOCK, LOCK2 and TRY_LOCK record per lock site how
+ * long they waited for the mutex and how long they held it. The samples go
+ * to a buffer of the calling thread and are aggregated by GetLockProfile().
+ * While disabled a lock only pays for reading the flag.
+ */
+extern std::atomic<bool> fLockProfiling;
+
+/** Monotonic time in nanoseconds used for lock profiling */
+int64_t LockProfileTime();
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine, bool fAcquired, bool fContended, int64_t nWaitTime, int64_t nHoldTime);
+
+/** Lock profile of one lock site, times in nanoseconds */
+struct CLockProfileStats
+{
+    //! Histogram bucket i > 0 counts times in [2^(i-1), 2^i) microseconds, the last one everything above
+    static const int HISTOGRAM_BUCKETS = 24;
+
+    uint64_t nLocks;
+    uint64_t nContended;
+    uint64_t nTryFailed;
+    int64_t nWaitTotal;
+    int64_t nWaitMax;
+    int64_t nHoldTotal;
+    int64_t nHoldMax;
+    uint64_t vWaitHistogram[HISTOGRAM_BUCKETS];
+    uint64_t vHoldHistogram[HISTOGRAM_BUCKETS];
+
+    CLockProfileStats();
+    void Add(const CLockProfileStats& other);
+};
+
+struct CLockProfileSite
+{
+    std::string strName;
+    std::string strFile;
+    int nLine;
+    CLockProfileStats stats;
+};
+
+/** Statistics of all lock sites collected so far, optionally starting over */
+std::vector<CLockProfileSite> GetLockProfile(bool fReset);
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
@@ -106,25 +156,53 @@ class SCOPED_LOCKABLE CMutexLock
 private:
     boost::unique_lock<Mutex> lock;
 
+    //! Where and when the lock was taken, nProfileLockTime < 0 if it is not profiled
+    const char* pszProfileName;
+    const char* pszProfileFile;
+    int nProfileLine;
+    bool fProfileContended;
+    int64_t nProfileWaitTime;
+    int64_t nProfileLockTime = -1;
+
+    void StartProfile(const char* pszName, const char* pszFile, int nLine, bool fContended, int64_t nStart)
+    {
+        pszProfileName = pszName;
+        pszProfileFile = pszFile;
+        nProfileLine = nLine;
+        fProfileContended = fContended;
+        nProfileLockTime = fContended ? LockProfileTime() : nStart;
+        nProfileWaitTime = nProfileLockTime - nStart;
+    }
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        const bool fProfile = fLockProfiling.load(std::memory_order_relaxed);
+        const int64_t nStart = fProfile ? LockProfileTime() : 0;
+        const bool fContended = !lock.try_lock();
+        if (fContended) {
 #ifdef DEBUG_LOCKCONTENTION
-        if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
 #endif
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
         }
-#endif
+        if (fProfile)
+            StartProfile(pszName, pszFile, nLine, fContended, nStart);
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()), true);
+        const bool fProfile = fLockProfiling.load(std::memory_order_relaxed);
+        const int64_t nStart = fProfile ? LockProfileTime() : 0;
         lock.try_lock();
-        if (!lock.owns_lock())
+        if (!lock.owns_lock()) {
             LeaveCritical();
+            if (fProfile)
+                LockProfileRecord(pszName, pszFile, nLine, false, true, 0, 0);
+        } else if (fProfile) {
+            StartProfile(pszName, pszFile, nLine, false, nStart);
+        }
         return lock.owns_lock();
     }
 
@@ -150,8 +228,16 @@ public:
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            // take the hold time, release the lock and only then record it, so that the
+            // profiler's own bookkeeping is not counted as time the lock was held
+            const int64_t nHoldTime = nProfileLockTime >= 0 ? LockProfileTime() - nProfileLockTime : -1;
             LeaveCritical();
+            lock.unlock();
+            if (nHoldTime >= 0)
+                LockProfileRecord(pszProfileName, pszProfileFile, nProfileLine, true, fProfileContended,
+                                  nProfileWaitTime, nHoldTime);
+        }
     }
 
     operator bool()
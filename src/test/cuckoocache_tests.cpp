@@ -0,0 +1,141 @@
+// Copyright (c) 2020 The Zen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "uint256.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+class TestHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, TestHasher> test_cache;
+
+std::vector<uint256> RandomHashes(size_t n)
+{
+    std::vector<uint256> hashes(n);
+    for (uint256& h : hashes)
+        h = GetRandHash();
+    return hashes;
+}
+
+double HitRate(const test_cache& cache, const std::vector<uint256>& hashes)
+{
+    size_t nHits = 0;
+    for (const uint256& h : hashes)
+        nHits += cache.contains(h, false);
+    return double(nHits) / hashes.size();
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_not_set_up)
+{
+    test_cache cache;
+    uint256 h = GetRandHash();
+    cache.insert(h);
+    BOOST_CHECK(!cache.contains(h, false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_setup_bytes)
+{
+    test_cache cache;
+    BOOST_CHECK_EQUAL(cache.setup_bytes(1 << 20), (1 << 20) / sizeof(uint256));
+    BOOST_CHECK_EQUAL(cache.setup_bytes(0), 2);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_half_full_keeps_everything)
+{
+    test_cache cache;
+    uint32_t nSize = cache.setup(1 << 14);
+    std::vector<uint256> hashes = RandomHashes(nSize / 2);
+    for (const uint256& h : hashes)
+        cache.insert(h);
+    BOOST_CHECK_GE(HitRate(cache, hashes), 0.99);
+
+    // Inserting again does not take more room
+    for (const uint256& h : hashes)
+        cache.insert(h);
+    BOOST_CHECK_GE(HitRate(cache, hashes), 0.99);
+    BOOST_CHECK_EQUAL(HitRate(cache, RandomHashes(1000)), 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erased_entries_make_room)
+{
+    test_cache cache;
+    uint32_t nSize = cache.setup(1 << 14);
+    std::vector<uint256> oldHashes = RandomHashes(nSize * 3 / 4);
+    for (const uint256& h : oldHashes)
+        cache.insert(h);
+    for (const uint256& h : oldHashes)
+        cache.contains(h, true);
+
+    // With the old entries erased the new ones fit as if the table was empty
+    std::vector<uint256> newHashes = RandomHashes(nSize * 3 / 4);
+    for (const uint256& h : newHashes)
+        cache.insert(h);
+    BOOST_CHECK_GE(HitRate(cache, newHashes), 0.99);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_keeps_recent_entries)
+{
+    test_cache cache;
+    uint32_t nSize = cache.setup(1 << 14);
+
+    // Keep inserting well past the capacity, the latest entries must stay
+    std::vector<uint256> hashes = RandomHashes(nSize * 4);
+    for (const uint256& h : hashes)
+        cache.insert(h);
+    std::vector<uint256> recent(hashes.end() - nSize / 4, hashes.end());
+    BOOST_CHECK_GE(HitRate(cache, recent), 0.98);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_concurrent_lookups)
+{
+    test_cache cache;
+    uint32_t nSize = cache.setup(1 << 14);
+    std::vector<uint256> hashes = RandomHashes(nSize / 2);
+    for (const uint256& h : hashes)
+        cache.insert(h);
+
+    // Lookups that erase only flip flags, so they can run side by side
+    const int nThreads = 4;
+    std::vector<size_t> vHits(nThreads, 0);
+    boost::thread_group threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.create_thread([&, t] {
+            for (size_t i = t; i < hashes.size(); i += nThreads)
+                vHits[t] += cache.contains(hashes[i], true);
+        });
+    }
+    threads.join_all();
+
+    size_t nHits = 0;
+    for (size_t n : vHits)
+        nHits += n;
+    BOOST_CHECK_GE(double(nHits) / hashes.size(), 0.99);
+    // Erased entries are still found until they are overwritten
+    BOOST_CHECK_GE(HitRate(cache, hashes), 0.99);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
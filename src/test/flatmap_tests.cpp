@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The Zen Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flatmap.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flatmap_matches_std_map)
+{
+    flatmap<int, std::string> fm;
+    std::map<int, std::string> ref;
+
+    for (int i = 0; i < 100000; i++) {
+        int key = GetRandInt(2000);
+        switch (GetRandInt(4)) {
+        case 0:
+            fm[key] = std::to_string(i);
+            ref[key] = std::to_string(i);
+            break;
+        case 1:
+            BOOST_CHECK_EQUAL(fm.insert(std::make_pair(key, std::string("ins"))).second,
+                              ref.insert(std::make_pair(key, std::string("ins"))).second);
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(fm.erase(key), ref.erase(key));
+            break;
+        default:
+            BOOST_CHECK_EQUAL(fm.count(key), ref.count(key));
+            if (ref.count(key))
+                BOOST_CHECK_EQUAL(fm.at(key), ref.at(key));
+        }
+
+        if (i % 10000 == 0) {
+            // Erase while iterating, the way CCoinsViewCache::BatchWrite does.
+            for (flatmap<int, std::string>::iterator it = fm.begin(); it != fm.end();) {
+                if (it->first % 3 == 0) {
+                    ref.erase(it->first);
+                    flatmap<int, std::string>::iterator itOld = it++;
+                    fm.erase(itOld);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        BOOST_CHECK_EQUAL(fm.size(), ref.size());
+    }
+
+    size_t nVisited = 0;
+    const flatmap<int, std::string> copy = fm;
+    for (flatmap<int, std::string>::const_iterator it = copy.begin(); it != copy.end(); ++it) {
+        BOOST_CHECK_EQUAL(it->second, ref.at(it->first));
+        nVisited++;
+    }
+    BOOST_CHECK_EQUAL(nVisited, ref.size());
+
+    fm.clear();
+    BOOST_CHECK(fm.empty());
+    BOOST_CHECK(fm.begin() == fm.end());
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_entries_survive_rehash)
+{
+    flatmap<int, int> fm;
+    int* pFirst = &fm[0];
+    *pFirst = 42;
+
+    for (int i = 1; i < 10000; i++)
+        fm[i] = i;
+
+    BOOST_CHECK(fm.bucket_count() >= fm.size());
+    BOOST_CHECK_EQUAL(&fm[0], pFirst);
+    BOOST_CHECK_EQUAL(fm.at(0), 42);
+    BOOST_CHECK_THROW(fm.at(10000), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
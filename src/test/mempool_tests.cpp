@@ -104,4 +104,275 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removedTxs.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolDependencyIndexTest)
+{
+    // Parent transaction with one child and one grand-child
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.resizeOut(1);
+    txParent.getOut(0).scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.getOut(0).nValue = 33000LL;
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.resizeOut(1);
+    txChild.getOut(0).scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.getOut(0).nValue = 11000LL;
+
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.resizeOut(1);
+    txGrandChild.getOut(0).scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.getOut(0).nValue = 11000LL;
+
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction>   removedTxs;
+    std::list<CScCertificate> removedCerts;
+
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 0, 0, 0.0, 1));
+
+    BOOST_CHECK_EQUAL(testPool.mapDependencies.count(txParent.GetHash()), 0);
+    BOOST_CHECK(testPool.mapDependencies[txChild.GetHash()] == std::set<uint256>{txParent.GetHash()});
+    BOOST_CHECK(testPool.mapDependencies[txGrandChild.GetHash()] == std::set<uint256>{txChild.GetHash()});
+    BOOST_CHECK(testPool.mapDependents[txParent.GetHash()] == std::set<uint256>{txChild.GetHash()});
+
+    // Parent mined: the child no longer waits for anything
+    testPool.remove(txParent, removedTxs, removedCerts, false);
+    BOOST_CHECK_EQUAL(testPool.mapDependencies.count(txChild.GetHash()), 0);
+    BOOST_CHECK_EQUAL(testPool.mapDependents.count(txParent.GetHash()), 0);
+    BOOST_CHECK_EQUAL(testPool.mapDependencies.count(txGrandChild.GetHash()), 1);
+
+    // Parent resurrected by a reorg after its child: the dependency is restored
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    BOOST_CHECK(testPool.mapDependencies[txChild.GetHash()] == std::set<uint256>{txParent.GetHash()});
+    BOOST_CHECK(testPool.mapDependents[txParent.GetHash()] == std::set<uint256>{txChild.GetHash()});
+
+    testPool.remove(txParent, removedTxs, removedCerts, true);
+    BOOST_CHECK_EQUAL(removedTxs.size(), 4);
+    BOOST_CHECK(testPool.mapDependencies.empty());
+    BOOST_CHECK(testPool.mapDependents.empty());
+}
+
+static CMutableTransaction MempoolTestTx(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vin[0].prevout = prevout;
+    tx.resizeOut(1);
+    tx.getOut(0).scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.getOut(0).nValue = 10000LL;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+
+    // A zero fee tx whose output is spent by a certificate: both must outlive every other tx
+    CMutableTransaction txCertParent = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    CMutableScCertificate mutCert;
+    mutCert.scId = GetRandHash();
+    mutCert.vin.resize(1);
+    mutCert.vin[0].scriptSig = CScript() << OP_11;
+    mutCert.vin[0].prevout = COutPoint(txCertParent.GetHash(), 0);
+    mutCert.addOut(CTxOut(5000LL, CScript() << OP_11 << OP_EQUAL));
+    CScCertificate cert(mutCert);
+
+    testPool.addUnchecked(txCertParent.GetHash(), CTxMemPoolEntry(txCertParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(cert.GetHash(), CCertificateMemPoolEntry(cert, 0, 0, 0.0, 1));
+    size_t nCertUsage = testPool.DynamicMemoryUsage();
+
+    // A well paying parent with a free child, and two independent txs
+    CMutableTransaction txParent = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    CMutableTransaction txChild = MempoolTestTx(COutPoint(txParent.GetHash(), 0));
+    CMutableTransaction txLow = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    CMutableTransaction txHigh = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 10000LL, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txLow.GetHash(), CTxMemPoolEntry(txLow, 1000LL, 0, 0.0, 1));
+    testPool.addUnchecked(txHigh.GetHash(), CTxMemPoolEntry(txHigh, 100000LL, 0, 0.0, 1));
+    BOOST_CHECK_EQUAL(testPool.GetMinFee(1).GetFeePerK(), 0);
+
+    // Under the limit nothing happens
+    testPool.TrimToSize(testPool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(testPool.size(), 6);
+
+    // The free child goes first, on its own
+    testPool.TrimToSize(testPool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!testPool.existsTx(txChild.GetHash()));
+    BOOST_CHECK(testPool.existsTx(txParent.GetHash()));
+    BOOST_CHECK(testPool.existsTx(txLow.GetHash()));
+    BOOST_CHECK_EQUAL(testPool.GetEvictedTxs(), 1);
+    BOOST_CHECK(testPool.mapDependents.count(txParent.GetHash()) == 0);
+
+    // Then txLow, which paid less than txParent
+    testPool.TrimToSize(testPool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!testPool.existsTx(txLow.GetHash()));
+    BOOST_CHECK(testPool.existsTx(txParent.GetHash()));
+    BOOST_CHECK(testPool.existsTx(txHigh.GetHash()));
+
+    // All other txs are evicted before the zero fee certificate package
+    testPool.TrimToSize(nCertUsage);
+    BOOST_CHECK_EQUAL(testPool.sizeTx(), 1);
+    BOOST_CHECK(testPool.existsTx(txCertParent.GetHash()));
+    BOOST_CHECK(testPool.existsCert(cert.GetHash()));
+    BOOST_CHECK_EQUAL(testPool.GetEvictedTxs(), 4);
+    BOOST_CHECK_EQUAL(testPool.GetEvictedCerts(), 0);
+
+    // The pool now wants more than txHigh paid, until blocks let the minimum decay
+    CFeeRate highRate(100000LL, ::GetSerializeSize(CTransaction(txHigh), SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK(testPool.GetMinFee(1) > highRate);
+
+    // With no room at all the certificate finally goes, together with the tx it spends
+    testPool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(testPool.size(), 0);
+    BOOST_CHECK_EQUAL(testPool.GetEvictedTxs(), 5);
+    BOOST_CHECK_EQUAL(testPool.GetEvictedCerts(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolExpireTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+
+    CMutableTransaction txOld = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    CMutableTransaction txOldChild = MempoolTestTx(COutPoint(txOld.GetHash(), 0));
+    CMutableTransaction txNew = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    testPool.addUnchecked(txOld.GetHash(), CTxMemPoolEntry(txOld, 0, 100, 0.0, 1));
+    testPool.addUnchecked(txOldChild.GetHash(), CTxMemPoolEntry(txOldChild, 0, 300, 0.0, 1));
+    testPool.addUnchecked(txNew.GetHash(), CTxMemPoolEntry(txNew, 0, 300, 0.0, 1));
+
+    // The old tx takes its younger child with it
+    BOOST_CHECK_EQUAL(testPool.Expire(200), 2);
+    BOOST_CHECK_EQUAL(testPool.size(), 1);
+    BOOST_CHECK(testPool.existsTx(txNew.GetHash()));
+    BOOST_CHECK_EQUAL(testPool.GetExpiredTxs(), 2);
+    BOOST_CHECK_EQUAL(testPool.Expire(200), 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolTrimPackageScoreTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+
+    // A free parent paid for by its child, and an independent tx paying less than the pair
+    CMutableTransaction txParent = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    CMutableTransaction txChild = MempoolTestTx(COutPoint(txParent.GetHash(), 0));
+    CMutableTransaction txLow = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 20000LL, 0, 0.0, 1));
+    testPool.addUnchecked(txLow.GetHash(), CTxMemPoolEntry(txLow, 1000LL, 0, 0.0, 1));
+
+    testPool.TrimToSize(testPool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!testPool.existsTx(txLow.GetHash()));
+    BOOST_CHECK(testPool.existsTx(txParent.GetHash()));
+    BOOST_CHECK(testPool.existsTx(txChild.GetHash()));
+
+    // Prioritisation moves an entry in the eviction order
+    CMutableTransaction txPrioritised = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    testPool.addUnchecked(txPrioritised.GetHash(), CTxMemPoolEntry(txPrioritised, 0, 0, 0.0, 1));
+    testPool.PrioritiseTransaction(txPrioritised.GetHash(), txPrioritised.GetHash().ToString(), 0.0, 100000LL);
+    testPool.TrimToSize(testPool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(testPool.existsTx(txPrioritised.GetHash()));
+    BOOST_CHECK(!testPool.existsTx(txParent.GetHash()));
+    BOOST_CHECK(!testPool.existsTx(txChild.GetHash()));
+    BOOST_CHECK_EQUAL(testPool.GetEvictedTxs(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorPackageTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+
+    // A free parent paid for by its child
+    CMutableTransaction txParent = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    CMutableTransaction txChild = MempoolTestTx(COutPoint(txParent.GetHash(), 0));
+    CMutableTransaction txOther = MempoolTestTx(COutPoint(GetRandHash(), 0));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 20000LL, 0, 0.0, 1));
+    testPool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 1000LL, 0, 0.0, 1));
+
+    unsigned int nTxSize = ::GetSerializeSize(CTransaction(txParent), SER_NETWORK, PROTOCOL_VERSION);
+    const CTxMemPoolAncestorState& childState = testPool.mapAncestorState[txChild.GetHash()];
+    BOOST_CHECK_EQUAL(childState.nCountWithAncestors, 2);
+    BOOST_CHECK_EQUAL(childState.nSizeWithAncestors, 2 * nTxSize);
+    BOOST_CHECK_EQUAL(childState.nModFeesWithAncestors, 20000LL);
+    BOOST_CHECK(testPool.setTxByAncestorFeeRate.rbegin()->second == txChild.GetHash());
+
+    // Prioritising the parent raises the package of the child too
+    testPool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 50000LL);
+    BOOST_CHECK_EQUAL(testPool.mapAncestorState[txChild.GetHash()].nModFeesWithAncestors, 70000LL);
+    BOOST_CHECK(testPool.setTxByAncestorFeeRate.rbegin()->second == txParent.GetHash());
+
+    // Parent mined: the child is a package on its own
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    testPool.remove(txParent, removedTxs, removedCerts, false);
+    BOOST_CHECK_EQUAL(testPool.mapAncestorState[txChild.GetHash()].nCountWithAncestors, 1);
+    BOOST_CHECK_EQUAL(testPool.mapAncestorState[txChild.GetHash()].nModFeesWithAncestors, 20000LL);
+    BOOST_CHECK_EQUAL(testPool.setTxByAncestorFeeRate.size(), 2);
+
+    // Certificates are found by sidechain and epoch
+    CMutableScCertificate mutCert;
+    mutCert.scId = GetRandHash();
+    mutCert.epochNumber = 3;
+    mutCert.vin.resize(1);
+    mutCert.vin[0].scriptSig = CScript() << OP_11;
+    mutCert.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    mutCert.addOut(CTxOut(5000LL, CScript() << OP_11 << OP_EQUAL));
+    CScCertificate cert(mutCert);
+    testPool.addUnchecked(cert.GetHash(), CCertificateMemPoolEntry(cert, 0, 0, 0.0, 1));
+    BOOST_CHECK(testPool.mapCertByScEpoch[std::make_pair(cert.GetScId(), 3)] == cert.GetHash());
+
+    testPool.remove(txChild, removedTxs, removedCerts, true);
+    BOOST_CHECK(testPool.mapCertByScEpoch.empty());
+    BOOST_CHECK_EQUAL(testPool.mapAncestorState.size(), 1);
+    BOOST_CHECK_EQUAL(testPool.setTxByAncestorFeeRate.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMaturityIndexTest)
+{
+    CTxMemPool testPool(CFeeRate(0));
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.resizeOut(1);
+    coinbase.getOut(0).scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    coinbase.getOut(0).nValue = 50000LL;
+    view.ModifyCoins(coinbase.GetHash())->From(CTransaction(coinbase), 10);
+
+    CMutableTransaction txSpend = MempoolTestTx(COutPoint(coinbase.GetHash(), 0));
+    testPool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, 0, 0.0, 1), true, &view);
+
+    // Spendable from height 10 + COINBASE_MATURITY on
+    testPool.removeImmatureExpenditures(&view, 10 + COINBASE_MATURITY);
+    BOOST_CHECK(testPool.existsTx(txSpend.GetHash()));
+
+    // Only entries indexed above the new height are checked again: the coin changing under the
+    // pool does not matter until a disconnect goes below its recorded maturity
+    view.ModifyCoins(coinbase.GetHash())->nHeight = 50;
+    testPool.removeImmatureExpenditures(&view, 10 + COINBASE_MATURITY);
+    BOOST_CHECK(testPool.existsTx(txSpend.GetHash()));
+
+    testPool.removeImmatureExpenditures(&view, 10 + COINBASE_MATURITY - 1);
+    BOOST_CHECK(!testPool.existsTx(txSpend.GetHash()));
+
+    // Without a view the entry is checked by the next call, whatever the height
+    view.ModifyCoins(coinbase.GetHash())->nHeight = 10;
+    testPool.addUnchecked(txSpend.GetHash(), CTxMemPoolEntry(txSpend, 0, 0, 0.0, 1));
+    testPool.removeImmatureExpenditures(&view, 10 + COINBASE_MATURITY + 100);
+    BOOST_CHECK(testPool.existsTx(txSpend.GetHash()));
+    testPool.removeImmatureExpenditures(&view, 10 + COINBASE_MATURITY - 1);
+    BOOST_CHECK(!testPool.existsTx(txSpend.GetHash()));
+    BOOST_CHECK_EQUAL(testPool.size(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -68,6 +68,7 @@ BasicTestingSetup::BasicTestingSetup()
     fPrintToDebugLog = false; // don't want to write to debug.log file
     fCheckBlockIndex = true;
     SelectParams(CBaseChainParams::MAIN);
+    InitSignatureCache();
 }
 BasicTestingSetup::~BasicTestingSetup()
 {
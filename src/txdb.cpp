@@ -101,10 +101,12 @@ void static BatchWriteHashBestAnchor(CLevelDBBatch &batch, const uint256 &hash)
     batch.Write(DB_BEST_ANCHOR, hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) :
+    db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe), fScIdsCatalogLoaded(false) {
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) :
+    db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), fScIdsCatalogLoaded(false) {
 }
 
 
@@ -155,10 +157,20 @@ bool CCoinsViewDB::GetSidechainEvents(int height, CSidechainEvents& ceasingScs)
     return db.Read(std::make_pair(DB_CEASEDSCS, height), ceasingScs);
 }
 
-void CCoinsViewDB::GetScIds(std::set<uint256>& scIdsList) const
+void CCoinsViewDB::LoadScIdsCatalog() const
 {
+    AssertLockHeld(csScIdsCatalog);
+    if (fScIdsCatalogLoaded)
+        return;
+
+    // sidechain keys are contiguous in the db, seek straight to the first one
+    // and stop as soon as we step out of the DB_SIDECHAINS key range
     std::unique_ptr<leveldb::Iterator> it(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    for (it->SeekToFirst(); it->Valid(); it->Next())
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_SIDECHAINS, uint256());
+
+    scIdsCatalog.clear();
+    for (it->Seek(ssKeySet.str()); it->Valid(); it->Next())
     {
         boost::this_thread::interruption_point();
 
@@ -166,15 +178,23 @@ void CCoinsViewDB::GetScIds(std::set<uint256>& scIdsList) const
         CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
         char chType;
         ssKey >> chType;
-        if (chType == DB_SIDECHAINS)
-        {
-            uint256 keyScId;
-            ssKey >> keyScId;
-            scIdsList.insert(keyScId);
-            LogPrint("sc", "%s():%d - scId[%s] added in map\n", __func__, __LINE__, keyScId.ToString() );
-        }
+        if (chType != DB_SIDECHAINS)
+            break;
+
+        uint256 keyScId;
+        ssKey >> keyScId;
+        scIdsCatalog.insert(keyScId);
+        LogPrint("sc", "%s():%d - scId[%s] added in map\n", __func__, __LINE__, keyScId.ToString() );
     }
 
+    fScIdsCatalogLoaded = true;
+}
+
+void CCoinsViewDB::GetScIds(std::set<uint256>& scIdsList) const
+{
+    LOCK(csScIdsCatalog);
+    LoadScIdsCatalog();
+    scIdsList = scIdsCatalog;
     return;
 }
 
@@ -199,48 +219,61 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
                               CNullifiersMap &mapNullifiers,
                               CSidechainsMap& mapSidechains,
                               CSidechainEventsMap& mapSidechainEvents) {
+    bool fOk = WriteSnapshot(mapCoins, hashBlock, hashAnchor, mapAnchors, mapNullifiers, mapSidechains, mapSidechainEvents);
+    mapCoins.clear();
+    mapAnchors.clear();
+    mapNullifiers.clear();
+    mapSidechains.clear();
+    mapSidechainEvents.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::WriteSnapshot(const CCoinsMap &mapCoins,
+                                 const uint256 &hashBlock,
+                                 const uint256 &hashAnchor,
+                                 const CAnchorsMap &mapAnchors,
+                                 const CNullifiersMap &mapNullifiers,
+                                 const CSidechainsMap& mapSidechains,
+                                 const CSidechainEventsMap& mapSidechainEvents,
+                                 size_t* pnBytesWritten) {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             BatchWriteCoins(batch, it->first, it->second.coins);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
     }
 
-    for (CAnchorsMap::iterator it = mapAnchors.begin(); it != mapAnchors.end();) {
+    for (CAnchorsMap::const_iterator it = mapAnchors.begin(); it != mapAnchors.end(); ++it) {
         if (it->second.flags & CAnchorsCacheEntry::DIRTY) {
             BatchWriteAnchor(batch, it->first, it->second.tree, it->second.entered);
             // TODO: changed++?
         }
-        CAnchorsMap::iterator itOld = it++;
-        mapAnchors.erase(itOld);
     }
 
-    for (CNullifiersMap::iterator it = mapNullifiers.begin(); it != mapNullifiers.end();) {
+    for (CNullifiersMap::const_iterator it = mapNullifiers.begin(); it != mapNullifiers.end(); ++it) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             BatchWriteNullifier(batch, it->first, it->second.entered);
             // TODO: changed++?
         }
-        CNullifiersMap::iterator itOld = it++;
-        mapNullifiers.erase(itOld);
     }
 
-    for (CSidechainsMap::iterator it = mapSidechains.begin(); it != mapSidechains.end();) {
+    // catalog changes are applied only once the batch has been committed
+    std::set<uint256> scIdsAdded;
+    std::set<uint256> scIdsErased;
+    for (CSidechainsMap::const_iterator it = mapSidechains.begin(); it != mapSidechains.end(); ++it) {
         BatchSidechains(batch, it->first, it->second);
-        CSidechainsMap::iterator itOld = it++;
-        mapSidechains.erase(itOld);
+        if (it->second.flag == CSidechainsCacheEntry::Flags::FRESH || it->second.flag == CSidechainsCacheEntry::Flags::DIRTY)
+            scIdsAdded.insert(it->first);
+        else if (it->second.flag == CSidechainsCacheEntry::Flags::ERASED)
+            scIdsErased.insert(it->first);
     }
 
-    for (CSidechainEventsMap::iterator it = mapSidechainEvents.begin(); it != mapSidechainEvents.end();) {
+    for (CSidechainEventsMap::const_iterator it = mapSidechainEvents.begin(); it != mapSidechainEvents.end(); ++it)
         BatchCeasedScs(batch, it->first, it->second);
-        CSidechainEventsMap::iterator itOld = it++;
-        mapSidechainEvents.erase(itOld);
-    }
 
     if (!hashBlock.IsNull())
         BatchWriteHashBestChain(batch, hashBlock);
@@ -248,7 +281,283 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
         BatchWriteHashBestAnchor(batch, hashAnchor);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+
+    if (pnBytesWritten)
+        *pnBytesWritten = batch.SizeEstimate();
+
+    {
+        LOCK(csScIdsCatalog);
+        if (fScIdsCatalogLoaded) {
+            for(const uint256& scId: scIdsErased)
+                scIdsCatalog.erase(scId);
+            scIdsCatalog.insert(scIdsAdded.begin(), scIdsAdded.end());
+        }
+    }
+    return true;
+}
+
+CCoinsViewFlushBuffer::CCoinsViewFlushBuffer(CCoinsViewDB* dbIn) :
+    db(dbIn), fInFlight(false), fWriteFailed(false), fStop(false)
+{
+    writerThread = boost::thread(boost::bind(&CCoinsViewFlushBuffer::ThreadWriter, this));
+}
+
+CCoinsViewFlushBuffer::~CCoinsViewFlushBuffer()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWriter.notify_all();
+    // the writer commits the pending snapshot, if any, before leaving
+    writerThread.join();
+}
+
+void CCoinsViewFlushBuffer::ThreadWriter()
+{
+    RenameThread("horizen-coinsflush");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (!fInFlight && !fStop)
+            condWriter.wait(lock);
+        if (!fInFlight)
+            return;
+
+        // Nobody modifies the snapshot while it is in flight, so the batch can be built
+        // without holding the lock and concurrent lookups only contend on the final swap.
+        lock.unlock();
+        int64_t nStart = GetTimeMicros();
+        size_t nBytes = 0;
+        bool fOk = false;
+        try {
+            fOk = db->WriteSnapshot(snapCoins, snapBestBlock, snapBestAnchor, snapAnchors, snapNullifiers,
+                                    snapSidechains, snapSidechainEvents, &nBytes);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: error writing coins snapshot: %s\n", __func__, e.what());
+        }
+        int64_t nDuration = GetTimeMicros() - nStart;
+
+        CCoinsMap oldCoins;
+        CAnchorsMap oldAnchors;
+        CNullifiersMap oldNullifiers;
+        CSidechainsMap oldSidechains;
+        CSidechainEventsMap oldSidechainEvents;
+        lock.lock();
+        if (fOk) {
+            // the db now holds this state: drop the snapshot, deallocating it out of the lock below
+            oldCoins.swap(snapCoins);
+            oldAnchors.swap(snapAnchors);
+            oldNullifiers.swap(snapNullifiers);
+            oldSidechains.swap(snapSidechains);
+            oldSidechainEvents.swap(snapSidechainEvents);
+            snapBestBlock.SetNull();
+            snapBestAnchor.SetNull();
+
+            stats.nFlushes++;
+            stats.nLastDurationMicros = nDuration;
+            stats.nLastBytes = nBytes;
+            stats.nTotalBytes += nBytes;
+        } else {
+            // keep serving the snapshot, the failure is reported by the next BatchWrite/Sync
+            fWriteFailed = true;
+        }
+        fInFlight = false;
+        condDone.notify_all();
+        lock.unlock();
+
+        LogPrint("coindb", "%s: committed %u coins (%u bytes) in %.2fms\n", __func__,
+            (unsigned int)oldCoins.size(), (unsigned int)nBytes, nDuration * 0.001);
+        {
+            // free the committed snapshot before waiting for the next one
+            CCoinsMap().swap(oldCoins);
+            CAnchorsMap().swap(oldAnchors);
+            CNullifiersMap().swap(oldNullifiers);
+            CSidechainsMap().swap(oldSidechains);
+            CSidechainEventsMap().swap(oldSidechainEvents);
+        }
+        lock.lock();
+    }
+}
+
+bool CCoinsViewFlushBuffer::WaitIdle(boost::unique_lock<boost::mutex>& lock) const
+{
+    while (fInFlight)
+        condDone.wait(lock);
+    return !fWriteFailed;
+}
+
+bool CCoinsViewFlushBuffer::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CAnchorsMap::const_iterator it = snapAnchors.find(rt);
+        if (it != snapAnchors.end()) {
+            if (!it->second.entered)
+                return false;
+            tree = it->second.tree;
+            return true;
+        }
+    }
+    return db->GetAnchorAt(rt, tree);
+}
+
+bool CCoinsViewFlushBuffer::GetNullifier(const uint256 &nf) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CNullifiersMap::const_iterator it = snapNullifiers.find(nf);
+        if (it != snapNullifiers.end())
+            return it->second.entered;
+    }
+    return db->GetNullifier(nf);
+}
+
+bool CCoinsViewFlushBuffer::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = snapCoins.find(txid);
+        if (it != snapCoins.end()) {
+            // pruned entries are erased from the db once the snapshot is committed
+            if (it->second.coins.IsPruned())
+                return false;
+            coins = it->second.coins;
+            return true;
+        }
+    }
+    return db->GetCoins(txid, coins);
+}
+
+bool CCoinsViewFlushBuffer::HaveCoins(const uint256 &txid) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CCoinsMap::const_iterator it = snapCoins.find(txid);
+        if (it != snapCoins.end())
+            return !it->second.coins.IsPruned();
+    }
+    return db->HaveCoins(txid);
+}
+
+bool CCoinsViewFlushBuffer::GetSidechain(const uint256& scId, CSidechain& info) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CSidechainsMap::const_iterator it = snapSidechains.find(scId);
+        if (it != snapSidechains.end()) {
+            if (it->second.flag == CSidechainsCacheEntry::Flags::ERASED)
+                return false;
+            info = it->second.scInfo;
+            return true;
+        }
+    }
+    return db->GetSidechain(scId, info);
+}
+
+bool CCoinsViewFlushBuffer::HaveSidechain(const uint256& scId) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CSidechainsMap::const_iterator it = snapSidechains.find(scId);
+        if (it != snapSidechains.end())
+            return it->second.flag != CSidechainsCacheEntry::Flags::ERASED;
+    }
+    return db->HaveSidechain(scId);
+}
+
+bool CCoinsViewFlushBuffer::HaveSidechainEvents(int height) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CSidechainEventsMap::const_iterator it = snapSidechainEvents.find(height);
+        if (it != snapSidechainEvents.end())
+            return it->second.flag != CSidechainEventsCacheEntry::Flags::ERASED;
+    }
+    return db->HaveSidechainEvents(height);
+}
+
+bool CCoinsViewFlushBuffer::GetSidechainEvents(int height, CSidechainEvents& scEvents) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CSidechainEventsMap::const_iterator it = snapSidechainEvents.find(height);
+        if (it != snapSidechainEvents.end()) {
+            if (it->second.flag == CSidechainEventsCacheEntry::Flags::ERASED)
+                return false;
+            scEvents = it->second.scEvents;
+            return true;
+        }
+    }
+    return db->GetSidechainEvents(height, scEvents);
+}
+
+void CCoinsViewFlushBuffer::GetScIds(std::set<uint256>& scIdsList) const {
+    // keep the snapshot alive while reading the db catalog, so that the two are not
+    // taken on different sides of a commit
+    boost::unique_lock<boost::mutex> lock(mutex);
+    db->GetScIds(scIdsList);
+    for (const auto& entry: snapSidechains) {
+        if (entry.second.flag == CSidechainsCacheEntry::Flags::ERASED)
+            scIdsList.erase(entry.first);
+        else
+            scIdsList.insert(entry.first);
+    }
+}
+
+uint256 CCoinsViewFlushBuffer::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!snapBestBlock.IsNull())
+            return snapBestBlock;
+    }
+    return db->GetBestBlock();
+}
+
+uint256 CCoinsViewFlushBuffer::GetBestAnchor() const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!snapBestAnchor.IsNull())
+            return snapBestAnchor;
+    }
+    return db->GetBestAnchor();
+}
+
+bool CCoinsViewFlushBuffer::BatchWrite(CCoinsMap &mapCoins,
+                                       const uint256 &hashBlock,
+                                       const uint256 &hashAnchor,
+                                       CAnchorsMap &mapAnchors,
+                                       CNullifiersMap &mapNullifiers,
+                                       CSidechainsMap& mapSidechains,
+                                       CSidechainEventsMap& mapSidechainEvents) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!WaitIdle(lock))
+        return false;
+
+    // The previous snapshot is gone, hand the empty maps back to the caller
+    snapCoins.swap(mapCoins);
+    snapAnchors.swap(mapAnchors);
+    snapNullifiers.swap(mapNullifiers);
+    snapSidechains.swap(mapSidechains);
+    snapSidechainEvents.swap(mapSidechainEvents);
+    snapBestBlock = hashBlock;
+    snapBestAnchor = hashAnchor;
+    fInFlight = true;
+    condWriter.notify_one();
+    return true;
+}
+
+bool CCoinsViewFlushBuffer::GetStats(CCoinsStats &stats) const {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        WaitIdle(lock);
+    }
+    return db->GetStats(stats);
+}
+
+bool CCoinsViewFlushBuffer::Sync() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return WaitIdle(lock);
+}
+
+CCoinsFlushStats CCoinsViewFlushBuffer::GetFlushStats() const {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CCoinsFlushStats ret = stats;
+    ret.fInFlight = fInFlight;
+    return ret;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -406,15 +715,15 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+bool CBlockTreeDB::LoadBlockIndexShard(unsigned char chBegin, unsigned int nEnd, boost::mutex& csInsert, std::string& strError)
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
+    // Block index keys are 'b' followed by the block hash, whose first serialized byte selects the shard
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
-    ssKeySet << make_pair(DB_BLOCK_INDEX, uint256());
+    ssKeySet << DB_BLOCK_INDEX << chBegin;
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -422,14 +731,26 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == DB_BLOCK_INDEX) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
+            if (chType != DB_BLOCK_INDEX || slKey.size() < 2 || (unsigned char)slKey.data()[1] >= nEnd)
+                break; // end of this shard
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            // Hashing the header and checking its PoW is the expensive part, it is done outside the lock
+            const uint256 hash = diskindex.GetBlockHash();
+            if (!CheckProofOfWork(hash, diskindex.nBits, Params().GetConsensus())) {
+                strError = strprintf("LoadBlockIndex(): CheckProofOfWork failed: %s", hash.ToString());
+                return false;
+            }
+
+            {
+                boost::unique_lock<boost::mutex> lock(csInsert);
 
                 // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = InsertBlockIndex(hash);
                 pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -441,23 +762,57 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nTime          = diskindex.nTime;
                 pindexNew->nBits          = diskindex.nBits;
                 pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
+                pindexNew->nSolution.swap(diskindex.nSolution);
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
                 pindexNew->nSproutValue   = diskindex.nSproutValue;
                 pindexNew->hashScTxsCommitment = diskindex.hashScTxsCommitment;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
             }
+
+            pcursor->Next();
         } catch (const std::exception& e) {
-            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            strError = strprintf("%s: Deserialize or I/O error - %s", __func__, e.what());
+            return false;
         }
     }
 
     return true;
 }
+
+bool CBlockTreeDB::LoadBlockIndexGuts()
+{
+    const int64_t nStart = GetTimeMillis();
+    const size_t nSizeBefore = mapBlockIndex.size();
+
+    // Split the block index key range in shards and load them in parallel
+    const unsigned int nShards = std::max(1, std::min(GetNumCores(), 16));
+    boost::mutex csInsert;
+    std::vector<std::string> vErrors(nShards);
+    std::vector<char> vResults(nShards, 1);
+
+    boost::thread_group loaders;
+    for (unsigned int i = 0; i < nShards; i++) {
+        const unsigned char chBegin = (unsigned char)(i * 256 / nShards);
+        const unsigned int nEnd = (i + 1) * 256 / nShards;
+        loaders.create_thread([this, i, chBegin, nEnd, &csInsert, &vErrors, &vResults] {
+            vResults[i] = LoadBlockIndexShard(chBegin, nEnd, csInsert, vErrors[i]) ? 1 : 0;
+        });
+    }
+    try {
+        loaders.join_all();
+    } catch (const boost::thread_interrupted&) {
+        // shutdown requested, the loaders use this stack frame: stop them before leaving
+        loaders.interrupt_all();
+        loaders.join_all();
+        throw;
+    }
+
+    for (unsigned int i = 0; i < nShards; i++) {
+        if (!vResults[i])
+            return error("%s", vErrors[i]);
+    }
+
+    LogPrintf("%s: loaded %u block index entries using %u threads in %dms\n", __func__,
+        mapBlockIndex.size() - nSizeBefore, nShards, GetTimeMillis() - nStart);
+    return true;
+}
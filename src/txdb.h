@@ -8,12 +8,16 @@
 
 #include "coins.h"
 #include "leveldbwrapper.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlockFileInfo;
 class CBlockIndex;
 struct CDiskTxPos;
@@ -32,6 +36,16 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CLevelDBWrapper db;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /**
+     * In-memory catalog of the sidechain ids persisted in the db. It is loaded lazily
+     * via a prefix seek on the first GetScIds call and then kept aligned in BatchWrite,
+     * so that listing sidechains does not need to walk the whole chainstate.
+     */
+    mutable CCriticalSection csScIdsCatalog;
+    mutable std::set<uint256> scIdsCatalog;
+    mutable bool fScIdsCatalogLoaded;
+    void LoadScIdsCatalog() const;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -55,6 +69,99 @@ public:
                     CSidechainEventsMap& mapSidechainEvents)                 override;
     bool GetStats(CCoinsStats &stats)                                  const override;
     void Dump_info() const;
+
+    //! Same as BatchWrite, but leaves the passed maps untouched so they can be read concurrently
+    bool WriteSnapshot(const CCoinsMap &mapCoins,
+                       const uint256 &hashBlock,
+                       const uint256 &hashAnchor,
+                       const CAnchorsMap &mapAnchors,
+                       const CNullifiersMap &mapNullifiers,
+                       const CSidechainsMap& mapSidechains,
+                       const CSidechainEventsMap& mapSidechainEvents,
+                       size_t* pnBytesWritten = nullptr);
+};
+
+struct CCoinsFlushStats
+{
+    //! background writes committed so far
+    uint64_t nFlushes;
+    //! time spent building and committing the last batch
+    int64_t nLastDurationMicros;
+    //! approximate size of the last batch
+    uint64_t nLastBytes;
+    //! approximate size of all the batches committed so far
+    uint64_t nTotalBytes;
+    //! a snapshot is currently being written
+    bool fInFlight;
+
+    CCoinsFlushStats() : nFlushes(0), nLastDurationMicros(0), nLastBytes(0), nTotalBytes(0), fInFlight(false) {}
+};
+
+/**
+ * Double buffer between the coins cache and the LevelDB coin database.
+ *
+ * BatchWrite does not touch the disk: it takes ownership of the flushed maps as an
+ * in-flight snapshot and wakes a dedicated writer thread, which builds and commits the
+ * LevelDB batch while the caller goes on with an empty front cache. Until the commit
+ * is done, lookups are answered from the snapshot first and from the db otherwise.
+ * A new BatchWrite waits for the previous snapshot to be committed, so at most one
+ * write is in flight; Sync() waits for it too and reports its outcome.
+ */
+class CCoinsViewFlushBuffer : public CCoinsView
+{
+private:
+    CCoinsViewDB* db;
+
+    mutable boost::mutex mutex;
+    mutable boost::condition_variable condWriter;
+    mutable boost::condition_variable condDone;
+
+    //! the snapshot is only modified by the writer thread or while no write is in flight
+    CCoinsMap snapCoins;
+    CAnchorsMap snapAnchors;
+    CNullifiersMap snapNullifiers;
+    CSidechainsMap snapSidechains;
+    CSidechainEventsMap snapSidechainEvents;
+    uint256 snapBestBlock;
+    uint256 snapBestAnchor;
+
+    bool fInFlight;
+    bool fWriteFailed;
+    bool fStop;
+    CCoinsFlushStats stats;
+    boost::thread writerThread;
+
+    void ThreadWriter();
+    //! Wait for the in-flight snapshot to be committed, mutex must be held
+    bool WaitIdle(boost::unique_lock<boost::mutex>& lock) const;
+
+public:
+    CCoinsViewFlushBuffer(CCoinsViewDB* dbIn);
+    ~CCoinsViewFlushBuffer();
+
+    bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const override;
+    bool GetNullifier(const uint256 &nf)                               const override;
+    bool GetCoins(const uint256 &txid, CCoins &coins)                  const override;
+    bool HaveCoins(const uint256 &txid)                                const override;
+    bool GetSidechain(const uint256& scId, CSidechain& info)           const override;
+    bool HaveSidechain(const uint256& scId)                            const override;
+    bool HaveSidechainEvents(int height)                               const override;
+    bool GetSidechainEvents(int height, CSidechainEvents& scEvents)    const override;
+    void GetScIds(std::set<uint256>& scIdsList)                        const override;
+    uint256 GetBestBlock()                                             const override;
+    uint256 GetBestAnchor()                                            const override;
+    bool BatchWrite(CCoinsMap &mapCoins,
+                    const uint256 &hashBlock,
+                    const uint256 &hashAnchor,
+                    CAnchorsMap &mapAnchors,
+                    CNullifiersMap &mapNullifiers,
+                    CSidechainsMap& mapSidechains,
+                    CSidechainEventsMap& mapSidechainEvents)                 override;
+    bool GetStats(CCoinsStats &stats)                                  const override;
+
+    //! Wait until the in-flight snapshot, if any, is on disk. Returns false if writing it failed.
+    bool Sync();
+    CCoinsFlushStats GetFlushStats() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -76,6 +183,10 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
+
+private:
+    //! Load the block index entries whose hash first serialized byte is in [chBegin, nEnd)
+    bool LoadBlockIndexShard(unsigned char chBegin, unsigned int nEnd, boost::mutex& csInsert, std::string& strError);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -18,6 +18,10 @@
 #include "main.h"
 #include <undo.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 CMemPoolEntry::CMemPoolEntry():
     nFee(0), nModSize(0), nUsageSize(0), nTime(0), dPriority(0.0)
 {
@@ -92,7 +96,8 @@ CCertificateMemPoolEntry::GetPriority(unsigned int currentHeight) const
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minRelayFee) :
-    nTransactionsUpdated(0), nCertificatesUpdated(0), cachedInnerUsage(0)
+    nTransactionsUpdated(0), nCertificatesUpdated(0), cachedInnerUsage(0),
+    lastRollingFeeUpdate(GetTime()), blockSinceLastRollingFeeBump(false), rollingMinimumFeeRate(0)
 {
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -133,7 +138,8 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
-bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate)
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate,
+                              const CCoinsViewCache *pcoins)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
@@ -165,6 +171,11 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         mapSidechains[fwd.scId].fwdTransfersSet.insert(hash);
     }
 
+    addDependencies(hash, tx);
+    addMaturity(hash, tx, pcoins);
+    addEvictionIndex(hash);
+    addAncestorState(hash);
+
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
@@ -174,7 +185,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     return true;
 }
 
-bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntry &entry, bool fCurrentEstimate)
+bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntry &entry, bool fCurrentEstimate,
+                              const CCoinsViewCache *pcoins)
 {
     LOCK(cs);
     mapCertificate[hash] = entry;
@@ -188,7 +200,12 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntr
 
     LogPrint("mempool", "%s():%d - adding [%s] in mapSidechain\n", __func__, __LINE__, cert.GetScId().ToString() );
     mapSidechains[cert.GetScId()].backwardCertificate = hash;
-           
+
+    addDependencies(hash, cert);
+    addMaturity(hash, cert, pcoins);
+    addEvictionIndex(hash);
+    mapCertByScEpoch[std::make_pair(cert.GetScId(), cert.epochNumber)] = hash;
+
     nCertificatesUpdated++;
     totalCertificateSize += entry.GetCertificateSize();
     cachedInnerUsage += entry.DynamicMemoryUsage();
@@ -198,6 +215,122 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CCertificateMemPoolEntr
     return true;
 }
 
+void CTxMemPool::addDependency(const uint256& parentHash, const uint256& childHash)
+{
+    if (parentHash == childHash)
+        return;
+    if (mapDependencies[childHash].insert(parentHash).second)
+        nDependencyLinks++;
+    mapDependents[parentHash].insert(childHash);
+}
+
+void CTxMemPool::addDependencies(const uint256& hash, const CTransactionBase& txBase)
+{
+    // what the new object spends...
+    for (const CTxIn& txin: txBase.GetVin()) {
+        if (mapTx.count(txin.prevout.hash) || mapCertificate.count(txin.prevout.hash))
+            addDependency(txin.prevout.hash, hash);
+    }
+
+    // ...and who already spends it, which happens when it is resurrected from a disconnected block
+    for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.lower_bound(COutPoint(hash, 0));
+         it != mapNextTx.end() && it->first.hash == hash; ++it)
+        addDependency(hash, it->second.ptx->GetHash());
+
+    if (txBase.IsCertificate())
+        return;
+
+    const CTransaction& tx = dynamic_cast<const CTransaction&>(txBase);
+    for (const auto& fwd: tx.GetVftCcOut()) {
+        const uint256& scCreationHash = mapSidechains.at(fwd.scId).scCreationTxHash;
+        if (!scCreationHash.IsNull())
+            addDependency(scCreationHash, hash);
+    }
+
+    for (const auto& sc: tx.GetVscCcOut()) {
+        for (const uint256& fwdTxHash: mapSidechains.at(sc.GetScId()).fwdTransfersSet)
+            addDependency(hash, fwdTxHash);
+    }
+}
+
+void CTxMemPool::removeDependencies(const uint256& hash)
+{
+    std::map<uint256, std::set<uint256> >::iterator itDeps = mapDependencies.find(hash);
+    if (itDeps != mapDependencies.end()) {
+        for (const uint256& parentHash: itDeps->second) {
+            std::map<uint256, std::set<uint256> >::iterator itParent = mapDependents.find(parentHash);
+            itParent->second.erase(hash);
+            if (itParent->second.empty())
+                mapDependents.erase(itParent);
+        }
+        nDependencyLinks -= itDeps->second.size();
+        mapDependencies.erase(itDeps);
+    }
+
+    std::map<uint256, std::set<uint256> >::iterator itDependents = mapDependents.find(hash);
+    if (itDependents != mapDependents.end()) {
+        for (const uint256& childHash: itDependents->second) {
+            std::map<uint256, std::set<uint256> >::iterator itChild = mapDependencies.find(childHash);
+            itChild->second.erase(hash);
+            nDependencyLinks--;
+            if (itChild->second.empty())
+                mapDependencies.erase(itChild);
+        }
+        mapDependents.erase(itDependents);
+    }
+}
+
+bool CTxMemPool::getMaturityHeight(const CTransactionBase& txBase, const CCoinsViewCache *pcoins, int& nMaturityHeight) const
+{
+    nMaturityHeight = 0;
+    for (const CTxIn& txin: txBase.GetVin()) {
+        if (mapTx.count(txin.prevout.hash) || mapCertificate.count(txin.prevout.hash))
+            continue;
+
+        const CCoins *coins = pcoins->AccessCoins(txin.prevout.hash);
+        if (!coins)
+            return false;
+
+        if (coins->IsCoinBase())
+            nMaturityHeight = std::max(nMaturityHeight, coins->nHeight + COINBASE_MATURITY);
+        else if (coins->IsFromCert() && (int)txin.prevout.n >= coins->nFirstBwtPos)
+            nMaturityHeight = std::max(nMaturityHeight, coins->nBwtMaturityHeight);
+        else if (coins->IsFromCert())
+            // certificate change is spendable right away, but is back in the pool if its block is disconnected
+            nMaturityHeight = std::max(nMaturityHeight, coins->nHeight + 1);
+    }
+    return true;
+}
+
+void CTxMemPool::addMaturity(const uint256& hash, const CTransactionBase& txBase, const CCoinsViewCache *pcoins)
+{
+    int nMaturityHeight = 0;
+    if (pcoins == nullptr || !getMaturityHeight(txBase, pcoins, nMaturityHeight)) {
+        setMaturityUnknown.insert(hash);
+        return;
+    }
+
+    if (nMaturityHeight == 0)
+        return;
+    mapMaturityHeight[nMaturityHeight].insert(hash);
+    mapEntryMaturityHeight[hash] = nMaturityHeight;
+}
+
+void CTxMemPool::removeMaturity(const uint256& hash)
+{
+    setMaturityUnknown.erase(hash);
+
+    std::map<uint256, int>::iterator it = mapEntryMaturityHeight.find(hash);
+    if (it == mapEntryMaturityHeight.end())
+        return;
+
+    std::map<int, std::set<uint256> >::iterator itHeight = mapMaturityHeight.find(it->second);
+    itHeight->second.erase(hash);
+    if (itHeight->second.empty())
+        mapMaturityHeight.erase(itHeight);
+    mapEntryMaturityHeight.erase(it);
+}
+
 void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -300,6 +433,10 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
                 cachedInnerUsage -= mapTx[hash].DynamicMemoryUsage();
  
                 LogPrint("mempool", "%s():%d - removing tx [%s] from mempool\n", __func__, __LINE__, hash.ToString() );
+                removeAncestorState(hash);
+                removeDependencies(hash);
+                removeMaturity(hash);
+                removeEvictionIndex(hash);
                 mapTx.erase(hash);
  
                 nTransactionsUpdated++;
@@ -334,6 +471,13 @@ void CTxMemPool::remove(const CTransactionBase& origTx, std::list<CTransaction>&
                 totalCertificateSize -= mapCertificate[hash].GetCertificateSize();
                 cachedInnerUsage -= mapCertificate[hash].DynamicMemoryUsage();
                 LogPrint("mempool", "%s():%d - removing cert [%s] from mempool\n", __func__, __LINE__, hash.ToString() );
+                std::map<std::pair<uint256, int32_t>, uint256>::iterator itScEpoch =
+                    mapCertByScEpoch.find(std::make_pair(cert.GetScId(), cert.epochNumber));
+                if (itScEpoch != mapCertByScEpoch.end() && itScEpoch->second == hash)
+                    mapCertByScEpoch.erase(itScEpoch);
+                removeDependencies(hash);
+                removeMaturity(hash);
+                removeEvictionIndex(hash);
                 mapCertificate.erase(hash);
                 nCertificatesUpdated++;
             }
@@ -449,25 +593,35 @@ inline bool CTxMemPool::checkCertImmatureExpenditures(
 
 void CTxMemPool::removeImmatureExpenditures(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight)
 {
-    // Remove transactions spending a coinbase or a certificate output which are now immature
+    // Remove transactions spending a coinbase or a certificate output which are now immature. Only the
+    // entries that were mature at a later height, and those whose maturity is not known yet, can be.
     LOCK(cs);
-    std::list<const CTransactionBase*> transactionsToRemove;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->second.GetTx();
+    std::set<uint256> setToCheck;
+    setToCheck.swap(setMaturityUnknown);
+    for (std::map<int, std::set<uint256> >::const_iterator it = mapMaturityHeight.upper_bound((int)nMemPoolHeight);
+         it != mapMaturityHeight.end(); ++it)
+        setToCheck.insert(it->second.begin(), it->second.end());
 
-        if (!checkTxImmatureExpenditures(tx, pcoins, nMemPoolHeight))
-        {
-            transactionsToRemove.push_back(&tx);
+    std::list<const CTransactionBase*> transactionsToRemove;
+    for (const uint256& hash: setToCheck) {
+        std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+        if (itTx != mapTx.end()) {
+            const CTransaction& tx = itTx->second.GetTx();
+            if (!checkTxImmatureExpenditures(tx, pcoins, nMemPoolHeight))
+                transactionsToRemove.push_back(&tx);
+            else if (!mapEntryMaturityHeight.count(hash))
+                addMaturity(hash, tx, pcoins);
+            continue;
         }
-    }
-
-    // the same for certificates
-    for (std::map<uint256, CCertificateMemPoolEntry>::const_iterator it = mapCertificate.begin(); it != mapCertificate.end(); it++) {
-        const CScCertificate& cert = it->second.GetCertificate();
 
-        if (!checkCertImmatureExpenditures(cert, pcoins, nMemPoolHeight))
-        {
-            transactionsToRemove.push_back(&cert);
+        // the same for certificates
+        std::map<uint256, CCertificateMemPoolEntry>::const_iterator itCert = mapCertificate.find(hash);
+        if (itCert != mapCertificate.end()) {
+            const CScCertificate& cert = itCert->second.GetCertificate();
+            if (!checkCertImmatureExpenditures(cert, pcoins, nMemPoolHeight))
+                transactionsToRemove.push_back(&cert);
+            else if (!mapEntryMaturityHeight.count(hash))
+                addMaturity(hash, cert, pcoins);
         }
     }
 
@@ -600,6 +754,7 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     }
     // After the txs in the new block have been removed from the mempool, update policy estimates
     minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
+    blockSinceLastRollingFeeBump = true;
 }
 
 void CTxMemPool::removeConflicts(const CScCertificate &cert,std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts) {
@@ -643,6 +798,318 @@ void CTxMemPool::removeForBlock(const std::vector<CScCertificate>& vcert, unsign
     }
 }
 
+void CTxMemPool::calculateDescendants(const uint256& hash, std::set<uint256>& setDescendants, size_t nMaxDescendants) const
+{
+    std::vector<uint256> stage(1, hash);
+    while (!stage.empty() && setDescendants.size() < nMaxDescendants) {
+        uint256 current = stage.back();
+        stage.pop_back();
+        if (!setDescendants.insert(current).second)
+            continue;
+        std::map<uint256, std::set<uint256> >::const_iterator it = mapDependents.find(current);
+        if (it != mapDependents.end())
+            stage.insert(stage.end(), it->second.begin(), it->second.end());
+    }
+}
+
+void CTxMemPool::calculateCertAncestors(std::set<uint256>& setCertAncestors) const
+{
+    std::vector<uint256> stage;
+    for (const auto& entry: mapCertificate)
+        stage.push_back(entry.first);
+    while (!stage.empty()) {
+        uint256 current = stage.back();
+        stage.pop_back();
+        if (!setCertAncestors.insert(current).second)
+            continue;
+        std::map<uint256, std::set<uint256> >::const_iterator it = mapDependencies.find(current);
+        if (it != mapDependencies.end())
+            stage.insert(stage.end(), it->second.begin(), it->second.end());
+    }
+}
+
+CFeeRate CTxMemPool::getPackageFeeRate(const std::set<uint256>& setPackage) const
+{
+    CAmount nFees = 0;
+    size_t nSize = 0;
+    for (const uint256& hash: setPackage) {
+        std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+        if (itTx != mapTx.end()) {
+            nFees += itTx->second.GetFee();
+            nSize += itTx->second.GetTxSize();
+        } else {
+            std::map<uint256, CCertificateMemPoolEntry>::const_iterator itCert = mapCertificate.find(hash);
+            assert(itCert != mapCertificate.end());
+            nFees += itCert->second.GetFee();
+            nSize += itCert->second.GetCertificateSize();
+        }
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator itDelta = mapDeltas.find(hash);
+        if (itDelta != mapDeltas.end())
+            nFees += itDelta->second.second;
+    }
+    return CFeeRate(nFees, nSize);
+}
+
+CFeeRate CTxMemPool::getModifiedFeeRate(const uint256& hash) const
+{
+    return getPackageFeeRate(std::set<uint256>{hash});
+}
+
+void CTxMemPool::addEvictionIndex(const uint256& hash)
+{
+    setEntriesByFeeRate.insert(std::make_pair(getModifiedFeeRate(hash), hash));
+    std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+    if (itTx != mapTx.end())
+        mapTxByTime.insert(std::make_pair(itTx->second.GetTime(), hash));
+}
+
+void CTxMemPool::removeEvictionIndex(const uint256& hash)
+{
+    setEntriesByFeeRate.erase(std::make_pair(getModifiedFeeRate(hash), hash));
+    std::map<uint256, CTxMemPoolEntry>::const_iterator itTx = mapTx.find(hash);
+    if (itTx == mapTx.end())
+        return;
+    auto range = mapTxByTime.equal_range(itTx->second.GetTime());
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == hash) {
+            mapTxByTime.erase(it);
+            break;
+        }
+    }
+}
+
+void CTxMemPool::CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const
+{
+    LOCK(cs);
+    std::vector<uint256> stage(1, hash);
+    while (!stage.empty()) {
+        uint256 current = stage.back();
+        stage.pop_back();
+        if (!setAncestors.insert(current).second)
+            continue;
+        std::map<uint256, std::set<uint256> >::const_iterator it = mapDependencies.find(current);
+        if (it != mapDependencies.end())
+            stage.insert(stage.end(), it->second.begin(), it->second.end());
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    LOCK(cs);
+    calculateDescendants(hash, setDescendants, std::numeric_limits<size_t>::max());
+}
+
+CAmount CTxMemPool::getModifiedFee(const uint256& hash) const
+{
+    CAmount nFee = mapTx.at(hash).GetFee();
+    std::map<uint256, std::pair<double, CAmount> >::const_iterator itDelta = mapDeltas.find(hash);
+    if (itDelta != mapDeltas.end())
+        nFee += itDelta->second.second;
+    return nFee;
+}
+
+CTxMemPoolAncestorState CTxMemPool::calculateAncestorState(const uint256& hash) const
+{
+    std::set<uint256> setAncestors;
+    CalculateAncestors(hash, setAncestors);
+
+    CTxMemPoolAncestorState state;
+    for (const uint256& ancestorHash: setAncestors) {
+        state.nCountWithAncestors++;
+        state.nSizeWithAncestors += mapTx.at(ancestorHash).GetTxSize();
+        state.nModFeesWithAncestors += getModifiedFee(ancestorHash);
+    }
+    return state;
+}
+
+void CTxMemPool::setAncestorState(const uint256& hash, const CTxMemPoolAncestorState& state)
+{
+    std::map<uint256, CTxMemPoolAncestorState>::iterator it = mapAncestorState.find(hash);
+    if (it != mapAncestorState.end()) {
+        setTxByAncestorFeeRate.erase(std::make_pair(it->second.GetFeeRate(), hash));
+        it->second = state;
+    } else {
+        mapAncestorState.insert(std::make_pair(hash, state));
+    }
+    setTxByAncestorFeeRate.insert(std::make_pair(state.GetFeeRate(), hash));
+}
+
+void CTxMemPool::addAncestorState(const uint256& hash)
+{
+    setAncestorState(hash, calculateAncestorState(hash));
+
+    // a tx resurrected from a disconnected block may already have dependents in the pool, which
+    // reach new ancestors through it: their packages are computed again
+    if (!mapDependents.count(hash))
+        return;
+    std::set<uint256> setDescendants;
+    calculateDescendants(hash, setDescendants, std::numeric_limits<size_t>::max());
+    for (const uint256& descendantHash: setDescendants) {
+        if (descendantHash != hash && mapTx.count(descendantHash))
+            setAncestorState(descendantHash, calculateAncestorState(descendantHash));
+    }
+}
+
+void CTxMemPool::removeAncestorState(const uint256& hash)
+{
+    if (!mapAncestorState.count(hash))
+        return;
+
+    // the descendants, if any are left in the pool, no longer need this tx in their package
+    updateAncestorStates(hash, -1, -(int64_t)mapTx.at(hash).GetTxSize(), -getModifiedFee(hash));
+
+    std::map<uint256, CTxMemPoolAncestorState>::iterator it = mapAncestorState.find(hash);
+    setTxByAncestorFeeRate.erase(std::make_pair(it->second.GetFeeRate(), hash));
+    mapAncestorState.erase(it);
+}
+
+void CTxMemPool::updateAncestorStates(const uint256& hash, int64_t nCountDelta, int64_t nSizeDelta, CAmount nFeeDelta)
+{
+    // certificates have no ancestor state, and only certificates depend on them
+    std::set<uint256> setDescendants;
+    calculateDescendants(hash, setDescendants, std::numeric_limits<size_t>::max());
+    for (const uint256& descendantHash: setDescendants) {
+        std::map<uint256, CTxMemPoolAncestorState>::const_iterator it = mapAncestorState.find(descendantHash);
+        if (it == mapAncestorState.end())
+            continue;
+        CTxMemPoolAncestorState state = it->second;
+        state.nCountWithAncestors += nCountDelta;
+        state.nSizeWithAncestors += nSizeDelta;
+        state.nModFeesWithAncestors += nFeeDelta;
+        setAncestorState(descendantHash, state);
+    }
+}
+
+void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
+{
+    if (rate.GetFeePerK() > rollingMinimumFeeRate) {
+        rollingMinimumFeeRate = rate.GetFeePerK();
+        blockSinceLastRollingFeeBump = false;
+    }
+}
+
+CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
+{
+    LOCK(cs);
+    if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
+        return CFeeRate(llround(rollingMinimumFeeRate));
+
+    int64_t time = GetTime();
+    if (time > lastRollingFeeUpdate + 10) {
+        // Decay faster while the pool is far from full
+        double halflife = ROLLING_FEE_HALFLIFE;
+        size_t usage = DynamicMemoryUsage();
+        if (usage < sizelimit / 4)
+            halflife /= 4;
+        else if (usage < sizelimit / 2)
+            halflife /= 2;
+
+        rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
+        lastRollingFeeUpdate = time;
+
+        if (rollingMinimumFeeRate < ::minRelayTxFee.GetFeePerK() / 2) {
+            rollingMinimumFeeRate = 0;
+            return CFeeRate(0);
+        }
+    }
+    return std::max(CFeeRate(llround(rollingMinimumFeeRate)), ::minRelayTxFee);
+}
+
+void CTxMemPool::TrimToSize(size_t sizelimit)
+{
+    LOCK(cs);
+    if (DynamicMemoryUsage() <= sizelimit)
+        return;
+
+    // Certificates, and the txs they depend on, are only evicted once no other tx is left
+    std::set<uint256> setCertAncestors;
+    calculateCertAncestors(setCertAncestors);
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    CFeeRate maxFeeRateRemoved(0);
+    for (bool fCertPackages: {false, true}) {
+        while (DynamicMemoryUsage() > sizelimit) {
+            // An entry scores the higher of its own fee rate and the fee rate of its package (itself and
+            // what depends on it), so that a low fee child goes on its own before it drags a well paying
+            // parent with it. Entries are visited by own fee rate, and none after the first whose own
+            // fee rate reaches the best score found can do better. Low fee parents paid for by their
+            // children make the search longer, so it gives up after TRIM_MAX_CANDIDATES of them.
+            uint256 hashBest;
+            CFeeRate bestScore, bestPackageRate;
+            size_t nBestPackageSize = 0;
+            size_t nCandidates = 0;
+            for (const auto& item: setEntriesByFeeRate) {
+                if (nCandidates > 0 && (item.first >= bestScore || nCandidates >= TRIM_MAX_CANDIDATES))
+                    break;
+                if ((setCertAncestors.count(item.second) != 0) != fCertPackages)
+                    continue;
+                nCandidates++;
+
+                std::set<uint256> setPackage;
+                calculateDescendants(item.second, setPackage, TRIM_MAX_DESCENDANTS);
+                CFeeRate packageRate = getPackageFeeRate(setPackage);
+                CFeeRate score = std::max(item.first, packageRate);
+                if (nCandidates == 1 || score < bestScore) {
+                    hashBest = item.second;
+                    bestScore = score;
+                    bestPackageRate = packageRate;
+                    nBestPackageSize = setPackage.size();
+                }
+            }
+            if (nCandidates == 0)
+                break;
+
+            // Whoever wants to take the place of this package has to pay more than it did
+            CFeeRate removedRate(bestPackageRate.GetFeePerK() + ::minRelayTxFee.GetFeePerK());
+            trackPackageRemoved(removedRate);
+            maxFeeRateRemoved = std::max(maxFeeRateRemoved, removedRate);
+
+            LogPrint("mempool", "%s():%d - evicting [%s] and %d dependents, package fee rate %s\n",
+                __func__, __LINE__, hashBest.ToString(), nBestPackageSize - 1, bestPackageRate.ToString());
+            if (mapTx.count(hashBest)) {
+                const CTransaction tx = mapTx[hashBest].GetTx();
+                remove(tx, removedTxs, removedCerts, true);
+            } else {
+                const CScCertificate cert = mapCertificate[hashBest].GetCertificate();
+                remove(cert, removedTxs, removedCerts, true);
+            }
+        }
+    }
+
+    nEvictedTxs += removedTxs.size();
+    nEvictedCerts += removedCerts.size();
+    if (!removedTxs.empty() || !removedCerts.empty())
+        LogPrint("mempool", "%s():%d - evicted %d txs and %d certs, new mempool min fee %s\n", __func__, __LINE__,
+            removedTxs.size(), removedCerts.size(), maxFeeRateRemoved.ToString());
+}
+
+int CTxMemPool::Expire(int64_t time)
+{
+    LOCK(cs);
+    std::vector<uint256> vExpired;
+    std::set<uint256> setCertAncestors;
+    for (std::multimap<int64_t, uint256>::const_iterator it = mapTxByTime.begin();
+         it != mapTxByTime.end() && it->first < time; ++it) {
+        if (vExpired.empty() && setCertAncestors.empty())
+            calculateCertAncestors(setCertAncestors);
+        // Certificates are dropped when their epoch ends, not because the txs they spend are old
+        if (!setCertAncestors.count(it->second))
+            vExpired.push_back(it->second);
+    }
+
+    std::list<CTransaction> removedTxs;
+    std::list<CScCertificate> removedCerts;
+    for (const uint256& hash: vExpired) {
+        if (!mapTx.count(hash))
+            continue;
+        const CTransaction tx = mapTx[hash].GetTx();
+        remove(tx, removedTxs, removedCerts, true);
+    }
+    nExpiredTxs += removedTxs.size();
+    return removedTxs.size();
+}
+
 void CTxMemPool::clear()
 {
     LOCK(cs);
@@ -651,6 +1118,17 @@ void CTxMemPool::clear()
     mapDeltas.clear();
     mapNextTx.clear();
     mapSidechains.clear();
+    mapDependencies.clear();
+    mapDependents.clear();
+    nDependencyLinks = 0;
+    mapMaturityHeight.clear();
+    mapEntryMaturityHeight.clear();
+    setMaturityUnknown.clear();
+    setEntriesByFeeRate.clear();
+    mapTxByTime.clear();
+    mapAncestorState.clear();
+    setTxByAncestorFeeRate.clear();
+    mapCertByScEpoch.clear();
     totalTxSize = 0;
     totalCertificateSize = 0;
     cachedInnerUsage = 0;
@@ -881,6 +1359,42 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         {
             assert(false);
         }
+
+        // spending an output of another pool object must be recorded in the dependency index
+        if (mapTx.count(it->first.hash) || mapCertificate.count(it->first.hash))
+            assert(mapDependencies.count(hash) && mapDependencies.at(hash).count(it->first.hash));
+    }
+
+    uint64_t nCheckLinks = 0;
+    for (const auto& entry: mapDependencies) {
+        assert(mapTx.count(entry.first) || mapCertificate.count(entry.first));
+        assert(!entry.second.empty());
+        for (const uint256& parentHash: entry.second) {
+            assert(mapTx.count(parentHash) || mapCertificate.count(parentHash));
+            assert(mapDependents.count(parentHash) && mapDependents.at(parentHash).count(entry.first));
+        }
+        nCheckLinks += entry.second.size();
+    }
+    assert(nCheckLinks == nDependencyLinks);
+    nCheckLinks = 0;
+    for (const auto& entry: mapDependents)
+        nCheckLinks += entry.second.size();
+    assert(nCheckLinks == nDependencyLinks);
+
+    // every tx has an ancestor package matching the dependency index, and is ordered by its fee rate
+    assert(mapAncestorState.size() == mapTx.size());
+    assert(setTxByAncestorFeeRate.size() == mapTx.size());
+    for (const auto& entry: mapAncestorState) {
+        CTxMemPoolAncestorState state = calculateAncestorState(entry.first);
+        assert(state.nCountWithAncestors == entry.second.nCountWithAncestors);
+        assert(state.nSizeWithAncestors == entry.second.nSizeWithAncestors);
+        assert(state.nModFeesWithAncestors == entry.second.nModFeesWithAncestors);
+        assert(setTxByAncestorFeeRate.count(std::make_pair(entry.second.GetFeeRate(), entry.first)));
+    }
+    assert(mapCertByScEpoch.size() == mapCertificate.size());
+    for (const auto& entry: mapCertByScEpoch) {
+        const CScCertificate& cert = mapCertificate.at(entry.second).GetCertificate();
+        assert(cert.GetScId() == entry.first.first && cert.epochNumber == entry.first.second);
     }
 
     for (std::map<uint256, const CTransaction*>::const_iterator it = mapNullifiers.begin(); it != mapNullifiers.end(); it++) {
@@ -975,9 +1489,16 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const std::string& s
 {
     {
         LOCK(cs);
+        bool fInPool = exists(hash);
+        if (fInPool)
+            removeEvictionIndex(hash);
         std::pair<double, CAmount> &deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        if (fInPool)
+            addEvictionIndex(hash);
+        if (mapTx.count(hash))
+            updateAncestorStates(hash, 0, 0, nFeeDelta);
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -1147,6 +1668,18 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
           memusage::DynamicUsage(mapDeltas) +
           memusage::DynamicUsage(mapCertificate) +
           memusage::DynamicUsage(mapSidechains) +
+          memusage::DynamicUsage(mapDependencies) +
+          memusage::DynamicUsage(mapDependents) +
+          memusage::DynamicUsage(mapMaturityHeight) +
+          memusage::DynamicUsage(mapEntryMaturityHeight) +
+          memusage::DynamicUsage(setMaturityUnknown) +
+          memusage::DynamicUsage(setEntriesByFeeRate) +
+          memusage::DynamicUsage(mapTxByTime) +
+          memusage::DynamicUsage(mapAncestorState) +
+          memusage::DynamicUsage(setTxByAncestorFeeRate) +
+          memusage::DynamicUsage(mapCertByScEpoch) +
+          mapEntryMaturityHeight.size() * memusage::MallocUsage(sizeof(memusage::stl_tree_node<uint256>)) +
+          2 * nDependencyLinks * memusage::MallocUsage(sizeof(memusage::stl_tree_node<uint256>)) +
           cachedInnerUsage);
 }
 
@@ -119,6 +119,19 @@ struct CSidechainMemPoolEntry
     }
 };
 
+/**
+ * A transaction together with all its in-pool ancestors: the package a block has to take in order to
+ * include it. Fees are modified ones, i.e. prioritisation included.
+ */
+struct CTxMemPoolAncestorState
+{
+    uint64_t nCountWithAncestors = 0;
+    uint64_t nSizeWithAncestors = 0;
+    CAmount nModFeesWithAncestors = 0;
+
+    CFeeRate GetFeeRate() const { return CFeeRate(nModFeesWithAncestors, nSizeWithAncestors); }
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -147,11 +160,67 @@ private:
     bool checkCertImmatureExpenditures(
         const CScCertificate& cert, const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight);
 
+    /**
+     * Maturity index used by removeImmatureExpenditures: the entries spending coinbase or certificate
+     * outputs of the chain, by the lowest height at which all of those outputs can be spent. Disconnecting
+     * a block only makes immature the entries indexed above the new height. Entries added without a
+     * coins view are indexed, and checked, by the next removeImmatureExpenditures.
+     */
+    std::map<int, std::set<uint256> > mapMaturityHeight;
+    std::map<uint256, int> mapEntryMaturityHeight;
+    std::set<uint256> setMaturityUnknown;
+    bool getMaturityHeight(const CTransactionBase& txBase, const CCoinsViewCache *pcoins, int& nMaturityHeight) const;
+    void addMaturity(const uint256& hash, const CTransactionBase& txBase, const CCoinsViewCache *pcoins);
+    void removeMaturity(const uint256& hash);
+
     std::map<uint256, std::shared_ptr<CTransactionBase> > mapRecentlyAddedTxBase;
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
 
+    uint64_t nDependencyLinks = 0; //! number of (parent, child) pairs in mapDependencies
+    void addDependency(const uint256& parentHash, const uint256& childHash);
+    void addDependencies(const uint256& hash, const CTransactionBase& txBase);
+    void removeDependencies(const uint256& hash);
+
+    /**
+     * Minimum fee rate (satoshis per kB) for entering the pool once it has been full: raised by
+     * TrimToSize() to the fee rate of the evicted packages, then halved every ROLLING_FEE_HALFLIFE
+     * seconds once a block has been connected.
+     */
+    mutable int64_t lastRollingFeeUpdate;
+    mutable bool blockSinceLastRollingFeeBump;
+    mutable double rollingMinimumFeeRate;
+    void trackPackageRemoved(const CFeeRate& rate);
+
+    uint64_t nEvictedTxs = 0; //! txs removed by TrimToSize()
+    uint64_t nEvictedCerts = 0; //! certificates removed by TrimToSize()
+    uint64_t nExpiredTxs = 0; //! txs removed by Expire()
+
+    //! Own fee rate, prioritisation included, of every tx and certificate: where TrimToSize() looks for packages to evict
+    std::set<std::pair<CFeeRate, uint256> > setEntriesByFeeRate;
+    //! Entry time of every tx: where Expire() looks for txs to drop
+    std::multimap<int64_t, uint256> mapTxByTime;
+    CFeeRate getModifiedFeeRate(const uint256& hash) const;
+    void addEvictionIndex(const uint256& hash);
+    void removeEvictionIndex(const uint256& hash);
+
+    //! Bounds on the work done by TrimToSize() to pick one package
+    static const size_t TRIM_MAX_CANDIDATES = 100;
+    static const size_t TRIM_MAX_DESCENDANTS = 1000;
+
+    void calculateDescendants(const uint256& hash, std::set<uint256>& setDescendants, size_t nMaxDescendants) const;
+    CAmount getModifiedFee(const uint256& hash) const;
+    CTxMemPoolAncestorState calculateAncestorState(const uint256& hash) const;
+    void setAncestorState(const uint256& hash, const CTxMemPoolAncestorState& state);
+    void addAncestorState(const uint256& hash);
+    void removeAncestorState(const uint256& hash);
+    void updateAncestorStates(const uint256& hash, int64_t nCountDelta, int64_t nSizeDelta, CAmount nFeeDelta);
+    void calculateCertAncestors(std::set<uint256>& setCertAncestors) const;
+    CFeeRate getPackageFeeRate(const std::set<uint256>& setPackage) const;
+
 public:
+    static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // 12 hours
+
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<uint256, CCertificateMemPoolEntry> mapCertificate;
@@ -160,6 +229,29 @@ public:
     std::map<uint256, const CTransaction*> mapNullifiers;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+    /**
+     * Dependency index: for each tx/cert, the mempool objects it must follow in a block, i.e. those
+     * whose outputs it spends and, for forward transfers, the creation of the target sidechain;
+     * mapDependents holds the reverse relation. Both are kept up to date on add/remove.
+     */
+    std::map<uint256, std::set<uint256> > mapDependencies;
+    std::map<uint256, std::set<uint256> > mapDependents;
+
+    /**
+     * Block assembly indexes, kept up to date on add/remove and prioritisation so that CreateNewBlock
+     * picks packages without scanning the pool. mapAncestorState holds the ancestor package of every
+     * tx and setTxByAncestorFeeRate orders the txs by the fee rate of that package. The ancestors of a
+     * tx are txs only, as a tx cannot spend a certificate output still in the pool. mapCertByScEpoch
+     * holds the certificates by sidechain and epoch.
+     */
+    std::map<uint256, CTxMemPoolAncestorState> mapAncestorState;
+    std::set<std::pair<CFeeRate, uint256> > setTxByAncestorFeeRate;
+    std::map<std::pair<uint256, int32_t>, uint256> mapCertByScEpoch;
+
+    //! The in-pool ancestors, or descendants, of a tx or certificate, itself included
+    void CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const;
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -176,8 +268,11 @@ public:
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(bool _fSanityCheck) { fSanityCheck = _fSanityCheck; }
 
-    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
-    bool addUnchecked(const uint256& hash, const CCertificateMemPoolEntry &entry, bool fCurrentEstimate = true);
+    /** pcoins, when given, must hold the inputs of the entry that are not in the pool */
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true,
+                      const CCoinsViewCache *pcoins = nullptr);
+    bool addUnchecked(const uint256& hash, const CCertificateMemPoolEntry &entry, bool fCurrentEstimate = true,
+                      const CCoinsViewCache *pcoins = nullptr);
 
     void remove(const CTransactionBase& origTx, std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts, bool fRecursive = false);
 
@@ -194,6 +289,22 @@ public:
     void removeForBlock(const std::vector<CScCertificate>& vcert, unsigned int nBlockHeight,
                         std::list<CTransaction>& removedTxs, std::list<CScCertificate>& removedCerts);
 
+    /**
+     * Evict the packages (an entry and everything depending on it) with the lowest fee rate until
+     * the dynamic memory usage is not above sizelimit. Transactions are evicted first; certificates,
+     * and the transactions they depend on, only go when no other transaction is left.
+     */
+    void TrimToSize(size_t sizelimit);
+
+    /** Remove the transactions that entered the pool before time, with their dependents. Returns the number removed. */
+    int Expire(int64_t time);
+
+    /**
+     * The minimum fee rate to get into the pool after evictions, decaying back to zero. Zero if
+     * nothing has been evicted lately, otherwise at least the min relay fee.
+     */
+    CFeeRate GetMinFee(size_t sizelimit) const;
+
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
@@ -249,6 +360,24 @@ public:
         return (totalTxSize + totalCertificateSize);
     }
 
+    uint64_t GetEvictedTxs() const
+    {
+        LOCK(cs);
+        return nEvictedTxs;
+    }
+
+    uint64_t GetEvictedCerts() const
+    {
+        LOCK(cs);
+        return nEvictedCerts;
+    }
+
+    uint64_t GetExpiredTxs() const
+    {
+        LOCK(cs);
+        return nExpiredTxs;
+    }
+
     bool existsTx(uint256 hash) const
     {
         LOCK(cs);
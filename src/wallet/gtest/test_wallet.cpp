@@ -410,6 +410,47 @@ TEST(wallet_tests, FindMyNotes) {
     EXPECT_EQ(nd, noteMap[jsoutpt]);
 }
 
+TEST(wallet_tests, FilteredNotesByAddressUseCachedPlaintext) {
+    SelectParams(CBaseChainParams::TESTNET);
+    CWallet wallet;
+
+    auto sk = libzcash::SpendingKey::random();
+    auto sk2 = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+    wallet.AddSpendingKey(sk2);
+
+    // note data loaded without plaintext, as when read back from disk
+    auto wtx = GetValidReceive(sk, 10, true);
+    auto note = GetNote(sk, wtx.getWrappedTx(), 0, 1);
+    mapNoteData_t noteData;
+    JSOutPoint jsoutpt {wtx.getWrappedTx().GetHash(), 0, 1};
+    CNoteData nd {sk.address(), note.nullifier(sk)};
+    noteData[jsoutpt] = nd;
+    wtx.SetNoteData(noteData);
+    wallet.AddToWallet(wtx, true, NULL);
+    EXPECT_FALSE(wallet.getMapWallet().at(jsoutpt.hash)->mapNoteData.at(jsoutpt).plaintext.is_initialized());
+
+    std::vector<CNotePlaintextEntry> entries;
+    wallet.GetFilteredNotes(entries, CZCPaymentAddress(sk2.address()).ToString(), -1);
+    EXPECT_EQ(0, entries.size());
+
+    wallet.GetFilteredNotes(entries, CZCPaymentAddress(sk.address()).ToString(), -1);
+    ASSERT_EQ(1, entries.size());
+    EXPECT_EQ(jsoutpt, entries[0].jsop);
+    EXPECT_EQ(10, entries[0].plaintext.value());
+
+    // the first query decrypted the note and left the plaintext in the wallet
+    auto cached = wallet.getMapWallet().at(jsoutpt.hash)->mapNoteData.at(jsoutpt).plaintext;
+    ASSERT_TRUE(cached.is_initialized());
+    EXPECT_EQ(10, cached->value());
+
+    // notes found by trial decryption come with their plaintext
+    auto noteMap = wallet.FindMyNotes(wtx.getWrappedTx());
+    ASSERT_EQ(1, noteMap.count(jsoutpt));
+    ASSERT_TRUE(noteMap[jsoutpt].plaintext.is_initialized());
+    EXPECT_EQ(10, noteMap[jsoutpt].plaintext->value());
+}
+
 TEST(wallet_tests, FindMyNotesInEncryptedWallet) {
     TestWallet wallet;
     uint256 r {GetRandHash()};
@@ -1145,3 +1186,61 @@ TEST(wallet_tests, SetBestChainIgnoresTxsWithoutShieldedData) {
         .WillOnce(Return(true));
     wallet.SetBestChain(walletdb, loc);
 }
+
+TEST(wallet_tests, OrderedTxWithInputsUsesAddressIndex) {
+    SelectParams(CBaseChainParams::REGTEST);
+    CWallet wallet;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyId = key.GetPubKey().GetID();
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    // funding tx paying to the address
+    CMutableTransaction mtxFund;
+    mtxFund.vin.resize(1);
+    mtxFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtxFund.addOut(CTxOut(10, GetScriptForDestination(keyId, false)));
+    CTransaction txFund(mtxFund);
+
+    // tx spending the funding output somewhere else
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.resize(1);
+    mtxSpend.vin[0].prevout = COutPoint(txFund.GetHash(), 0);
+    mtxSpend.addOut(CTxOut(9, GetScriptForDestination(otherKey.GetPubKey().GetID(), false)));
+    CTransaction txSpend(mtxSpend);
+
+    // tx not involving the address at all
+    CMutableTransaction mtxOther;
+    mtxOther.vin.resize(1);
+    mtxOther.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtxOther.addOut(CTxOut(5, GetScriptForDestination(otherKey.GetPubKey().GetID(), false)));
+    CTransaction txOther(mtxOther);
+
+    for (const CTransaction& tx : {txFund, txSpend, txOther})
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 0, 0, 0.0, 1), false);
+
+    // the spender is added first, it must be indexed once its input becomes known
+    CWalletTx wtxSpend(&wallet, txSpend);
+    wtxSpend.nOrderPos = 1;
+    wallet.AddToWallet(wtxSpend, true, NULL);
+    CWalletTx wtxFund(&wallet, txFund);
+    wtxFund.nOrderPos = 0;
+    wallet.AddToWallet(wtxFund, true, NULL);
+    CWalletTx wtxOther(&wallet, txOther);
+    wtxOther.nOrderPos = 2;
+    wallet.AddToWallet(wtxOther, true, NULL);
+
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        vTxWithInputs vTxes = wallet.OrderedTxWithInputs(CBitcoinAddress(keyId).ToString());
+        ASSERT_EQ(2, vTxes.size());
+        EXPECT_EQ(txFund.GetHash(), vTxes[0]->getTxBase()->GetHash());
+        EXPECT_EQ(txSpend.GetHash(), vTxes[1]->getTxBase()->GetHash());
+
+        EXPECT_EQ(0, wallet.OrderedTxWithInputs(CBitcoinAddress(CKeyID()).ToString()).size());
+    }
+
+    mempool.clear();
+}
@@ -3727,10 +3727,14 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             sample_times.push_back(benchmark_large_tx());
         } else if (benchmarktype == "trydecryptnotes") {
             int nAddrs = params[2].get_int();
-            sample_times.push_back(benchmark_try_decrypt_notes(nAddrs));
+            int nThreads = params.size() > 3 ? params[3].get_int() : 0;
+            sample_times.push_back(benchmark_try_decrypt_notes(nAddrs, nThreads));
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
             sample_times.push_back(benchmark_increment_note_witnesses(nTxs));
+        } else if (benchmarktype == "incwalletnotewitnesses") {
+            int nNotes = params[2].get_int();
+            sample_times.push_back(benchmark_increment_note_witnesses_wallet(nNotes));
         } else if (benchmarktype == "connectblockslow") {
             if (Params().NetworkIDString() != "regtest") {
                 throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark must be run in regtest mode");
@@ -15,6 +15,7 @@
 #include "script/script.h"
 #include "script/sign.h"
 #include "timedata.h"
+#include "checkqueue.h"
 #include "utilmoneystr.h"
 #include "zcash/Note.hpp"
 #include "crypter.h"
@@ -23,6 +24,7 @@
 using namespace zen;
 
 #include <assert.h>
+#include <atomic>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
@@ -693,6 +695,12 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 {
     {
         LOCK(cs_wallet);
+        // Gather in a single pass over the wallet the notes whose cache has to be
+        // advanced to this height, and among them the ones holding a witness the
+        // block commitments must be appended to. The per-commitment work below then
+        // only touches these flat vectors instead of walking mapWallet every time.
+        std::vector<CNoteData*> vAdvancedNotes;
+        std::vector<CNoteData*> vLiveWitnesses;
         for (auto& wtxItem : mapWallet)
         {
             for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
@@ -716,6 +724,10 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                     if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
                         nd->witnesses.pop_back();
                     }
+                    vAdvancedNotes.push_back(nd);
+                    if (nd->witnesses.size() > 0) {
+                        vLiveWitnesses.push_back(nd);
+                    }
                 }
             }
         }
@@ -732,7 +744,8 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 
         for (const CTransaction& tx : pblock->vtx) {
             auto hash = tx.GetHash();
-            bool txIsOurs = mapWallet.count(hash);
+            auto itWtx = mapWallet.find(hash);
+            bool txIsOurs = (itWtx != mapWallet.end());
             for (size_t i = 0; i < tx.GetVjoinsplit().size(); i++) {
                 const JSDescription& jsdesc = tx.GetVjoinsplit()[i];
                 for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
@@ -740,27 +753,24 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                     tree.append(note_commitment);
 
                     // Increment existing witnesses
-                    for (auto& wtxItem : mapWallet)
-                    {
-                        for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
-                            CNoteData* nd = &(item.second);
-                            if (nd->witnessHeight < pindex->nHeight &&
-                                    nd->witnesses.size() > 0) {
-                                // Check the validity of the cache
-                                // See earlier comment about validity.
-                                assert(nWitnessCacheSize >= nd->witnesses.size());
-                                nd->witnesses.front().append(note_commitment);
-                            }
-                        }
+                    for (CNoteData* nd : vLiveWitnesses) {
+                        // Check the validity of the cache
+                        // See earlier comment about validity.
+                        assert(nWitnessCacheSize >= nd->witnesses.size());
+                        nd->witnesses.front().append(note_commitment);
                     }
 
                     // If this is our note, witness it
                     if (txIsOurs) {
                         JSOutPoint jsoutpt {hash, i, j};
-                        if (mapWallet[hash]->mapNoteData.count(jsoutpt) &&
-                                mapWallet[hash]->mapNoteData[jsoutpt].witnessHeight < pindex->nHeight) {
-                            CNoteData* nd = &(mapWallet[hash]->mapNoteData[jsoutpt]);
-                            if (nd->witnesses.size() > 0) {
+                        auto itNd = itWtx->second->mapNoteData.find(jsoutpt);
+                        if (itNd != itWtx->second->mapNoteData.end() &&
+                                itNd->second.witnessHeight < pindex->nHeight) {
+                            CNoteData* nd = &(itNd->second);
+                            // A note with a cached witness is already live and
+                            // gets the following commitments of the block.
+                            bool fLive = nd->witnesses.size() > 0;
+                            if (fLive) {
                                 // We think this can happen because we write out the
                                 // witness cache state after every block increment or
                                 // decrement, but the block index itself is written in
@@ -782,6 +792,9 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                             nd->witnessHeight = pindex->nHeight - 1;
                             // Check the validity of the cache
                             assert(nWitnessCacheSize >= nd->witnesses.size());
+                            if (!fLive) {
+                                vLiveWitnesses.push_back(nd);
+                            }
                         }
                     }
                 }
@@ -789,17 +802,11 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
         }
 
         // Update witness heights
-        for (auto& wtxItem : mapWallet)
-        {
-            for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
-                CNoteData* nd = &(item.second);
-                if (nd->witnessHeight < pindex->nHeight) {
-                    nd->witnessHeight = pindex->nHeight;
-                    // Check the validity of the cache
-                    // See earlier comment about validity.
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
-                }
-            }
+        for (CNoteData* nd : vAdvancedNotes) {
+            nd->witnessHeight = pindex->nHeight;
+            // Check the validity of the cache
+            // See earlier comment about validity.
+            assert(nWitnessCacheSize >= nd->witnesses.size());
         }
 
         // For performance reasons, we write out the witness cache in
@@ -833,14 +840,7 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
                     // height is one below it.
                     nd->witnessHeight = pindex->nHeight - 1;
                 }
-            }
-        }
-        nWitnessCacheSize -= 1;
-        for (auto& wtxItem : mapWallet)
-        {
-            for (mapNoteData_t::value_type& item : wtxItem.second->mapNoteData) {
-                CNoteData* nd = &(item.second);
-                // Check the validity of the cache
+                // Check the validity of the cache against the decremented size
                 // Technically if there are notes witnessed above the current
                 // height, their cache will now be invalid (relative to the new
                 // value of nWitnessCacheSize). However, this would only occur
@@ -851,10 +851,11 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
                 // reindex because the on-disk blocks had already resulted in a
                 // chain that didn't trigger the assertion below.
                 if (nd->witnessHeight < pindex->nHeight) {
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
+                    assert(nWitnessCacheSize - 1 >= nd->witnesses.size());
                 }
             }
         }
+        nWitnessCacheSize -= 1;
         // TODO: If nWitnessCache is zero, we need to regenerate the caches (#1302)
         assert(nWitnessCacheSize > 0);
 
@@ -970,7 +971,6 @@ int64_t CWallet::IncOrderPosNext(CWalletDB *pwalletdb)
 vTxWithInputs CWallet::OrderedTxWithInputs(const std::string& address) const
 {
     AssertLockHeld(cs_wallet);
-    CWalletDB walletdb(strWalletFile);
 
     vTxWithInputs vOrderedTxes;
 
@@ -984,16 +984,25 @@ vTxWithInputs CWallet::OrderedTxWithInputs(const std::string& address) const
 
     const CScript& scriptPubKey = GetScriptForDestination(taddr.Get(), false);
 
-    // tx are ordered in this map, from the oldest to the newest. As a consequence, the returned vector is ordered 
-    // as well
-    for (auto it : wtxOrdered)
-    {
-        CWalletTransactionBase* wtx = it.second.first;
-        int64_t orderPos = it.first;
+    auto itTxes = mapAddressesToTxes.find(taddr.Get());
+    if (itTxes == mapAddressesToTxes.end())
+        return vOrderedTxes;
 
-        LogPrintf("%s():%d - processing ordered tx: nOrderPos[%d]: tx[%s]\n", __func__, __LINE__,
-            orderPos, wtx->getTxBase()->GetHash().ToString() );
+    // only the txes indexed for this address are candidates, ordered from the oldest to the newest
+    // as they are in wtxOrdered
+    std::vector<CWalletTransactionBase*> vCandidates;
+    vCandidates.reserve(itTxes->second.size());
+    for (const uint256& hash : itTxes->second)
+    {
+        auto mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            vCandidates.push_back(mi->second.get());
+    }
+    std::stable_sort(vCandidates.begin(), vCandidates.end(),
+        [](const CWalletTransactionBase* a, const CWalletTransactionBase* b) { return a->nOrderPos < b->nOrderPos; });
 
+    for (CWalletTransactionBase* wtx : vCandidates)
+    {
         if (wtx->GetDepthInMainChain() < 0) {
             LogPrintf("%s():%d - skipping tx[%s]: conflicted\n", __func__, __LINE__, wtx->getTxBase()->GetHash().ToString() );
             continue;
@@ -1061,6 +1070,90 @@ bool CWallet::UpdateNullifierNoteMap()
     return true;
 }
 
+/**
+ * Update mapAddressesToNotes with the notes of this tx.
+ */
+void CWallet::UpdateAddressNoteMapWithTx(const CWalletTransactionBase& obj)
+{
+    {
+        LOCK(cs_wallet);
+        for (const mapNoteData_t::value_type& item : obj.mapNoteData) {
+            mapAddressesToNotes[item.second.address].insert(item.first);
+        }
+    }
+}
+
+/**
+ * Index this tx in mapAddressesToTxes under the destinations of its outputs and of the
+ * wallet outputs it spends, and index the wallet txes already spending its outputs.
+ */
+void CWallet::AddToAddressTxMap(const CWalletTransactionBase& obj)
+{
+    {
+        LOCK(cs_wallet);
+        const uint256& hash = obj.getTxBase()->GetHash();
+        const std::vector<CTxOut>& vout = obj.getTxBase()->GetVout();
+        for (unsigned int n = 0; n < vout.size(); n++) {
+            CTxDestination dest;
+            if (!ExtractDestination(vout[n].scriptPubKey, dest))
+                continue;
+            std::set<uint256>& setTxes = mapAddressesToTxes[dest];
+            setTxes.insert(hash);
+            std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(COutPoint(hash, n));
+            for (TxSpends::const_iterator it = range.first; it != range.second; ++it)
+                setTxes.insert(it->second);
+        }
+
+        if (obj.getTxBase()->IsCoinBase())
+            return;
+
+        for (const CTxIn& txin : obj.getTxBase()->GetVin()) {
+            auto mi = mapWallet.find(txin.prevout.hash);
+            if (mi == mapWallet.end() || txin.prevout.n >= mi->second->getTxBase()->GetVout().size())
+                continue;
+            CTxDestination dest;
+            if (ExtractDestination(mi->second->getTxBase()->GetVout()[txin.prevout.n].scriptPubKey, dest))
+                mapAddressesToTxes[dest].insert(hash);
+        }
+    }
+}
+
+/**
+ * Drop this tx from mapAddressesToTxes. Txes spending its outputs are left in place
+ * and filtered out on lookup.
+ */
+void CWallet::RemoveFromAddressTxMap(const CWalletTransactionBase& obj)
+{
+    {
+        LOCK(cs_wallet);
+        const uint256& hash = obj.getTxBase()->GetHash();
+        std::vector<CTxDestination> vDest;
+        for (const CTxOut& txout : obj.getTxBase()->GetVout()) {
+            CTxDestination dest;
+            if (ExtractDestination(txout.scriptPubKey, dest))
+                vDest.push_back(dest);
+        }
+        if (!obj.getTxBase()->IsCoinBase()) {
+            for (const CTxIn& txin : obj.getTxBase()->GetVin()) {
+                auto mi = mapWallet.find(txin.prevout.hash);
+                if (mi == mapWallet.end() || txin.prevout.n >= mi->second->getTxBase()->GetVout().size())
+                    continue;
+                CTxDestination dest;
+                if (ExtractDestination(mi->second->getTxBase()->GetVout()[txin.prevout.n].scriptPubKey, dest))
+                    vDest.push_back(dest);
+            }
+        }
+        for (const CTxDestination& dest : vDest) {
+            auto it = mapAddressesToTxes.find(dest);
+            if (it == mapAddressesToTxes.end())
+                continue;
+            it->second.erase(hash);
+            if (it->second.empty())
+                mapAddressesToTxes.erase(it);
+        }
+    }
+}
+
 /**
  * Update mapNullifiersToNotes with the cached nullifiers in this tx.
  */
@@ -1092,7 +1185,9 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
         UpdateNullifierNoteMapWithTx(*(mapWallet[hash]));
+        UpdateAddressNoteMapWithTx(*(mapWallet[hash]));
         AddToSpends(hash);
+        AddToAddressTxMap(*(mapWallet[hash]));
     }
     else
     {
@@ -1155,6 +1250,7 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
                              wtxIn.hashBlock.ToString());
             }
             AddToSpends(hash);
+            AddToAddressTxMap(wtx);
         }
 
         bool fUpdated = false;
@@ -1183,6 +1279,7 @@ bool CWallet::AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWal
 
             wtx.bwtMaturityDepth = wtxIn.bwtMaturityDepth;
         }
+        UpdateAddressNoteMapWithTx(wtx);
 
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.getTxBase()->GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
@@ -1223,6 +1320,10 @@ bool CWallet::UpdatedNoteData(const CWalletTransactionBase& wtxIn, CWalletTransa
             tmp.at(nd.first).witnesses.assign(
                 nd.second.witnesses.cbegin(), nd.second.witnesses.cend());
         }
+        // and the decrypted plaintext, which is not serialized
+        if (tmp.count(nd.first) && nd.second.plaintext && !tmp.at(nd.first).plaintext) {
+            tmp.at(nd.first).plaintext = nd.second.plaintext;
+        }
         tmp.at(nd.first).witnessHeight = nd.second.witnessHeight;
     }
     // Now copy over the updated note data
@@ -1242,13 +1343,15 @@ bool CWallet::UpdatedNoteData(const CWalletTransactionBase& wtxIn, CWalletTransa
  * updated; instead, the transaction being in the mempool or conflicted is determined on
  * the fly in CMerkleTx::GetDepthInMainChain().
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate,
+                                       const mapNoteData_t* pNoteData)
 {
     {
         AssertLockHeld(cs_wallet);
         bool fExisted = mapWallet.count(obj.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        auto noteData = FindMyNotes(obj);
+        // callers scanning a whole block can pass the notes already found by a batched FindMyNotes
+        mapNoteData_t noteData = pNoteData ? *pNoteData : FindMyNotes(obj);
         try
         {
             if (fExisted || IsMine(obj) || IsFromMe(obj) || noteData.size() > 0)
@@ -1350,8 +1453,13 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         LOCK(cs_wallet);
         LogPrint("cert", "%s():%d - called for obj[%s]\n", __func__, __LINE__, hash.ToString());
 
-        if (mapWallet.erase(hash))
+        auto mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+        {
+            RemoveFromAddressTxMap(*(mi->second));
+            mapWallet.erase(mi);
             CWalletDB(strWalletFile).EraseWalletTxBase(hash);
+        }
     }
     return;
 }
@@ -1365,7 +1473,8 @@ boost::optional<uint256> CWallet::GetNoteNullifier(const JSDescription& jsdesc,
                                                    const libzcash::PaymentAddress& address,
                                                    const ZCNoteDecryption& dec,
                                                    const uint256& hSig,
-                                                   uint8_t n) const
+                                                   uint8_t n,
+                                                   libzcash::NotePlaintext* pPlaintext) const
 {
     boost::optional<uint256> ret;
     auto note_pt = libzcash::NotePlaintext::decrypt(
@@ -1380,6 +1489,9 @@ boost::optional<uint256> CWallet::GetNoteNullifier(const JSDescription& jsdesc,
     if (note.cm() != jsdesc.commitments[n]) {
         throw libzcash::note_decryption_failed();
     }
+    if (pPlaintext) {
+        *pPlaintext = note_pt;
+    }
 
     // SpendingKeys are only available if:
     // - We have them (this isn't a viewing key)
@@ -1400,42 +1512,166 @@ boost::optional<uint256> CWallet::GetNoteNullifier(const JSDescription& jsdesc,
  * already have been cached in CWalletTx.mapNoteData.
  */
 mapNoteData_t CWallet::FindMyNotes(const CTransactionBase& tx) const
+{
+    std::vector<const CTransactionBase*> vTx(1, &tx);
+    return FindMyNotes(vTx).front();
+}
+
+bool CNoteDecryptionCheck::operator()()
+{
+    for (size_t k = nBegin; k < nEnd; k++) {
+        const NoteDecryptorMap::value_type& item = *(*vDecryptors)[k];
+        try {
+            auto note_pt = libzcash::NotePlaintext::decrypt(
+                item.second,
+                jsdesc->ciphertexts[n],
+                jsdesc->ephemeralKey,
+                *hSig,
+                (unsigned char) n);
+            // Check note plaintext against note commitment
+            if (note_pt.note(item.first).cm() == jsdesc->commitments[n]) {
+                *pnFound = k;
+                break;
+            }
+        } catch (const note_decryption_failed &err) {
+            // Couldn't decrypt with this decryptor
+        } catch (const std::exception &exc) {
+            // Unexpected failure
+            LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
+            LogPrintf("%s\n", exc.what());
+        }
+    }
+    // a failed trial decryption is not an error, keep the other jobs running
+    return true;
+}
+
+static CCheckQueue<CNoteDecryptionCheck> notedecryptionqueue(128);
+// only one batch at a time can be dispatched to the queue, whatever wallet it comes from
+static boost::mutex csNoteDecryptionQueue;
+static std::atomic<int> nNoteDecryptionThreads(0);
+
+void ThreadNoteDecryption() {
+    RenameThread("horizen-notedec");
+    nNoteDecryptionThreads++;
+    try {
+        notedecryptionqueue.Thread();
+    } catch (...) {
+        nNoteDecryptionThreads--;
+        throw;
+    }
+    nNoteDecryptionThreads--;
+}
+
+/**
+ * Trial-decrypts all the JoinSplit outputs of a batch of transactions with every
+ * wallet note decryptor. Each ciphertext is split in jobs of NOTE_DECRYPTORS_PER_CHECK
+ * decryptors, which are fanned out to the note decryption threads when running.
+ * Nullifiers are derived afterwards by the calling thread, which holds the key store lock.
+ */
+std::vector<mapNoteData_t> CWallet::FindMyNotes(const std::vector<const CTransactionBase*>& vTx) const
+{
+    return FindMyNotes(vTx, nNoteDecryptionThreads > 0 ? &notedecryptionqueue : NULL);
+}
+
+std::vector<mapNoteData_t> CWallet::FindMyNotes(const std::vector<const CTransactionBase*>& vTx,
+                                                CCheckQueue<CNoteDecryptionCheck>* pqueue) const
 {
     LOCK(cs_SpendingKeyStore);
-    uint256 hash = tx.GetHash();
-
-    mapNoteData_t noteData;
-    for (size_t i = 0; i < tx.GetVjoinsplit().size(); i++) {
-        auto hSig = tx.GetVjoinsplit()[i].h_sig(*pzcashParams, tx.GetJoinSplitPubKey());
-        for (uint8_t j = 0; j < tx.GetVjoinsplit()[i].ciphertexts.size(); j++) {
-            for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors) {
-                try {
-                    auto address = item.first;
-                    JSOutPoint jsoutpt {hash, i, j};
-                    auto nullifier = GetNoteNullifier(
-                        tx.GetVjoinsplit()[i],
-                        address,
-                        item.second,
-                        hSig, j);
-                    if (nullifier) {
-                        CNoteData nd {address, *nullifier};
-                        noteData.insert(std::make_pair(jsoutpt, nd));
-                    } else {
-                        CNoteData nd {address};
-                        noteData.insert(std::make_pair(jsoutpt, nd));
-                    }
-                    break;
-                } catch (const note_decryption_failed &err) {
-                    // Couldn't decrypt with this decryptor
-                } catch (const std::exception &exc) {
-                    // Unexpected failure
-                    LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
-                    LogPrintf("%s\n", exc.what());
-                }
+    std::vector<mapNoteData_t> vNoteData(vTx.size());
+
+    std::vector<const NoteDecryptorMap::value_type*> vDecryptors;
+    vDecryptors.reserve(mapNoteDecryptors.size());
+    for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors)
+        vDecryptors.push_back(&item);
+    if (vDecryptors.empty())
+        return vNoteData;
+    const size_t nChecksPerOutput = (vDecryptors.size() + NOTE_DECRYPTORS_PER_CHECK - 1) / NOTE_DECRYPTORS_PER_CHECK;
+
+    struct OutputToDecrypt {
+        size_t nTx;
+        size_t i;
+        uint8_t j;
+        const uint256* hSig;
+    };
+    std::vector<uint256> vHSig;
+    std::vector<OutputToDecrypt> vOutputs;
+    for (size_t t = 0; t < vTx.size(); t++) {
+        for (size_t i = 0; i < vTx[t]->GetVjoinsplit().size(); i++) {
+            vHSig.push_back(vTx[t]->GetVjoinsplit()[i].h_sig(*pzcashParams, vTx[t]->GetJoinSplitPubKey()));
+        }
+    }
+    size_t nHSig = 0;
+    for (size_t t = 0; t < vTx.size(); t++) {
+        for (size_t i = 0; i < vTx[t]->GetVjoinsplit().size(); i++, nHSig++) {
+            for (uint8_t j = 0; j < vTx[t]->GetVjoinsplit()[i].ciphertexts.size(); j++) {
+                vOutputs.push_back(OutputToDecrypt {t, i, j, &vHSig[nHSig]});
+            }
+        }
+    }
+    if (vOutputs.empty())
+        return vNoteData;
+
+    // one slot per job, holding the index of the decryptor that opened the note, if any
+    const size_t nNotFound = vDecryptors.size();
+    std::vector<size_t> vFound(vOutputs.size() * nChecksPerOutput, nNotFound);
+    std::vector<CNoteDecryptionCheck> vChecks;
+    vChecks.reserve(vFound.size());
+    for (size_t o = 0; o < vOutputs.size(); o++) {
+        const JSDescription& jsdesc = vTx[vOutputs[o].nTx]->GetVjoinsplit()[vOutputs[o].i];
+        for (size_t c = 0; c < nChecksPerOutput; c++) {
+            size_t nBegin = c * NOTE_DECRYPTORS_PER_CHECK;
+            size_t nEnd = std::min(nBegin + NOTE_DECRYPTORS_PER_CHECK, vDecryptors.size());
+            vChecks.push_back(CNoteDecryptionCheck(jsdesc, *vOutputs[o].hSig, vOutputs[o].j,
+                                                   vDecryptors, nBegin, nEnd, &vFound[o * nChecksPerOutput + c]));
+        }
+    }
+
+    if (pqueue != NULL && vChecks.size() > 1) {
+        boost::unique_lock<boost::mutex> lock(csNoteDecryptionQueue, boost::defer_lock);
+        if (pqueue == &notedecryptionqueue)
+            lock.lock();
+        CCheckQueueControl<CNoteDecryptionCheck> control(pqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (CNoteDecryptionCheck& check : vChecks)
+            check();
+    }
+
+    for (size_t o = 0; o < vOutputs.size(); o++) {
+        // the first decryptor in map order wins, as with a serial scan
+        size_t nDecryptor = nNotFound;
+        for (size_t c = 0; c < nChecksPerOutput && nDecryptor == nNotFound; c++)
+            nDecryptor = vFound[o * nChecksPerOutput + c];
+        if (nDecryptor == nNotFound)
+            continue;
+
+        const CTransactionBase& tx = *vTx[vOutputs[o].nTx];
+        const NoteDecryptorMap::value_type& item = *vDecryptors[nDecryptor];
+        JSOutPoint jsoutpt {tx.GetHash(), vOutputs[o].i, vOutputs[o].j};
+        try {
+            libzcash::NotePlaintext plaintext;
+            auto nullifier = GetNoteNullifier(
+                tx.GetVjoinsplit()[vOutputs[o].i],
+                item.first,
+                item.second,
+                *vOutputs[o].hSig, vOutputs[o].j, &plaintext);
+            if (nullifier) {
+                CNoteData nd {item.first, *nullifier};
+                nd.plaintext = plaintext;
+                vNoteData[vOutputs[o].nTx].insert(std::make_pair(jsoutpt, nd));
+            } else {
+                CNoteData nd {item.first};
+                nd.plaintext = plaintext;
+                vNoteData[vOutputs[o].nTx].insert(std::make_pair(jsoutpt, nd));
             }
+        } catch (const std::exception &exc) {
+            // Unexpected failure
+            LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
+            LogPrintf("%s\n", exc.what());
         }
     }
-    return noteData;
+    return vNoteData;
 }
 
 bool CWallet::IsFromMe(const uint256& nullifier) const
@@ -2001,9 +2237,12 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             ReadBlockFromDisk(block, pindex);
             std::vector<const CTransactionBase*> vTxBase;
             block.GetTxAndCertsVector(vTxBase);
+            // trial-decrypt the notes of the whole block in one batch
+            std::vector<mapNoteData_t> vNoteData = FindMyNotes(vTxBase);
   
-            for (const CTransactionBase* obj: vTxBase)
+            for (size_t nTx = 0; nTx < vTxBase.size(); nTx++)
             {
+                const CTransactionBase* obj = vTxBase[nTx];
                 int bwtMatDepth = -1;
                 bool areBwtVoided = false;
 
@@ -2021,7 +2260,7 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
                         areBwtVoided = true;
                 }
 
-                if (AddToWalletIfInvolvingMe(*obj, &block, bwtMatDepth, fUpdate))
+                if (AddToWalletIfInvolvingMe(*obj, &block, bwtMatDepth, fUpdate, &vNoteData[nTx]))
                 {
                     ret++;
 
@@ -4225,37 +4464,24 @@ void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, st
 
     LOCK2(cs_main, cs_wallet);
 
-    for (auto & p : mapWallet) {
-        CWalletTransactionBase& wtx = *(p.second);
-        // Filter the transactions before checking for notes
-        if (!CheckFinalTx(*wtx.getTxBase()) || (wtx.getTxBase()->IsCoinBase() && !wtx.HasMatureOutputs()) || wtx.GetDepthInMainChain() < minDepth) {
-            continue;
-        }
-
-        if (wtx.mapNoteData.size() == 0) {
-            continue;
-        }
-
-        for (auto & pair : wtx.mapNoteData) {
-            JSOutPoint jsop = pair.first;
-            CNoteData nd = pair.second;
-            PaymentAddress pa = nd.address;
+    auto isTxFiltered = [minDepth](const CWalletTransactionBase& wtx) {
+        return !CheckFinalTx(*wtx.getTxBase()) || (wtx.getTxBase()->IsCoinBase() && !wtx.HasMatureOutputs()) || wtx.GetDepthInMainChain() < minDepth;
+    };
 
-            // skip notes which belong to a different payment address in the wallet
-            if (fFilterAddress && !(pa == filterPaymentAddress)) {
-                continue;
-            }
+    auto addNote = [&](const CWalletTransactionBase& wtx, const JSOutPoint& jsop, CNoteData& nd) {
+        const PaymentAddress& pa = nd.address;
 
-            // skip note which has been spent
-            if (ignoreSpent && nd.nullifier && IsSpent(*nd.nullifier)) {
-                continue;
-            }
+        // skip note which has been spent
+        if (ignoreSpent && nd.nullifier && IsSpent(*nd.nullifier)) {
+            return;
+        }
 
-            // skip notes which cannot be spent
-            if (ignoreUnspendable && !HaveSpendingKey(pa)) {
-                continue;
-            }
+        // skip notes which cannot be spent
+        if (ignoreUnspendable && !HaveSpendingKey(pa)) {
+            return;
+        }
 
+        if (!nd.plaintext) {
             int i = jsop.js; // Index into CTransaction.GetJoinsSplits()
             int j = jsop.n;  // Index into JSDescription.ciphertexts
 
@@ -4269,15 +4495,12 @@ void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, st
             // determine amount of funds in the note
             auto hSig = wtx.getTxBase()->GetVjoinsplit()[i].h_sig(*pzcashParams, wtx.getTxBase()->GetJoinSplitPubKey());
             try {
-                NotePlaintext plaintext = NotePlaintext::decrypt(
+                nd.plaintext = NotePlaintext::decrypt(
                         decryptor,
                         wtx.getTxBase()->GetVjoinsplit()[i].ciphertexts[j],
                         wtx.getTxBase()->GetVjoinsplit()[i].ephemeralKey,
                         hSig,
                         (unsigned char) j);
-
-                outEntries.push_back(CNotePlaintextEntry{jsop, plaintext});
-
             } catch (const note_decryption_failed &err) {
                 // Couldn't decrypt with this spending key
                 throw std::runtime_error(strprintf("Could not decrypt note for payment address %s", CZCPaymentAddress(pa).ToString()));
@@ -4286,6 +4509,50 @@ void CWallet::GetFilteredNotes(std::vector<CNotePlaintextEntry> & outEntries, st
                 throw std::runtime_error(strprintf("Error while decrypting note for payment address %s: %s", CZCPaymentAddress(pa).ToString(), exc.what()));
             }
         }
+
+        outEntries.push_back(CNotePlaintextEntry{jsop, *nd.plaintext});
+    };
+
+    if (fFilterAddress) {
+        // only visit the notes of the requested address, in the same order as a full scan
+        auto itNotes = mapAddressesToNotes.find(filterPaymentAddress);
+        if (itNotes == mapAddressesToNotes.end()) {
+            return;
+        }
+        uint256 lastHash;
+        bool fLastFiltered = true;
+        for (const JSOutPoint& jsop : itNotes->second) {
+            auto itWtx = mapWallet.find(jsop.hash);
+            if (itWtx == mapWallet.end()) {
+                continue;
+            }
+            CWalletTransactionBase& wtx = *(itWtx->second);
+            if (jsop.hash != lastHash) {
+                lastHash = jsop.hash;
+                fLastFiltered = isTxFiltered(wtx);
+            }
+            if (fLastFiltered) {
+                continue;
+            }
+            auto itNd = wtx.mapNoteData.find(jsop);
+            if (itNd == wtx.mapNoteData.end() || !(itNd->second.address == filterPaymentAddress)) {
+                continue;
+            }
+            addNote(wtx, jsop, itNd->second);
+        }
+        return;
+    }
+
+    for (auto & p : mapWallet) {
+        CWalletTransactionBase& wtx = *(p.second);
+        // Filter the transactions before checking for notes
+        if (wtx.mapNoteData.size() == 0 || isTxFiltered(wtx)) {
+            continue;
+        }
+
+        for (auto & pair : wtx.mapNoteData) {
+            addNote(wtx, pair.first, pair.second);
+        }
     }
 }
 
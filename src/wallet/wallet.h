@@ -62,7 +62,10 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //  Should be large enough that we can expect not to reorg beyond our cache
 //  unless there is some exceptional network disruption.
 static const unsigned int WITNESS_CACHE_SIZE = COINBASE_MATURITY;
+//! Number of wallet note decryptors a single trial decryption job tries on one ciphertext
+static const unsigned int NOTE_DECRYPTORS_PER_CHECK = 16;
 
+template <typename T> class CCheckQueue;
 class CBlockIndex;
 class CCoinControl;
 class COutput;
@@ -249,6 +252,15 @@ public:
      */
     int witnessHeight;
 
+    /**
+     * Decrypted plaintext of the note, memory only.
+     *
+     * Filled when the note is found by CWallet::FindMyNotes, or the first time
+     * CWallet::GetFilteredNotes needs it after the wallet is loaded, so that
+     * balance queries do not decrypt the same ciphertext over and over.
+     */
+    boost::optional<libzcash::NotePlaintext> plaintext;
+
     CNoteData() : address(), nullifier(), witnessHeight {-1} { }
     CNoteData(libzcash::PaymentAddress a) :
             address {a}, nullifier(), witnessHeight {-1} { }
@@ -281,6 +293,46 @@ public:
 
 typedef std::map<JSOutPoint, CNoteData> mapNoteData_t;
 
+/**
+ * Trial decryption of a JoinSplit ciphertext against a range of the wallet note
+ * decryptors. Records the index of the first decryptor of the range which opens
+ * the note, so that the master thread can keep the serial lookup order.
+ */
+class CNoteDecryptionCheck
+{
+private:
+    const JSDescription* jsdesc;
+    const uint256* hSig;
+    uint8_t n;
+    const std::vector<const NoteDecryptorMap::value_type*>* vDecryptors;
+    size_t nBegin;
+    size_t nEnd;
+    size_t* pnFound;
+
+public:
+    CNoteDecryptionCheck(): jsdesc(NULL), hSig(NULL), n(0), vDecryptors(NULL), nBegin(0), nEnd(0), pnFound(NULL) {}
+    CNoteDecryptionCheck(const JSDescription& jsdescIn, const uint256& hSigIn, uint8_t nIn,
+                         const std::vector<const NoteDecryptorMap::value_type*>& vDecryptorsIn,
+                         size_t nBeginIn, size_t nEndIn, size_t* pnFoundIn):
+        jsdesc(&jsdescIn), hSig(&hSigIn), n(nIn), vDecryptors(&vDecryptorsIn),
+        nBegin(nBeginIn), nEnd(nEndIn), pnFound(pnFoundIn) {}
+
+    bool operator()();
+
+    void swap(CNoteDecryptionCheck& check) {
+        std::swap(jsdesc, check.jsdesc);
+        std::swap(hSig, check.hSig);
+        std::swap(n, check.n);
+        std::swap(vDecryptors, check.vDecryptors);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pnFound, check.pnFound);
+    }
+};
+
+/** Run a worker thread for the wallet note trial decryption queue */
+void ThreadNoteDecryption();
+
 /** Decrypted note and its location in a transaction. */
 struct CNotePlaintextEntry
 {
@@ -955,6 +1007,21 @@ public:
      */
     std::map<uint256, JSOutPoint> mapNullifiersToNotes;
 
+    /**
+     * Notes of the wallet indexed by payment address, used by GetFilteredNotes
+     * to avoid walking mapWallet when looking for the notes of one address.
+     * Entries are only added: notes of transactions no longer in mapWallet are
+     * skipped on lookup.
+     */
+    std::map<libzcash::PaymentAddress, std::set<JSOutPoint>> mapAddressesToNotes;
+
+    /**
+     * Wallet transactions indexed by the transparent destinations they pay to
+     * or spend from, used by OrderedTxWithInputs. Only standard output scripts
+     * are indexed; the candidates are checked again when looked up.
+     */
+    std::map<CTxDestination, std::set<uint256>> mapAddressesToTxes;
+
 private:
     std::map<uint256, std::shared_ptr<CWalletTransactionBase> > mapWallet;
 public:
@@ -1069,11 +1136,15 @@ public:
     void MarkDirty();
     bool UpdateNullifierNoteMap();
     void UpdateNullifierNoteMapWithTx(const CWalletTransactionBase& wtx);
+    void UpdateAddressNoteMapWithTx(const CWalletTransactionBase& wtx);
+    void AddToAddressTxMap(const CWalletTransactionBase& wtx);
+    void RemoveFromAddressTxMap(const CWalletTransactionBase& wtx);
     bool AddToWallet(const CWalletTransactionBase& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock) override;
     void SyncCertificate(const CScCertificate& cert, const CBlock* pblock, int bwtMaturityDepth = -1) override;
     void SyncVoidedCert(const uint256& certHash, bool bwtAreStripped) override;
-    bool AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransactionBase& obj, const CBlock* pblock, int bwtMaturityDepth, bool fUpdate,
+                                  const mapNoteData_t* pNoteData = NULL);
     void EraseFromWallet(const uint256 &hash) override;
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
@@ -1135,8 +1206,13 @@ public:
         const libzcash::PaymentAddress& address,
         const ZCNoteDecryption& dec,
         const uint256& hSig,
-        uint8_t n) const;
+        uint8_t n,
+        libzcash::NotePlaintext* pPlaintext = NULL) const;
     mapNoteData_t FindMyNotes(const CTransactionBase& tx) const;
+    std::vector<mapNoteData_t> FindMyNotes(const std::vector<const CTransactionBase*>& vTx) const;
+    //! Same, fanning the trial decryptions out to the given queue, or running them all in the calling thread if NULL
+    std::vector<mapNoteData_t> FindMyNotes(const std::vector<const CTransactionBase*>& vTx,
+                                           CCheckQueue<CNoteDecryptionCheck>* pqueue) const;
     bool IsFromMe(const uint256& nullifier) const;
     void GetNoteWitnesses(
          std::vector<JSOutPoint> notes,
@@ -223,6 +223,23 @@ void initialize_curve_params()
     std::call_once (init_public_params_once_flag, curve_pp::init_public_params);
 }
 
+class ProofVerifier::ProofBatch {
+public:
+    std::mutex cs;
+    r1cs_ppzksnark_batch_verifier<curve_pp> pending;
+    // Key the pending proofs were added for; proofs for any other key
+    // are verified on their own.
+    const r1cs_ppzksnark_processed_verification_key<curve_pp>* pvk = nullptr;
+};
+
+ProofVerifier::ProofVerifier(bool perform_verification, bool batch_verification) :
+    perform_verification(perform_verification),
+    batch(batch_verification ? new ProofBatch() : nullptr) { }
+
+ProofVerifier::ProofVerifier(ProofVerifier&&) = default;
+ProofVerifier& ProofVerifier::operator=(ProofVerifier&&) = default;
+ProofVerifier::~ProofVerifier() = default;
+
 ProofVerifier ProofVerifier::Strict() {
     initialize_curve_params();
     return ProofVerifier(true);
@@ -233,6 +250,11 @@ ProofVerifier ProofVerifier::Disabled() {
     return ProofVerifier(false);
 }
 
+ProofVerifier ProofVerifier::Batch() {
+    initialize_curve_params();
+    return ProofVerifier(true, true);
+}
+
 template<>
 bool ProofVerifier::check(
     const r1cs_ppzksnark_verification_key<curve_pp>& vk,
@@ -241,11 +263,47 @@ bool ProofVerifier::check(
     const r1cs_ppzksnark_proof<curve_pp>& proof
 )
 {
-    if (perform_verification) {
+    if (!perform_verification) {
+        return true;
+    }
+    if (!batch) {
         return r1cs_ppzksnark_online_verifier_strong_IC<curve_pp>(pvk, primary_input, proof);
-    } else {
+    }
+
+    // The expensive part (scalar multiplications and a Miller loop)
+    // happens outside the lock, only the accumulators are shared.
+    r1cs_ppzksnark_batch_verifier<curve_pp> single;
+    if (!single.add(vk, primary_input, proof)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(batch->cs);
+        if (batch->pending.size() == 0) {
+            batch->pvk = &pvk;
+        }
+        if (batch->pvk == &pvk) {
+            batch->pending.merge(single);
+            return true;
+        }
+    }
+    return single.verify(pvk);
+}
+
+bool ProofVerifier::verify_batch()
+{
+    if (!batch) {
         return true;
     }
+
+    r1cs_ppzksnark_batch_verifier<curve_pp> pending;
+    const r1cs_ppzksnark_processed_verification_key<curve_pp>* pvk;
+    {
+        std::lock_guard<std::mutex> lock(batch->cs);
+        std::swap(pending, batch->pending);
+        pvk = batch->pvk;
+        batch->pvk = nullptr;
+    }
+    return pending.size() == 0 || pending.verify(*pvk);
 }
 
 }
@@ -4,6 +4,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
+
 namespace libzcash {
 
 const unsigned char G1_PREFIX_MASK = 0x02;
@@ -239,9 +241,12 @@ void initialize_curve_params();
 
 class ProofVerifier {
 private:
+    class ProofBatch;
+
     bool perform_verification;
+    std::unique_ptr<ProofBatch> batch;
 
-    ProofVerifier(bool perform_verification) : perform_verification(perform_verification) { }
+    ProofVerifier(bool perform_verification, bool batch_verification = false);
 
 public:
     // ProofVerifier should never be copied
@@ -249,6 +254,7 @@ public:
     ProofVerifier& operator=(const ProofVerifier&) = delete;
     ProofVerifier(ProofVerifier&&);
     ProofVerifier& operator=(ProofVerifier&&);
+    ~ProofVerifier();
 
     // Creates a verification context that strictly verifies
     // all proofs using libsnark's API.
@@ -259,6 +265,12 @@ public:
     // such as during reindexing.
     static ProofVerifier Disabled();
 
+    // Creates a verification context that only rejects malformed
+    // proofs in check() and accumulates the rest, so that they are
+    // all verified together by verify_batch(). check() may be called
+    // from several threads at once.
+    static ProofVerifier Batch();
+
     template <typename VerificationKey,
               typename ProcessedVerificationKey,
               typename PrimaryInput,
@@ -270,6 +282,11 @@ public:
         const PrimaryInput& pi,
         const Proof& p
     );
+
+    // Verifies the proofs accumulated since the last call, if this is
+    // a batch context; true if they (or none) all verify. The batch
+    // does not tell which proof failed.
+    bool verify_batch();
 };
 
 }
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <cstdio>
 #include <future>
 #include <map>
@@ -13,6 +14,7 @@
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
@@ -282,7 +284,7 @@ double benchmark_large_tx()
     return timer_stop(tv_start);
 }
 
-double benchmark_try_decrypt_notes(size_t nAddrs)
+double benchmark_try_decrypt_notes(size_t nAddrs, int nThreads)
 {
     CWallet wallet;
     for (int i = 0; i < nAddrs; i++) {
@@ -293,10 +295,31 @@ double benchmark_try_decrypt_notes(size_t nAddrs)
     auto sk = libzcash::SpendingKey::random();
     auto walletTx = GetValidReceive(*pzcashParams, sk, 10, true);
 
+    // a queue of our own, so that the node's note decryption threads do not take part in the run:
+    // with nThreads = 0 the calling thread does all the trial decryptions alone
+    CCheckQueue<CNoteDecryptionCheck> queue(128);
+    std::atomic<int> nStarted(0);
+    boost::thread_group workers;
+    for (int i = 0; i < nThreads; i++) {
+        workers.create_thread([&queue, &nStarted]() {
+            nStarted++;
+            queue.Thread();
+        });
+    }
+    while (nStarted < nThreads) {
+        MilliSleep(1);
+    }
+    std::vector<const CTransactionBase*> vTx(1, &walletTx.getWrappedTx());
+
     struct timeval tv_start;
     timer_start(tv_start);
-    auto nd = wallet.FindMyNotes(walletTx.getWrappedTx());
-    return timer_stop(tv_start);
+    auto nd = wallet.FindMyNotes(vTx, &queue);
+    double elapsed = timer_stop(tv_start);
+
+    // the workers only ever wait on this queue, which goes away with them
+    workers.interrupt_all();
+    workers.join_all();
+    return elapsed;
 }
 
 double benchmark_increment_note_witnesses(size_t nTxs)
@@ -355,6 +378,63 @@ double benchmark_increment_note_witnesses(size_t nTxs)
     return timer_stop(tv_start);
 }
 
+// Transaction carrying a single joinsplit with random commitments, enough for
+// the wallet to maintain witnesses without having to build any proof
+static CTransaction GetFakeJoinSplitTransaction()
+{
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    JSDescription jsdesc = JSDescription::getNewInstance(false);
+    for (auto& cm : jsdesc.commitments) {
+        cm = GetRandHash();
+    }
+    mtx.vjoinsplit.push_back(jsdesc);
+    return CTransaction(mtx);
+}
+
+double benchmark_increment_note_witnesses_wallet(size_t nNotes)
+{
+    CWallet wallet;
+    ZCIncrementalMerkleTree tree;
+
+    auto sk = libzcash::SpendingKey::random();
+    wallet.AddSpendingKey(sk);
+
+    // First block holds all the wallet notes
+    CBlock block1;
+    for (size_t i = 0; i < nNotes; i++) {
+        CWalletTx wtx {NULL, GetFakeJoinSplitTransaction()};
+
+        mapNoteData_t noteData;
+        JSOutPoint jsoutpt {wtx.getWrappedTx().GetHash(), 0, 1};
+        CNoteData nd {sk.address(), GetRandHash()};
+        noteData[jsoutpt] = nd;
+
+        wtx.SetNoteData(noteData);
+        wallet.AddToWallet(wtx, true, NULL);
+        block1.vtx.push_back(wtx.getWrappedTx());
+    }
+    CBlockIndex index1(block1);
+    index1.nHeight = 1;
+
+    // Increment to get the notes witnessed
+    wallet.ChainTip(&index1, &block1, tree, true);
+
+    // Second block only carries foreign commitments every wallet witness must absorb
+    CBlock block2;
+    block2.hashPrevBlock = block1.GetHash();
+    for (int i = 0; i < 100; i++) {
+        block2.vtx.push_back(GetFakeJoinSplitTransaction());
+    }
+    CBlockIndex index2(block2);
+    index2.nHeight = 2;
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    wallet.ChainTip(&index2, &block2, tree, true);
+    return timer_stop(tv_start);
+}
+
 // Fake the input of a given block
 class FakeCoinsViewDB : public CCoinsViewDB {
     uint256 hash;
@@ -13,8 +13,9 @@ extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
 extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
 extern double benchmark_verify_equihash();
 extern double benchmark_large_tx();
-extern double benchmark_try_decrypt_notes(size_t nAddrs);
+extern double benchmark_try_decrypt_notes(size_t nAddrs, int nThreads = 0);
 extern double benchmark_increment_note_witnesses(size_t nTxs);
+extern double benchmark_increment_note_witnesses_wallet(size_t nNotes);
 extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
@@ -74,14 +74,8 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
             break;
         }
 
-        fd_set socketSet;
-        FD_ZERO(&socketSet);
-        FD_SET(hSocket, &socketSet);
-
-        struct timeval timeout = {timeoutSec, 0};
-
         if (sslErr == SSL_ERROR_WANT_READ) {
-            int result = select(hSocket + 1, &socketSet, NULL, NULL, &timeout);
+            int result = WaitForSocket(hSocket, false, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("net", "TLS: ERROR: %s: %s: WANT_READ timeout\n", __FILE__, __func__);
                 nErr = -1;
@@ -92,7 +86,7 @@ int TLSManager::waitFor(SSLConnectionRoutine eRoutine, SOCKET hSocket, SSL* ssl,
                 break;
             }
         } else {
-            int result = select(hSocket + 1, NULL, &socketSet, NULL, &timeout);
+            int result = WaitForSocket(hSocket, true, timeoutSec * 1000);
             if (result == 0) {
                 LogPrint("net", "TLS: ERROR: %s: %s: WANT_WRITE timeout\n", __FILE__, __func__);
                 nErr = -1;
@@ -323,30 +317,23 @@ void TLSManager::cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection
  * @brief Handles send and recieve functionality in TLS Sockets.
  * 
  * @param pnode reference to the CNode object.
- * @param fdsetRecv 
- * @param fdsetSend 
- * @param fdsetError 
+ * @param recvSet the socket is readable or has a pending error
+ * @param sendSet the socket is writable
  * @return int returns -1 when socket is invalid. returns 0 otherwise.
  */
-int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError)
+int TLSManager::threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet)
 {
     //
     // Receive
     //
-    bool recvSet = false, sendSet = false, errorSet = false;
-
     {
         LOCK(pnode->cs_hSocket);
 
         if (pnode->hSocket == INVALID_SOCKET)
             return -1;
-
-        recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-        sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-        errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
     }
 
-    if (recvSet || errorSet) {
+    if (recvSet) {
         TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
         if (lockRecv) {
             {
@@ -398,12 +385,27 @@ int TLSManager::threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fds
                                 LogPrintf("ERROR: SSL_read %s\n", ERR_error_string(nRet, NULL));
                             pnode->CloseSocketDisconnect();
                         } else {
+#ifdef USE_EPOLL
+                            // no complete record buffered: wait for the next readiness edge
+                            if (nRet == SSL_ERROR_WANT_READ) {
+                                pnode->fRecvReady = false;
+                            } else {
+                                // preventive measure from exhausting CPU usage
+                                //
+                                MilliSleep(1); // 1 msec
+                            }
+#else
+                            if (nRet == SSL_ERROR_WANT_READ)
+                                pnode->fRecvReady = false;
                             // preventive measure from exhausting CPU usage
                             //
                             MilliSleep(1); // 1 msec
+#endif
                         }
                     } else {
-                        if (nRet != WSAEWOULDBLOCK && nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
+                        if (nRet == WSAEWOULDBLOCK)
+                            pnode->fRecvReady = false;
+                        else if (nRet != WSAEMSGSIZE && nRet != WSAEINTR && nRet != WSAEINPROGRESS) {
                             if (!pnode->fDisconnect)
                                 LogPrintf("ERROR: socket recv %s\n", NetworkErrorString(nRet));
                             pnode->CloseSocketDisconnect();
@@ -52,7 +52,7 @@ public:
      SSL* accept(SOCKET hSocket, const CAddress& addr);
      bool isNonTLSAddr(const string& strAddr, const vector<NODE_ADDR>& vPool, CCriticalSection& cs);
      void cleanNonTLSPool(std::vector<NODE_ADDR>& vPool, CCriticalSection& cs);
-     int threadSocketHandler(CNode* pnode, fd_set& fdsetRecv, fd_set& fdsetSend, fd_set& fdsetError);
+     int threadSocketHandler(CNode* pnode, bool recvSet, bool sendSet);
      bool initialize();
 };
 }
@@ -7,6 +7,8 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <cstdlib>
 #include <functional>
+#include <map>
+#include <memory>
 #include <iostream>
 #include <string>
 #include <thread>
@@ -38,8 +40,10 @@ static int tot_connections = 0;
 class WsNotificationInterface;
 class WsHandler;
 
+static int readblock(const CBlockIndex *pindex, std::string& blockData);
 static int getblock(const CBlockIndex *pindex, std::string& blockHexStr);
 static void ws_updatetip(const CBlockIndex *pindex);
+static void ws_cachetip(const CBlockIndex *pindex, const CBlock *pblock);
 
 static boost::shared_ptr<WsNotificationInterface> wsNotificationInterface;
 static std::list< boost::shared_ptr<WsHandler> > listWsHandler;
@@ -48,6 +52,12 @@ std::atomic<bool> exit_ws_thread{false};
 boost::thread ws_thread;
 std::mutex wsmtx;
 
+// the last block connected to the active chain, kept from the in-memory block so that the tip
+// update does not have to read it back from disk; it is serialized by ws_updatetip, outside cs_main
+static std::mutex wstipmtx;
+static uint256 wsTipHash;
+static std::shared_ptr<const CBlock> wsTipBlock;
+
 static void dumpUniValueError(const UniValue& error, std::string& outMsg)
 {
     UniValue errCode = find_value(error, "code");
@@ -79,6 +89,10 @@ protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {
         ws_updatetip(pindex);
     };
+    virtual void ChainTip(const CBlockIndex *pindex, const CBlock *pblock, ZCIncrementalMerkleTree tree, bool added) {
+        if (added)
+            ws_cachetip(pindex, pblock);
+    };
 public:
     ~WsNotificationInterface() 
     {
@@ -98,6 +112,7 @@ public:
         GET_MULTIPLE_BLOCK_HASHES = 1,
         GET_NEW_BLOCK_HASHES = 2,
         SEND_CERTIFICATE = 3,
+        SET_BINARY_MODE = 4,
         REQ_UNDEFINED = 0xff
     };
     
@@ -113,6 +128,9 @@ public:
     {
         payload.push_back(Pair("msgType", type));
     }
+    // a message which has already been rendered, possibly shared among many handlers
+    explicit WsEvent(const std::shared_ptr<const std::string>& frameIn, bool binaryIn = false):
+        type(MSG_EVENT), frame(frameIn), binary(binaryIn) {}
     WsEvent & operator=(const WsEvent& ws) = delete;
     WsEvent(const WsEvent& ws) = delete;
 
@@ -120,9 +138,68 @@ public:
         return &payload;
     }
 
+    std::shared_ptr<const std::string> getFrame() const {
+        if (frame)
+            return frame;
+        return std::make_shared<const std::string>(payload.write());
+    }
+
+    bool isBinary() const {
+        return binary;
+    }
+
+    static std::shared_ptr<const std::string> makeBlockEventFrame(int height, const std::string& strHash,
+            const std::string& blockHex, WsEventType eventType)
+    {
+        WsEvent wse(MSG_EVENT);
+        UniValue rspPayload(UniValue::VOBJ);
+        rspPayload.push_back(Pair("height", height));
+        rspPayload.push_back(Pair("hash", strHash));
+        rspPayload.push_back(Pair("block", blockHex));
+
+        UniValue* rv = wse.getPayload();
+        rv->push_back(Pair("eventType", eventType));
+        rv->push_back(Pair("eventPayload", rspPayload));
+        return wse.getFrame();
+    }
+
+    /*
+     * Binary frames are sent to clients which negotiated the binary mode with a SET_BINARY_MODE request.
+     * They carry the same content as the JSON messages without any hex encoding:
+     *   uint8     msgType   (MSG_EVENT or MSG_RESPONSE)
+     *   uint8     subType   (WsEventType for events, WsRequestType for responses)
+     *   string    requestId (compact size prefixed, empty for events)
+     *   int32     height
+     *   body:     GET_SINGLE_BLOCK and UPDATE_TIP -> uint256 hash followed by the serialized block
+     *             GET_MULTIPLE_BLOCK_HASHES and GET_NEW_BLOCK_HASHES -> vector<uint256> of hashes
+     * Errors and certificate responses are always sent as JSON text frames.
+     */
+    static std::shared_ptr<const std::string> makeBinaryFrame(WsMsgType msgType, int subType,
+            const std::string& clientRequestId, int height, const CDataStream& body)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << static_cast<uint8_t>(msgType);
+        ss << static_cast<uint8_t>(subType);
+        ss << clientRequestId;
+        ss << static_cast<int32_t>(height);
+        ss.write(&body[0], body.size());
+        return std::make_shared<const std::string>(ss.begin(), ss.end());
+    }
+
+    static std::shared_ptr<const std::string> makeBinaryBlockFrame(WsMsgType msgType, int subType,
+            const std::string& clientRequestId, int height, const uint256& hash, const std::string& blockData)
+    {
+        CDataStream body(SER_NETWORK, PROTOCOL_VERSION);
+        body << hash;
+        body.write(blockData.data(), blockData.size());
+        return makeBinaryFrame(msgType, subType, clientRequestId, height, body);
+    }
+
 private:
     WsMsgType type;
     UniValue payload;
+    std::shared_ptr<const std::string> frame;
+    bool binary = false;
 };
 
 
@@ -133,20 +210,13 @@ private:
     boost::shared_ptr< websocket::stream<tcp::socket>> localWs;
     boost::lockfree::queue<WsEvent*, boost::lockfree::capacity<1024>> wsq;
     std::atomic<bool> exit_rwhandler_thread_flag { false };
+    std::atomic<bool> binary_mode { false };
 
-    void sendBlockEvent(int height, const std::string& strHash, const std::string& blockHex, WsEvent::WsEventType eventType)
+    void sendFrame(const std::shared_ptr<const std::string>& frame, bool binary = false)
     {
-        // Send a message to the client:  type = eventType
-        WsEvent* wse = new WsEvent(WsEvent::MSG_EVENT);
+        // Send an already rendered message to the client
+        WsEvent* wse = new WsEvent(frame, binary);
         LogPrint("ws", "%s():%d - allocated %p\n", __func__, __LINE__, wse);
-        UniValue rspPayload(UniValue::VOBJ);
-        rspPayload.push_back(Pair("height", height));
-        rspPayload.push_back(Pair("hash", strHash));
-        rspPayload.push_back(Pair("block", blockHex));
-
-        UniValue* rv = wse->getPayload();
-        rv->push_back(Pair("eventType", eventType));
-        rv->push_back(Pair("eventPayload", rspPayload));
         wsq.push(wse);
     }
 
@@ -169,8 +239,21 @@ private:
     }
 
     void sendHashes(int height, std::list<CBlockIndex*>& listBlock,
-            WsEvent::WsMsgType msgType, std::string clientRequestId = "")
+            WsEvent::WsMsgType msgType, WsEvent::WsRequestType reqType, std::string clientRequestId = "")
     {
+        if (binary_mode)
+        {
+            std::vector<uint256> vHashes;
+            vHashes.reserve(listBlock.size());
+            for (const CBlockIndex* pindex : listBlock)
+                vHashes.push_back(pindex->GetBlockHash());
+
+            CDataStream body(SER_NETWORK, PROTOCOL_VERSION);
+            body << vHashes;
+            sendFrame(WsEvent::makeBinaryFrame(msgType, reqType, clientRequestId, height, body), true);
+            return;
+        }
+
         // Send a message to the client:  type = eventType
         WsEvent* wse = new WsEvent(msgType);
         LogPrint("ws", "%s():%d - allocated %p\n", __func__, __LINE__, wse);
@@ -256,6 +339,18 @@ private:
             LogPrint("ws", "%s():%d - block index not found for hash[%s]\n", __func__, __LINE__, strHash);
             return INVALID_PARAMETER;
         }
+        if (binary_mode)
+        {
+            std::string blockData;
+            int ret = readblock(pblockindex, blockData);
+            if (ret != OK)
+            {
+                return ret;
+            }
+            sendFrame(WsEvent::makeBinaryBlockFrame(WsEvent::MSG_RESPONSE, WsEvent::GET_SINGLE_BLOCK, clientRequestId,
+                pblockindex->nHeight, pblockindex->GetBlockHash(), blockData), true);
+            return OK;
+        }
         std::string block;
         int ret = getblock(pblockindex, block);
         if (ret != OK)
@@ -266,6 +361,24 @@ private:
         return OK;
     }
 
+    int setBinaryMode(bool fBinary, const std::string& clientRequestId)
+    {
+        binary_mode = fBinary;
+        LogPrint("ws", "%s():%d - connection[%u] binary mode %s\n", __func__, __LINE__, t_id, fBinary ? "on" : "off");
+
+        // the acknowledgement is always a JSON message, so that the client can parse it in either mode
+        WsEvent* wse = new WsEvent(WsEvent::MSG_RESPONSE);
+        LogPrint("ws", "%s():%d - allocated %p\n", __func__, __LINE__, wse);
+        UniValue rspPayload(UniValue::VOBJ);
+        rspPayload.push_back(Pair("binary", fBinary));
+
+        UniValue* rv = wse->getPayload();
+        rv->push_back(Pair("requestId", clientRequestId));
+        rv->push_back(Pair("responsePayload", rspPayload));
+        wsq.push(wse);
+        return OK;
+    }
+
     int sendBlocksFromHeight(const std::string& strHeight, const std::string& strLen, const std::string& clientRequestId)
     {
         std::string strHash;
@@ -324,7 +437,7 @@ private:
                 n++;
             }
         }
-        sendHashes(listBlock.front()->nHeight, listBlock, WsEvent::MSG_RESPONSE, clientRequestId);
+        sendHashes(listBlock.front()->nHeight, listBlock, WsEvent::MSG_RESPONSE, WsEvent::GET_MULTIPLE_BLOCK_HASHES, clientRequestId);
         return OK;
     }
 
@@ -398,7 +511,7 @@ private:
                 n++;
             }
         }
-        sendHashes(listBlock.front()->nHeight, listBlock, WsEvent::MSG_RESPONSE, clientRequestId);
+        sendHashes(listBlock.front()->nHeight, listBlock, WsEvent::MSG_RESPONSE, WsEvent::GET_NEW_BLOCK_HASHES, clientRequestId);
         return OK;
     }
 
@@ -434,8 +547,6 @@ private:
 
     void writeLoop()
     {
-        localWs->text(localWs->got_text());
-
         while (!exit_rwhandler_thread_flag)
         {
             if (!wsq.empty())
@@ -443,12 +554,15 @@ private:
                 WsEvent* wse;
                 if (wsq.pop(wse) && wse != NULL)
                 {
-                    std::string msg = wse->getPayload()->write();
+                    std::shared_ptr<const std::string> frame = wse->getFrame();
+                    const std::string& msg = *frame;
+                    bool fBinary = wse->isBinary();
                     LogPrint("ws", "%s():%d - deleting %p\n", __func__, __LINE__, wse);
                     delete wse;
                     if (localWs->is_open())
                     {
                         boost::beast::error_code ec;
+                        localWs->binary(fBinary);
                         localWs->write(boost::asio::buffer(msg), ec);
 
                         if (ec == websocket::error::closed)
@@ -462,7 +576,10 @@ private:
                             LogPrint("ws", "%s():%d - err[%d]: %s\n", __func__, __LINE__, ec.value(), ec.message());
                             break;
                         }
-                        LogPrint("ws", "%s():%d - msg[%s] written on client socket\n", __func__, __LINE__, msg);
+                        if (fBinary)
+                            LogPrint("ws", "%s():%d - binary msg of size=%d written on client socket\n", __func__, __LINE__, msg.size());
+                        else
+                            LogPrint("ws", "%s():%d - msg[%s] written on client socket\n", __func__, __LINE__, msg);
                     }
                     else
                     {
@@ -730,6 +847,28 @@ private:
                 return sendCertificate(cmdParams, clientRequestId, outMsg);
             }
 
+            if (requestType == std::to_string(WsEvent::SET_BINARY_MODE))
+            {
+                reqType = WsEvent::SET_BINARY_MODE;
+                if (clientRequestId.empty()) {
+                    LogPrint("ws", "%s():%d - clientRequestId empty: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_REQID;
+                }
+                const UniValue& reqPayload = find_value(request, "requestPayload");
+                if (reqPayload.isNull())
+                {
+                    LogPrint("ws", "%s():%d - requestPayload null: msg[%s]\n", __func__, __LINE__, msg);
+                    return INVALID_JSON_FORMAT;
+                }
+
+                const UniValue& binaryVal = find_value(reqPayload, "binary");
+                if (!binaryVal.isBool()) {
+                    LogPrint("ws", "%s():%d - binary missing or invalid: msg[%s]\n", __func__, __LINE__, msg);
+                    return MISSING_PARAMETER;
+                }
+                return setBinaryMode(binaryVal.get_bool(), clientRequestId);
+            }
+
             // if we are here that means it is no valid request type, and reqType is an enum defaulting to 255
             *((int*)(&reqType)) = std::stoi(requestType);
 
@@ -913,9 +1052,14 @@ public:
         }
     }
 
-    void send_tip_update(int height, const std::string& strHash, const std::string& blockHex)
+    bool isBinaryMode() const
     {
-        sendBlockEvent(height, strHash, blockHex, WsEvent::UPDATE_TIP);
+        return binary_mode;
+    }
+
+    void send_tip_update(const std::shared_ptr<const std::string>& tipFrame, bool binary)
+    {
+        sendFrame(tipFrame, binary);
     }
 
     void shutdown()
@@ -937,7 +1081,7 @@ public:
 };
 
 
-static int getblock(const CBlockIndex *pindex, std::string& strHex)
+static int readblock(const CBlockIndex *pindex, std::string& blockData)
 {
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     {
@@ -948,45 +1092,129 @@ static int getblock(const CBlockIndex *pindex, std::string& strHex)
             return WsHandler::READ_ERROR;
         }
         ss << block;
-        strHex = HexStr(ss.begin(), ss.end());
     }
+    blockData.assign(ss.begin(), ss.end());
     return WsHandler::OK;
 }
 
+static int getblock(const CBlockIndex *pindex, std::string& strHex)
+{
+    std::string blockData;
+    int ret = readblock(pindex, blockData);
+    if (ret != WsHandler::OK)
+        return ret;
+    strHex = HexStr(blockData.begin(), blockData.end());
+    return WsHandler::OK;
+}
+
+
 
 
+static bool ws_hasclients()
+{
+    std::unique_lock<std::mutex> lck(wsmtx);
+    return !listWsHandler.empty();
+}
+
+static void ws_cachetip(const CBlockIndex *pindex, const CBlock *pblock)
+{
+    // called with cs_main held for every connected block, skip the work while nobody is listening
+    if (pblock == NULL || !ws_hasclients())
+        return;
+
+    // only take a copy here, the serialization is left to ws_updatetip once cs_main is released
+    std::shared_ptr<const CBlock> block = std::make_shared<const CBlock>(*pblock);
+
+    std::unique_lock<std::mutex> lck(wstipmtx);
+    wsTipHash = pindex->GetBlockHash();
+    wsTipBlock = block;
+}
 
 static void ws_updatetip(const CBlockIndex *pindex)
 {
-    std::string strHex;
-    int ret = getblock(pindex, strHex);
-    if (ret != WsHandler::OK)
+    if (!ws_hasclients())
     {
-        // should not happen
-        LogPrint("ws", "%s():%d - ERROR: can not update tip\n", __func__, __LINE__);
+        LogPrint("ws", "%s():%d - there are no connected ws clients\n", __func__, __LINE__);
         return;
     }
+
+    const uint256 hash = pindex->GetBlockHash();
+    std::shared_ptr<const CBlock> block;
+    {
+        std::unique_lock<std::mutex> lck(wstipmtx);
+        if (wsTipBlock && wsTipHash == hash)
+            block = wsTipBlock;
+    }
+
+    std::shared_ptr<const std::string> blockData;
+    if (block)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << *block;
+        blockData = std::make_shared<const std::string>(ss.begin(), ss.end());
+    }
+    else
+    {
+        // the block was connected before any client was listening, fall back to disk
+        std::string strData;
+        int ret = readblock(pindex, strData);
+        if (ret != WsHandler::OK)
+        {
+            // should not happen
+            LogPrint("ws", "%s():%d - ERROR: can not update tip\n", __func__, __LINE__);
+            return;
+        }
+        blockData = std::make_shared<const std::string>(std::move(strData));
+    }
+
+    // note the mode of each handler, so that the frames can be rendered without holding wsmtx;
+    // a client switching mode meanwhile gets this update in its old mode
+    std::map<const WsHandler*, bool> mapBinaryMode;
+    bool fText = false, fBinary = false;
     {
         std::unique_lock<std::mutex> lck(wsmtx);
-        if (listWsHandler.size() )
+        for (const auto& h : listWsHandler)
         {
-            LogPrint("ws", "%s():%d - update tip loop on ws clients\n", __func__, __LINE__);
-            auto it = listWsHandler.begin();
-            while (it != listWsHandler.end())
-            {
-                LogPrint("ws", "%s():%d - call wshandler_send_tip_update to connection[%u]\n", __func__, __LINE__, (*it)->t_id);
-                (*it)->send_tip_update(pindex->nHeight, pindex->GetBlockHash().GetHex(), strHex);
-                ++it;
-            }
+            bool fBinaryMode = h->isBinaryMode();
+            mapBinaryMode[h.get()] = fBinaryMode;
+            (fBinaryMode ? fBinary : fText) = true;
         }
-        else
+    }
+
+    if (mapBinaryMode.empty())
+    {
+        LogPrint("ws", "%s():%d - there are no connected ws clients\n", __func__, __LINE__);
+        return;
+    }
+
+    // render each flavour of the message at most once, every handler queues a reference to the same frame
+    std::shared_ptr<const std::string> tipFrame;
+    std::shared_ptr<const std::string> tipBinaryFrame;
+    if (fBinary)
+        tipBinaryFrame = WsEvent::makeBinaryBlockFrame(WsEvent::MSG_EVENT, WsEvent::UPDATE_TIP, "",
+            pindex->nHeight, hash, *blockData);
+    if (fText)
+        tipFrame = WsEvent::makeBlockEventFrame(pindex->nHeight, hash.GetHex(),
+            HexStr(blockData->begin(), blockData->end()), WsEvent::UPDATE_TIP);
+
+    {
+        // walk the live list: handlers gone in the meantime must not be sent anything, as nobody
+        // would drain their queue, and those connected in the meantime get the frame of their mode if any
+        std::unique_lock<std::mutex> lck(wsmtx);
+        LogPrint("ws", "%s():%d - update tip loop on ws clients\n", __func__, __LINE__);
+        for (const auto& h : listWsHandler)
         {
-            LogPrint("ws", "%s():%d - there are no connected ws clients\n", __func__, __LINE__);
+            auto itMode = mapBinaryMode.find(h.get());
+            bool fBinaryMode = (itMode != mapBinaryMode.end()) ? itMode->second : h->isBinaryMode();
+            const std::shared_ptr<const std::string>& frame = fBinaryMode ? tipBinaryFrame : tipFrame;
+            if (!frame)
+                continue;
+            LogPrint("ws", "%s():%d - call wshandler_send_tip_update to connection[%u]\n", __func__, __LINE__, h->t_id);
+            h->send_tip_update(frame, fBinaryMode);
         }
     }
 }
 
-
 //------------------------------------------------------------------------------
 
 static tcp::acceptor* acceptor = NULL;